@@ -9,11 +9,17 @@
 #ifndef TXCGradeBlockingQueue_h
 #define TXCGradeBlockingQueue_h
 
+#include <stdint.h>
 #include <list>
+#include <iterator>
 #include <mutex>
 #include <condition_variable>
+#include <functional>
+#include <unordered_map>
 #include <assert.h>
 
+#include "../trace/trace.h"
+
 // TXCGradeBlockingQueue内部最多拥有_MAX_QUEUE_NUM(10)个队列（编号分别为1, 2, ... _MAX_QUEUE_NUM）
 // 在定义TXCGradeBlockingQueue对象时需要指定最大队列数量，并且在push item时需要指定队列编号，
 // 每次pop都会从编号为1的队列开始依次读取
@@ -22,13 +28,26 @@
 //
 // 注意：如果T的类型是普通指针，需要调用close，再通过pop遍历来delete；如果是对象或者智能指针，则调用clear即可释放内存
 //
-template<typename T>
+// 按key合并：设置了key_of（从item中取出key）后，队列中同一个key最多只有一个item
+//   push时如果队列中已经有相同key的item，则原地替换为新的item，不增加item数量；
+//   新的队列编号优先级更高时，item移到高优先级队列的末尾，否则保持原来的队列和位置
+//   cancel(key)通过索引在O(1)时间内删除还没有被pop的item
+// 适用于同一个对象的状态被频繁更新、消费者只关心最新状态的场景
+// 被替换和被cancel的item可以通过push的replaced、cancel的out取回；如果T是普通指针，需要调用者自己delete
+//
+template<typename T, typename Key = int64_t>
 class TXCGradeBlockingQueue {
 public:
-    TXCGradeBlockingQueue(): _closed(false), _items_size(0) {
+    typedef std::function<Key(const T&)> KeyExtractor;
+    
+    TXCGradeBlockingQueue(): _items_size(0), _closed(false) {
         _max_queue_num = 1;
     }
-    explicit TXCGradeBlockingQueue(int max_queue_num): _closed(false), _items_size(0) {
+    explicit TXCGradeBlockingQueue(int max_queue_num): _items_size(0), _closed(false) {
+        assert(max_queue_num >= 1 && max_queue_num <= _MAX_QUEUE_NUM);
+        _max_queue_num = max_queue_num;
+    }
+    TXCGradeBlockingQueue(int max_queue_num, KeyExtractor key_of): _items_size(0), _closed(false), _key_of(std::move(key_of)) {
         assert(max_queue_num >= 1 && max_queue_num <= _MAX_QUEUE_NUM);
         _max_queue_num = max_queue_num;
     }
@@ -43,6 +62,13 @@ public:
         _max_queue_num = max_grade;
     }
     
+    // 需要在push之前设置
+    void setKeyExtractor(KeyExtractor key_of) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        assert(0 == _items_size);
+        _key_of = std::move(key_of);
+    }
+    
     // close后将只能读取数据
     void close() {
         std::lock_guard<std::mutex> lock(_mutex);
@@ -71,25 +97,63 @@ public:
                 _queue[i].pop_front();
             }
         }
+        _index.clear();
     }
     
+    // 按key合并时，如果替换了队列中已有的item，*is_replaced为true，被替换的item移到*replaced中
     template <typename TT>
-    bool push(TT &&item, int queue_index) {
+    bool push(TT &&item, int queue_index, T *replaced = nullptr, bool *is_replaced = nullptr) {
+        if (is_replaced) *is_replaced = false;
         if (queue_index < 1 || queue_index > _max_queue_num) {
             return false;
         }
         std::lock_guard<std::mutex> lock(_mutex);
         if (_closed) return false;
-        _queue[queue_index-1].emplace_back(std::forward<TT>(item));
+        if (_key_of) {
+            Key key = _key_of(item);
+            auto found = _index.find(key);
+            if (found != _index.end()) {
+                // 原地替换，优先级更高时移到对应队列的末尾
+                Entry &entry = found->second;
+                if (replaced) *replaced = std::move(*entry.it);
+                if (is_replaced) *is_replaced = true;
+                *entry.it = std::forward<TT>(item);
+                if (queue_index - 1 < entry.queue) {
+                    _queue[queue_index-1].splice(_queue[queue_index-1].end(), _queue[entry.queue], entry.it);
+                    entry.queue = queue_index - 1;
+                }
+                return true;
+            }
+            _queue[queue_index-1].emplace_back(std::forward<TT>(item));
+            _index.emplace(std::move(key), Entry{queue_index - 1, std::prev(_queue[queue_index-1].end())});
+        } else {
+            _queue[queue_index-1].emplace_back(std::forward<TT>(item));
+        }
         _items_size ++;
         _cond.notify_one();
         return true;
     }
     
+    // 删除还没有被pop的item，需要设置key_of；out不为空时被删除的item移到*out中
+    // 删除成功返回true，队列中没有这个key返回false
+    bool cancel(const Key &key, T *out = nullptr) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto found = _index.find(key);
+        if (found == _index.end()) {
+            return false;
+        }
+        if (out) *out = std::move(*found->second.it);
+        _queue[found->second.queue].erase(found->second.it);
+        _index.erase(found);
+        _items_size --;
+        return true;
+    }
+    
     // 若closed为true, pop将不再阻塞
     // 读取数据成功返回true，否则返回false
     // timeout单位为毫秒, -1表示不设置超时
     bool pop(T &item, int timeout = -1) {
+        TRACE_SCOPE("TXCGradeBlockingQueue::pop");
         std::unique_lock<std::mutex> lock(_mutex);
         if (-1 == timeout) {
             _cond.wait(lock, [this]{return _items_size || _closed;});
@@ -102,6 +166,9 @@ public:
         if (_items_size) {
             for (int i = 0; i < _max_queue_num; ++i) {
                 if (!_queue[i].empty()) {
+                    if (_key_of) {
+                        _index.erase(_key_of(_queue[i].front()));
+                    }
                     item = std::move(_queue[i].front());
                     _queue[i].pop_front();
                     _items_size --;
@@ -121,6 +188,12 @@ public:
     }
     
 private:
+    // item所在的队列下标（从0开始）和在队列中的位置，list的迭代器在splice之后仍然有效
+    struct Entry {
+        int queue;
+        typename std::list<T>::iterator it;
+    };
+    
     static const int        _MAX_QUEUE_NUM = 10;
     mutable std::mutex      _mutex;
     std::condition_variable _cond;
@@ -128,6 +201,8 @@ private:
     size_t                  _items_size;
     bool                    _closed;
     int                     _max_queue_num;
+    KeyExtractor            _key_of;
+    std::unordered_map<Key, Entry> _index;
 };
 
 
@@ -6,6 +6,7 @@
 //  Copyright © 2016年 gansidui. All rights reserved.
 //
 
+#include <stdlib.h>
 #include <iostream>
 #include <thread>
 #include <future>
@@ -13,7 +14,89 @@
 
 #include "TXCGradeBlockingQueue.h"
 
+struct Update {
+    int id;
+    int version;
+};
+
+// 按id合并：同一个id只保留最新的版本
+static void testCoalesce() {
+    TXCGradeBlockingQueue<Update, int> q(3, [](const Update &u) { return u.id; });
+    Update u, old;
+    bool replaced = false, ok;
+    
+    for (int version = 1; version <= 100; ++version) {
+        for (int id = 0; id < 10; ++id) {
+            q.push(Update{id, version}, 3);
+        }
+    }
+    if (q.size() != 10) {
+        exit(-1);
+    }
+    
+    // id为5的更新优先级提高，移到1号队列，取回被替换的版本
+    q.push(Update{5, 101}, 1, &old, &replaced);
+    if (!replaced || old.id != 5 || old.version != 100) {
+        exit(-1);
+    }
+    // id为5的更新优先级降低（3号低于1号），只替换内容，仍然在1号队列
+    q.push(Update{5, 102}, 3, &old, &replaced);
+    if (!replaced || old.version != 101) {
+        exit(-1);
+    }
+    // id为6先提高到2号队列，再降低到3号，仍然在2号队列
+    q.push(Update{6, 103}, 2);
+    q.push(Update{6, 104}, 3);
+    // 新的id没有替换
+    q.push(Update{10, 1}, 3, &old, &replaced);
+    if (replaced || q.size() != 11) {
+        exit(-1);
+    }
+    
+    // 取消id为0和9，取回被取消的item
+    ok = q.cancel(0, &u);
+    if (!ok || u.id != 0 || u.version != 100) {
+        exit(-1);
+    }
+    ok = q.cancel(9);
+    if (!ok) {
+        exit(-1);
+    }
+    ok = q.cancel(9);
+    if (ok || q.size() != 9) {
+        exit(-1);
+    }
+    
+    // 1号队列：5；2号队列：6；3号队列：其余的id按原来的顺序，最后是10
+    const int expect_id[] = { 5, 6, 1, 2, 3, 4, 7, 8, 10 };
+    const int expect_version[] = { 102, 104, 100, 100, 100, 100, 100, 100, 1 };
+    for (int i = 0; i < 9; ++i) {
+        ok = q.pop(u, 0);
+        if (!ok || u.id != expect_id[i] || u.version != expect_version[i]) {
+            exit(-1);
+        }
+    }
+    if (q.size() != 0) {
+        exit(-1);
+    }
+    
+    // pop之后同一个key可以重新入队
+    q.push(Update{1, 200}, 2);
+    if (q.size() != 1) {
+        exit(-1);
+    }
+    q.clear();
+    ok = q.cancel(1);
+    if (ok) {
+        exit(-1);
+    }
+    
+    std::cout << "coalesce ok" << std::endl;
+}
+
 int main() {
+    testCoalesce();
+    
     TXCGradeBlockingQueue<int> q(2);
     
     auto fut1 = std::async(std::launch::async, [&q]() {
@@ -1,5 +1,13 @@
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "base64.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BASE64_X86
+#include <immintrin.h>
+#endif
+
 static const char table64[] = {
 	'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
 	'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
@@ -11,118 +19,687 @@ static const char table64[] = {
 	'4', '5', '6', '7', '8', '9', '+', '/'
 };
 
+// 字符到6位值的反查表，非法字符为0xff
+static const unsigned char dtable64[256] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
 // 将3个字节编码成4个字节
-static void encode(unsigned char src[3], unsigned char dst[4]) {
-	unsigned char buf[4];
-	int i = 0;
+static void encode(const unsigned char src[3], unsigned char dst[4]) {
+	dst[0] = table64[(src[0] & 0xfc) >> 2];
+	dst[1] = table64[((src[0] & 0x03) << 4) + ((src[1] & 0xf0) >> 4)];
+	dst[2] = table64[((src[1] & 0x0f) << 2) + ((src[2] & 0xc0) >> 6)];
+	dst[3] = table64[src[2] & 0x3f];
+}
+
+// 将4个字节解码成3个字节，src必须都是合法字符
+static void decode(const unsigned char src[4], unsigned char dst[3]) {
+	unsigned char a = dtable64[src[0]], b = dtable64[src[1]], c = dtable64[src[2]], d = dtable64[src[3]];
+
+	dst[0] = (a << 2) + ((b & 0x30) >> 4);
+	dst[1] = ((b & 0xf) << 4) + ((c & 0x3c) >> 2);
+	dst[2] = ((c & 0x3) << 6) + d;
+}
+
+static bool is_base64_chars(unsigned char c) {
+	return dtable64[c] != 0xff;
+}
+
+// 以下*_blocks函数只处理完整的分组：编码每次3字节，解码每次4个字符
+// 返回已处理的输入长度，输出长度由调用者按3:4换算
+//
+// 解码遇到包含非法字符或者'='的分组时停止，由调用者逐个字符处理剩余部分（确定出错位置、处理padding）
+// dst_room为dst的可用空间，SIMD实现每次会多写几个字节，空间不足时停止
+
+static size_t encode_blocks_scalar(const unsigned char *src, size_t n, unsigned char *dst) {
+	size_t i = 0;
+	for (; n - i >= 3; i += 3, dst += 4) {
+		unsigned int v = (src[i] << 16) | (src[i+1] << 8) | src[i+2];
+		dst[0] = table64[v >> 18];
+		dst[1] = table64[(v >> 12) & 0x3f];
+		dst[2] = table64[(v >> 6) & 0x3f];
+		dst[3] = table64[v & 0x3f];
+	}
+	return i;
+}
+
+static size_t decode_blocks_scalar(const unsigned char *src, size_t n, unsigned char *dst, size_t dst_room) {
+	size_t i = 0;
+	for (; n - i >= 4 && dst_room >= 3; i += 4, dst += 3, dst_room -= 3) {
+		unsigned int a = dtable64[src[i]], b = dtable64[src[i+1]], c = dtable64[src[i+2]], d = dtable64[src[i+3]];
+		if ((a | b | c | d) & 0x80) {
+			break;
+		}
+		unsigned int v = (a << 18) | (b << 12) | (c << 6) | d;
+		dst[0] = (unsigned char)(v >> 16);
+		dst[1] = (unsigned char)(v >> 8);
+		dst[2] = (unsigned char)v;
+	}
+	return i;
+}
+
+#ifdef BASE64_X86
+
+// SSE4.1/AVX2的编解码参考Wojciech Muła和Daniel Lemire的向量化base64算法：
+// 编码：把3字节拆成4个6位值（pshufb重排 + 乘法移位），再通过按区间查偏移表得到字符
+// 解码：用高/低4位分别查表做合法性校验，查偏移表把字符转成6位值，再用madd合并成3字节
+
+#define ENC_SHUFFLE		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+#define ENC_SHIFT_LUT	'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, \
+						'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, \
+						'/' - 63, 'A', 0, 0
+#define DEC_LUT_LO		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, \
+						0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a
+#define DEC_LUT_HI		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, \
+						0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+#define DEC_LUT_ROLL	0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+#define DEC_PACK		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+__attribute__((target("ssse3,sse4.1")))
+static size_t encode_blocks_sse41(const unsigned char *src, size_t n, unsigned char *dst) {
+	const __m128i shuffle = _mm_set_epi8(ENC_SHUFFLE);
+	const __m128i shift_lut = _mm_setr_epi8(ENC_SHIFT_LUT);
+	size_t i = 0;
+
+	// 每次读16字节，只用前12字节
+	for (; n - i >= 16; i += 12, dst += 16) {
+		__m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), shuffle);
+		__m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+		__m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+		__m128i idx = _mm_or_si128(t0, t1);
+		__m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+		r = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, r), idx);
+		_mm_storeu_si128((__m128i*)dst, r);
+	}
+	return i;
+}
+
+__attribute__((target("ssse3,sse4.1")))
+static size_t decode_blocks_sse41(const unsigned char *src, size_t n, unsigned char *dst, size_t dst_room) {
+	const __m128i lut_lo = _mm_setr_epi8(DEC_LUT_LO);
+	const __m128i lut_hi = _mm_setr_epi8(DEC_LUT_HI);
+	const __m128i lut_roll = _mm_setr_epi8(DEC_LUT_ROLL);
+	const __m128i pack = _mm_setr_epi8(DEC_PACK);
+	const __m128i mask_0f = _mm_set1_epi8(0x0f);
+	const __m128i mask_2f = _mm_set1_epi8(0x2f);
+	size_t i = 0;
+
+	// 每次解码16个字符得到12字节，但会写16字节
+	for (; n - i >= 16 && dst_room >= 16; i += 16, dst += 12, dst_room -= 12) {
+		__m128i str = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_0f);
+		__m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(str, mask_0f));
+		__m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+		if (!_mm_testz_si128(lo, hi)) {
+			break;
+		}
+		__m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(str, mask_2f), hi_nibbles));
+		str = _mm_add_epi8(str, roll);
+		str = _mm_madd_epi16(_mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+		_mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi8(str, pack));
+	}
+	return i;
+}
 
-	buf[0] = (src[0] & 0xfc) >> 2;
-	buf[1] = ((src[0] & 0x03) << 4) + ((src[1] & 0xf0) >> 4);
-	buf[2] = ((src[1] & 0x0f) << 2) + ((src[2] & 0xc0) >> 6);
-	buf[3] = src[2] & 0x3f;
+__attribute__((target("avx2")))
+static size_t encode_blocks_avx2(const unsigned char *src, size_t n, unsigned char *dst) {
+	const __m256i shuffle = _mm256_set_epi8(ENC_SHUFFLE, ENC_SHUFFLE);
+	const __m256i shift_lut = _mm256_setr_epi8(ENC_SHIFT_LUT, ENC_SHIFT_LUT);
+	size_t i = 0;
 
-	for (i = 0; i < 4; ++i) {
-		dst[i] = table64[buf[i]];
+	// 两个128位通道分别读取[i, i+16)和[i+12, i+28)，每次处理24字节
+	for (; n - i >= 28; i += 24, dst += 32) {
+		__m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + i))),
+			_mm_loadu_si128((const __m128i*)(src + i + 12)), 1);
+		in = _mm256_shuffle_epi8(in, shuffle);
+		__m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+		__m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+		__m256i idx = _mm256_or_si256(t0, t1);
+		__m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+		r = _mm256_or_si256(r, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+		r = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, r), idx);
+		_mm256_storeu_si256((__m256i*)dst, r);
 	}
+	return i;
 }
 
-// 将4个字节解码成3个字节
-static void decode(unsigned char src[4], unsigned char dst[3]) {
-	unsigned char buf[3], tmp[4];
-	int i = 0, j = 0;
+__attribute__((target("avx2")))
+static size_t decode_blocks_avx2(const unsigned char *src, size_t n, unsigned char *dst, size_t dst_room) {
+	const __m256i lut_lo = _mm256_setr_epi8(DEC_LUT_LO, DEC_LUT_LO);
+	const __m256i lut_hi = _mm256_setr_epi8(DEC_LUT_HI, DEC_LUT_HI);
+	const __m256i lut_roll = _mm256_setr_epi8(DEC_LUT_ROLL, DEC_LUT_ROLL);
+	const __m256i pack = _mm256_setr_epi8(DEC_PACK, DEC_PACK);
+	const __m256i pack_lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+	const __m256i mask_0f = _mm256_set1_epi8(0x0f);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+	size_t i = 0;
 
-	for (i = 0; i < 4; ++i) {
-		for (j = 0; j < 64; ++j) {
-			if (src[i] == table64[j]) {
-				tmp[i] = j;
-				break;
-			}
+	// 每次解码32个字符得到24字节，但会写32字节
+	for (; n - i >= 32 && dst_room >= 32; i += 32, dst += 24, dst_room -= 24) {
+		__m256i str = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_0f);
+		__m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(str, mask_0f));
+		__m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+		if (!_mm256_testz_si256(lo, hi)) {
+			break;
 		}
+		__m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(str, mask_2f), hi_nibbles));
+		str = _mm256_add_epi8(str, roll);
+		str = _mm256_madd_epi16(_mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+		str = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(str, pack), pack_lanes);
+		_mm256_storeu_si256((__m256i*)dst, str);
 	}
+	return i;
+}
+
+// AVX-512 VBMI：vpermb直接按64字符表查表，vpmultishiftqb一次取出所有6位值，每次处理48字节/64字符
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static size_t encode_blocks_avx512vbmi(const unsigned char *src, size_t n, unsigned char *dst) {
+	const __m512i shuffle = _mm512_setr_epi32(0x01020001, 0x04050304, 0x07080607, 0x0a0b090a, 0x0d0e0c0d, 0x10110f10, 0x13141213, 0x16171516, 0x191a1819, 0x1c1d1b1c, 0x1f201e1f, 0x22232122, 0x25262425, 0x28292728, 0x2b2c2a2b, 0x2e2f2d2e);
+	const __m512i shifts = _mm512_set1_epi64(0x3036242a1016040aLL);
+	const __m512i lookup = _mm512_loadu_si512((const void*)table64);
+	size_t i = 0;
 
-	dst[0] = (tmp[0] << 2) + ((tmp[1] & 0x30) >> 4);
-	dst[1] = ((tmp[1] & 0xf) << 4) + ((tmp[2] & 0x3c) >> 2);
-	dst[2] = ((tmp[2] & 0x3) << 6) + tmp[3];
+	for (; n - i >= 48; i += 48, dst += 64) {
+		__m512i in = _mm512_maskz_loadu_epi8(0x0000ffffffffffffULL, src + i);
+		in = _mm512_permutexvar_epi8(shuffle, in);
+		__m512i idx = _mm512_multishift_epi64_epi8(shifts, in);
+		_mm512_storeu_si512((void*)dst, _mm512_permutexvar_epi8(idx, lookup));
+	}
+	return i;
 }
 
-static bool is_base64_chars(unsigned char c) {
-	if (('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || '+' == c || '/' == c) {
-		return true;
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static size_t decode_blocks_avx512vbmi(const unsigned char *src, size_t n, unsigned char *dst, size_t dst_room) {
+	static const unsigned char pack_idx[64] = {
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, 18, 17, 16, 22, 21, 20, 26, 25, 24, 30, 29, 28, 34, 33, 32, 38, 37, 36, 42, 41, 40, 46, 45, 44, 50, 49, 48, 54, 53, 52, 58, 57, 56, 62, 61, 60
+	};
+	// dtable64的前128项，非法字符的值最高位为1
+	const __m512i lookup_0 = _mm512_loadu_si512((const void*)dtable64);
+	const __m512i lookup_1 = _mm512_loadu_si512((const void*)(dtable64 + 64));
+	const __m512i pack = _mm512_loadu_si512((const void*)pack_idx);
+	size_t i = 0;
+
+	// 按掩码只写48字节
+	for (; n - i >= 64 && dst_room >= 48; i += 64, dst += 48, dst_room -= 48) {
+		__m512i str = _mm512_loadu_si512((const void*)(src + i));
+		__m512i val = _mm512_permutex2var_epi8(lookup_0, str, lookup_1);
+		if (_mm512_movepi8_mask(_mm512_or_si512(val, str))) {
+			break;
+		}
+		val = _mm512_madd_epi16(_mm512_maddubs_epi16(val, _mm512_set1_epi32(0x01400140)), _mm512_set1_epi32(0x00011000));
+		_mm512_mask_storeu_epi8(dst, 0x0000ffffffffffffULL, _mm512_permutexvar_epi8(pack, val));
 	}
-	return false;
+	return i;
 }
 
-bool base64_encode(const unsigned char *src, int src_len, unsigned char *dst, int dst_max_size, int *dst_len) {
-	int i = 0, j = 0, enc_len = 0;
-	unsigned char tmp[3];
+#endif	// BASE64_X86
 
-	if (dst_max_size * 3 < src_len * 4 + 10) {
+typedef size_t (*encode_blocks_func)(const unsigned char *src, size_t n, unsigned char *dst);
+typedef size_t (*decode_blocks_func)(const unsigned char *src, size_t n, unsigned char *dst, size_t dst_room);
+
+static encode_blocks_func encode_blocks_impl = NULL;
+static decode_blocks_func decode_blocks_impl = NULL;
+static int kernel_current = BASE64_KERNEL_AUTO;
+
+static bool kernel_supported(int kernel) {
+	switch (kernel) {
+	case BASE64_KERNEL_SCALAR:
+		return true;
+#ifdef BASE64_X86
+	case BASE64_KERNEL_SSE41:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3");
+	case BASE64_KERNEL_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	case BASE64_KERNEL_AVX512VBMI:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw");
+#endif
+	default:
 		return false;
 	}
+}
+
+bool base64_set_kernel(int kernel) {
+	encode_blocks_func enc = encode_blocks_scalar;
+	decode_blocks_func dec = decode_blocks_scalar;
 
-	while (src_len--) {
-		tmp[i++] = *src++;
-		if (3 == i) {
-			encode(tmp, dst + enc_len);
-			enc_len += 4;
-			i = 0;
+	// 运行时根据CPUID选择最快的实现
+	if (BASE64_KERNEL_AUTO == kernel) {
+		for (kernel = BASE64_KERNEL_AVX512VBMI; kernel > BASE64_KERNEL_SCALAR; --kernel) {
+			if (kernel_supported(kernel)) break;
 		}
+	} else if (!kernel_supported(kernel)) {
+		return false;
+	}
+
+	switch (kernel) {
+#ifdef BASE64_X86
+	case BASE64_KERNEL_SSE41:
+		enc = encode_blocks_sse41;
+		dec = decode_blocks_sse41;
+		break;
+	case BASE64_KERNEL_AVX2:
+		enc = encode_blocks_avx2;
+		dec = decode_blocks_avx2;
+		break;
+	case BASE64_KERNEL_AVX512VBMI:
+		enc = encode_blocks_avx512vbmi;
+		dec = decode_blocks_avx512vbmi;
+		break;
+#endif
+	default:
+		break;
+	}
+
+	decode_blocks_impl = dec;
+	encode_blocks_impl = enc;
+	kernel_current = kernel;
+	return true;
+}
+
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+// 没有通过base64_set_kernel指定时，根据CPUID自动选择
+static void select_kernel_once() {
+	if (!encode_blocks_impl || !decode_blocks_impl) {
+		base64_set_kernel(BASE64_KERNEL_AUTO);
+	}
+}
+
+// 只在第一次调用时检测，多个线程同时第一次编解码时只有一个线程选择，其他线程等它完成
+static void select_kernel() {
+	pthread_once(&kernel_once, select_kernel_once);
+}
+
+int base64_get_kernel() {
+	select_kernel();
+	return kernel_current;
+}
+
+const char* base64_kernel_name(int kernel) {
+	static const char *names[] = { "auto", "scalar", "sse4.1", "avx2", "avx512vbmi" };
+	if (kernel < BASE64_KERNEL_AUTO || kernel > BASE64_KERNEL_AVX512VBMI) {
+		return "unknown";
+	}
+	return names[kernel];
+}
+
+// 先用SIMD处理大块数据，剩余的完整分组用查表处理
+static size_t encode_blocks(const unsigned char *src, size_t n, unsigned char *dst) {
+	select_kernel();
+
+	size_t i = encode_blocks_impl(src, n, dst);
+	return i + encode_blocks_scalar(src + i, n - i, dst + i / 3 * 4);
+}
+
+static size_t decode_blocks(const unsigned char *src, size_t n, unsigned char *dst, size_t dst_room) {
+	select_kernel();
+
+	size_t i = decode_blocks_impl(src, n, dst, dst_room);
+	return i + decode_blocks_scalar(src + i, n - i, dst + i / 4 * 3, dst_room - i / 4 * 3);
+}
+
+size_t base64_encoded_len(size_t src_len) {
+	return (src_len + 2) / 3 * 4;
+}
+
+size_t base64_decoded_len(const unsigned char *src, size_t src_len) {
+	size_t pad = 0, n = 0;
+
+	// 末尾最多2个'='
+	while (pad < 2 && pad < src_len && '=' == src[src_len - pad - 1]) {
+		pad++;
+	}
+	n = src_len - pad;
+	return n / 4 * 3 + (n % 4 > 1 ? n % 4 - 1 : 0);
+}
+
+// 编码完整分组之后剩余的0~2个字节，输出4个字符（含padding）
+static size_t encode_tail(const unsigned char *src, size_t rem, unsigned char *dst) {
+	unsigned char tmp[3] = { 0, 0, 0 };
+	size_t i = 0;
+
+	if (0 == rem) {
+		return 0;
+	}
+	memcpy(tmp, src, rem);
+	encode(tmp, dst);
+	for (i = rem + 1; i < 4; ++i) {
+		dst[i] = '=';
+	}
+	return 4;
+}
+
+bool base64_encode(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len) {
+	size_t i = 0, enc_len = 0;
+
+	if (dst_max_size < base64_encoded_len(src_len) + 1) {
+		return false;
+	}
+
+	i = encode_blocks(src, src_len, dst);
+	enc_len = i / 3 * 4;
+	enc_len += encode_tail(src + i, src_len - i, dst + enc_len);
+
+	dst[enc_len] = '\0';
+	*dst_len = enc_len;
+
+	return true;
+}
+
+void base64_decode_init(base64_decode_state *state) {
+	state->len = 0;
+	state->done = false;
+}
+
+// 逐个字符解码，凑满4个字符时输出3字节
+static bool decode_push_char(base64_decode_state *state, unsigned char c, unsigned char *dst, size_t *dec_len) {
+	if ('=' == c) {
+		state->done = true;
+		return true;
+	}
+	if (!is_base64_chars(c)) {
+		return false;
+	}
+
+	state->buf[state->len++] = c;
+	if (4 == state->len) {
+		decode(state->buf, dst + *dec_len);
+		*dec_len += 3;
+		state->len = 0;
 	}
+	return true;
+}
 
-	if (i > 0) {
-		for (j = i; j < 3; ++j) {
-			tmp[j] = '\0';
+// 从src[j]开始逐个字符解码到dst + *dec_len，直到遇到'='或者输入结束，最后输出不完整的分组
+// 遇到非法字符返回false，并将其位置写入*err_pos
+static bool decode_tail(const unsigned char *src, size_t j, size_t src_len, unsigned char *dst, size_t *dec_len, size_t *err_pos) {
+	base64_decode_state state;
+	size_t n = 0;
+
+	base64_decode_init(&state);
+	for (; j < src_len && !state.done; ++j) {
+		if (!decode_push_char(&state, src[j], dst, dec_len)) {
+			if (err_pos) *err_pos = j;
+			return false;
 		}
-		encode(tmp, dst + enc_len);
-		enc_len += (i + 1);
+	}
+	base64_decode_final(&state, dst + *dec_len, 2, &n);
+	*dec_len += n;
+	return true;
+}
+
+bool base64_decode(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len) {
+	size_t j = 0, dec_len = 0;
+
+	if (dst_max_size < base64_decoded_len(src, src_len) + 1) {
+		return false;
+	}
+
+	// 完整且合法的分组批量解码，剩余部分（含'='或者非法字符的分组、末尾不足4个字符）逐个字符处理
+	j = decode_blocks(src, src_len, dst, dst_max_size);
+	dec_len = j / 4 * 3;
+	if (!decode_tail(src, j, src_len, dst, &dec_len, NULL)) {
+		return false;
+	}
+
+	dst[dec_len] = '\0';
+	*dst_len = dec_len;
+
+	return true;
+}
+
+bool base64_decode_inplace(unsigned char *buf, size_t len, size_t *dst_len) {
+	size_t j = 0, dec_len = 0;
+
+	// 第i个字符解码后写到i*3/4之前的位置，SIMD内核先读后写，不会覆盖还没有读取的字符
+	j = decode_blocks(buf, len, buf, len);
+	dec_len = j / 4 * 3;
+	if (!decode_tail(buf, j, len, buf, &dec_len, NULL)) {
+		return false;
+	}
+
+	if (dec_len < len) {
+		buf[dec_len] = '\0';
+	}
+	*dst_len = dec_len;
+
+	return true;
+}
+
+void base64_encode_init(base64_encode_state *state) {
+	state->len = 0;
+}
 
-		while (i++ < 3) {
-			dst[enc_len++] = '=';
+bool base64_encode_update(base64_encode_state *state, const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len) {
+	size_t i = 0, n = 0, enc_len = 0;
+
+	if (dst_max_size < (state->len + src_len) / 3 * 4) {
+		return false;
+	}
+
+	// 先补齐上一次剩余的分组
+	if (state->len > 0) {
+		while (state->len < 3 && i < src_len) {
+			state->buf[state->len++] = src[i++];
+		}
+		if (state->len < 3) {
+			*dst_len = 0;
+			return true;
 		}
+		encode(state->buf, dst);
+		enc_len = 4;
+		state->len = 0;
+	}
+
+	n = encode_blocks(src + i, src_len - i, dst + enc_len);
+	enc_len += n / 3 * 4;
+	i += n;
+
+	while (i < src_len) {
+		state->buf[state->len++] = src[i++];
 	}
 
-	dst[enc_len] = '\0';
 	*dst_len = enc_len;
+	return true;
+}
+
+bool base64_encode_final(base64_encode_state *state, unsigned char *dst, size_t dst_max_size, size_t *dst_len) {
+	*dst_len = 0;
+	if (0 == state->len) {
+		return true;
+	}
+	if (dst_max_size < 4) {
+		return false;
+	}
 
+	*dst_len = encode_tail(state->buf, state->len, dst);
+	state->len = 0;
 	return true;
 }
 
-bool base64_decode(const unsigned char *src, int src_len, unsigned char *dst, int dst_max_size, int *dst_len) {
-	int i = 0, j = 0, dec_len = 0;
-	unsigned char tmp[4];
+bool base64_decode_update(base64_decode_state *state, const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len) {
+	size_t i = 0, n = 0, dec_len = 0, pad = 0;
 
-	if (dst_max_size * 4 < src_len * 3 + 10) {
+	// 末尾的'='不产生输出
+	while (pad < 2 && pad < src_len && '=' == src[src_len - pad - 1]) {
+		pad++;
+	}
+	if (dst_max_size < (state->len + src_len - pad) / 4 * 3) {
 		return false;
 	}
 
-	while (src_len--) {
-		if ('=' == src[j]) {
-			break;
+	// 先补齐上一次剩余的分组
+	while (i < src_len && state->len > 0 && !state->done) {
+		if (!decode_push_char(state, src[i++], dst, &dec_len)) {
+			return false;
 		}
-		// 判断src是否合法
-		if (!is_base64_chars(src[j])) {
+	}
+
+	if (!state->done) {
+		n = decode_blocks(src + i, src_len - i, dst + dec_len, dst_max_size - dec_len);
+		dec_len += n / 4 * 3;
+		i += n;
+	}
+
+	// 末尾不足4个字符，或者含'='、非法字符的分组
+	while (i < src_len && !state->done) {
+		if (!decode_push_char(state, src[i++], dst, &dec_len)) {
 			return false;
 		}
+	}
+
+	*dst_len = dec_len;
+	return true;
+}
+
+bool base64_decode_final(base64_decode_state *state, unsigned char *dst, size_t dst_max_size, size_t *dst_len) {
+	unsigned char out[3];
+	size_t i = 0;
+
+	*dst_len = 0;
+	if (state->len > 1) {
+		if (dst_max_size < state->len - 1) {
+			return false;
+		}
+		for (i = state->len; i < 4; ++i) {
+			state->buf[i] = 'A';
+		}
+		decode(state->buf, out);
+		memcpy(dst, out, state->len - 1);
+		*dst_len = state->len - 1;
+	}
+
+	base64_decode_init(state);
+	return true;
+}
+
+// 多线程编解码的分块
+typedef struct {
+	const unsigned char *src;
+	size_t src_len;
+	unsigned char *dst;
+	size_t dst_room;	// 只能写本分块的输出区域，避免SIMD多写的字节覆盖相邻分块
+	size_t done;		// 已处理的输入长度
+	bool encode;
+} base64_chunk;
+
+#define BASE64_MIN_CHUNK	(1 << 16)
+#define BASE64_MAX_THREADS	64
+
+static void *base64_chunk_run(void *arg) {
+	base64_chunk *c = (base64_chunk*)arg;
+	if (c->encode) {
+		c->done = encode_blocks(c->src, c->src_len, c->dst);
+	} else {
+		c->done = decode_blocks(c->src, c->src_len, c->dst, c->dst_room);
+	}
+	return NULL;
+}
+
+// 按group（3或4）的倍数切分[0, src_len)，并行处理完整的分组，返回连续处理完成的输入长度
+static size_t base64_run_parallel(const unsigned char *src, size_t src_len, unsigned char *dst, int threads, bool encode) {
+	base64_chunk chunks[BASE64_MAX_THREADS];
+	pthread_t tids[BASE64_MAX_THREADS];
+	bool started[BASE64_MAX_THREADS];
+	size_t in_group = encode ? 3 : 4, out_group = encode ? 4 : 3;
+	size_t groups = src_len / in_group, per, off = 0, done = 0;
+	int n, i;
 
-		tmp[i++] = src[j++];
+	if (threads <= 0) {
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	n = threads;
+	if (n > BASE64_MAX_THREADS) n = BASE64_MAX_THREADS;
+	if ((size_t)n > src_len / BASE64_MIN_CHUNK) n = (int)(src_len / BASE64_MIN_CHUNK);
+	if (n < 1) n = 1;
+
+	// 先确定所有分块
+	select_kernel();
+	per = (groups + n - 1) / n;
+	for (i = 0; i < n; ++i) {
+		size_t g = groups - off / in_group < per ? groups - off / in_group : per;
+		chunks[i].src = src + off;
+		chunks[i].src_len = g * in_group;
+		chunks[i].dst = dst + off / in_group * out_group;
+		chunks[i].dst_room = g * out_group;
+		chunks[i].done = 0;
+		chunks[i].encode = encode;
+		off += g * in_group;
+	}
 
-		if (4 == i) {
-			decode(tmp, dst + dec_len);
-			dec_len += 3;
-			i = 0;
+	for (i = 1; i < n; ++i) {
+		started[i] = (0 == pthread_create(&tids[i], NULL, base64_chunk_run, &chunks[i]));
+		if (!started[i]) {
+			base64_chunk_run(&chunks[i]);
 		}
 	}
+	base64_chunk_run(&chunks[0]);
+	for (i = 1; i < n; ++i) {
+		if (started[i]) pthread_join(tids[i], NULL);
+	}
 
-	if (i > 0) {
-		for (j = i; j < 4; ++j) {
-			tmp[j] = '\0';
+	// 只有前面的分块全部成功，后面分块的结果才有效
+	for (i = 0; i < n; ++i) {
+		done += chunks[i].done;
+		if (chunks[i].done < chunks[i].src_len) {
+			break;
 		}
-		decode(tmp, dst + dec_len);
-		dec_len += (i - 1);
+	}
+	return done;
+}
+
+bool base64_encode_parallel(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len, int threads) {
+	size_t i = 0, enc_len = 0;
+
+	if (dst_max_size < base64_encoded_len(src_len) + 1) {
+		return false;
+	}
+
+	i = base64_run_parallel(src, src_len, dst, threads, true);
+	enc_len = i / 3 * 4;
+	enc_len += encode_tail(src + i, src_len - i, dst + enc_len);
+
+	dst[enc_len] = '\0';
+	*dst_len = enc_len;
+	return true;
+}
+
+bool base64_decode_parallel(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len, int threads, size_t *err_pos) {
+	size_t j = 0, dec_len = 0;
+
+	if (dst_max_size < base64_decoded_len(src, src_len) + 1) {
+		return false;
+	}
+
+	j = base64_run_parallel(src, src_len, dst, threads, false);
+	dec_len = j / 4 * 3;
+
+	// 从第一个没有完整解码的分组开始逐个字符处理，确定'='和非法字符的位置
+	if (!decode_tail(src, j, src_len, dst, &dec_len, err_pos)) {
+		return false;
 	}
 
 	dst[dec_len] = '\0';
 	*dst_len = dec_len;
-
 	return true;
 }
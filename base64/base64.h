@@ -8,9 +8,80 @@
 extern "C" {
 #endif
 
-bool base64_encode(const unsigned char *src, int src_len, unsigned char *dst, int dst_max_size, int *dst_len);
+// 编码后的长度（含padding，不含结尾的'\0'）
+size_t base64_encoded_len(size_t src_len);
 
-bool base64_decode(const unsigned char *src, int src_len, unsigned char *dst, int dst_max_size, int *dst_len);
+// 解码后的长度（不含结尾的'\0'），根据末尾的'='计算，对合法的输入是精确值
+size_t base64_decoded_len(const unsigned char *src, size_t src_len);
+
+// dst_max_size至少为 base64_encoded_len(src_len) + 1，dst以'\0'结尾
+bool base64_encode(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len);
+
+// dst_max_size至少为 base64_decoded_len(src, src_len) + 1，dst以'\0'结尾
+// 遇到'='时结束解码，遇到非法字符返回false
+bool base64_decode(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len);
+
+// 原地解码，结果写回buf的开头，省去一次输出buffer的申请；解码后长度小于len时以'\0'结尾
+bool base64_decode_inplace(unsigned char *buf, size_t len, size_t *dst_len);
+
+
+// 流式编解码：init -> 多次update -> final，在两次update之间保存不足一个分组的数据，
+// 可以按固定大小的分块处理任意长的数据（例如直接从ringbuffer或者socket读取），内存占用与总长度无关
+// update/final的输出不以'\0'结尾
+
+typedef struct {
+	unsigned char buf[3];	// 上一次update剩余的字节
+	size_t len;
+} base64_encode_state;
+
+typedef struct {
+	unsigned char buf[4];	// 上一次update剩余的字符
+	size_t len;
+	bool done;				// 已经遇到'='，之后的输入全部忽略
+} base64_decode_state;
+
+void base64_encode_init(base64_encode_state *state);
+
+// dst_max_size至少为 (state->len + src_len) / 3 * 4
+bool base64_encode_update(base64_encode_state *state, const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len);
+
+// 输出剩余的字节（含padding），dst_max_size至少为4
+bool base64_encode_final(base64_encode_state *state, unsigned char *dst, size_t dst_max_size, size_t *dst_len);
+
+void base64_decode_init(base64_decode_state *state);
+
+// dst_max_size至少为 (state->len + src_len - 末尾'='的个数) / 4 * 3，遇到非法字符返回false
+bool base64_decode_update(base64_decode_state *state, const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len);
+
+// 输出剩余的字节，dst_max_size至少为2
+bool base64_decode_final(base64_decode_state *state, unsigned char *dst, size_t dst_max_size, size_t *dst_len);
+
+
+// 多线程编解码，用于很大的数据：输入按3字节（编码）/4个字符（解码）的边界切分，
+// 每个分块的输出位置可以预先算出，各线程直接写到最终的dst中
+// threads为0时使用所有CPU，数据较小时会自动减少线程数
+// 编码：dst_max_size至少为 base64_encoded_len(src_len) + 1
+// 解码：dst_max_size至少为 base64_decoded_len(src, src_len) + 1，遇到非法字符返回false，并将第一个非法字符的位置写入*err_pos（可以为NULL）
+bool base64_encode_parallel(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len, int threads);
+
+bool base64_decode_parallel(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_max_size, size_t *dst_len, int threads, size_t *err_pos);
+
+
+// 编解码的实现，默认在第一次调用时根据CPUID自动选择，用于测试和benchmark时可以强制指定
+#define BASE64_KERNEL_AUTO			0
+#define BASE64_KERNEL_SCALAR		1
+#define BASE64_KERNEL_SSE41			2
+#define BASE64_KERNEL_AVX2			3
+#define BASE64_KERNEL_AVX512VBMI	4
+
+// CPU不支持指定的实现时返回false
+// 不是线程安全的，需要在其他线程编解码之前调用；其余接口可以在任意线程同时调用
+bool base64_set_kernel(int kernel);
+
+// 返回当前使用的实现
+int base64_get_kernel(void);
+
+const char* base64_kernel_name(int kernel);
 
 
 #ifdef __cplusplus
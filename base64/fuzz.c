@@ -0,0 +1,206 @@
+// base64差分测试：用一个逐字符的参考实现和每一种SIMD实现对比结果
+//
+// libFuzzer：clang -O1 -g -fsanitize=fuzzer,address -DBASE64_LIBFUZZER -o fuzz fuzz.c base64.c -pthread
+// 独立运行：gcc -O2 -o fuzz fuzz.c base64.c -pthread && ./fuzz [次数] [随机种子]
+//
+// 对每个输入检查：
+//   1. 各实现的编码结果与参考实现一致，一次性/流式/多线程/原地解码都能还原原始数据
+//   2. 把输入映射成（大部分合法的）base64字符串，各实现的解码结果（成功与否、输出）与参考实现一致
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "base64.h"
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static size_t ref_encode(const uint8_t *src, size_t n, uint8_t *dst) {
+	size_t i = 0, o = 0;
+	for (; i + 3 <= n; i += 3) {
+		uint32_t v = (src[i] << 16) | (src[i+1] << 8) | src[i+2];
+		dst[o++] = alphabet[v >> 18];
+		dst[o++] = alphabet[(v >> 12) & 63];
+		dst[o++] = alphabet[(v >> 6) & 63];
+		dst[o++] = alphabet[v & 63];
+	}
+	if (n - i == 1) {
+		uint32_t v = src[i] << 16;
+		dst[o++] = alphabet[v >> 18];
+		dst[o++] = alphabet[(v >> 12) & 63];
+		dst[o++] = '=';
+		dst[o++] = '=';
+	} else if (n - i == 2) {
+		uint32_t v = (src[i] << 16) | (src[i+1] << 8);
+		dst[o++] = alphabet[v >> 18];
+		dst[o++] = alphabet[(v >> 12) & 63];
+		dst[o++] = alphabet[(v >> 6) & 63];
+		dst[o++] = '=';
+	}
+	return o;
+}
+
+// 语义与base64_decode一致：遇到'='结束，遇到非法字符失败，末尾k个字符输出k-1字节
+static int ref_decode(const uint8_t *src, size_t n, uint8_t *dst, size_t *dst_len) {
+	uint32_t v = 0;
+	size_t i = 0, k = 0, o = 0;
+	for (; i < n && src[i] != '='; ++i) {
+		const char *p = src[i] ? strchr(alphabet, src[i]) : NULL;
+		if (!p) {
+			return 0;
+		}
+		v = (v << 6) | (uint32_t)(p - alphabet);
+		if (4 == ++k) {
+			dst[o++] = v >> 16;
+			dst[o++] = v >> 8;
+			dst[o++] = v;
+			v = 0;
+			k = 0;
+		}
+	}
+	if (k > 1) {
+		v <<= 6 * (4 - k);
+		dst[o++] = v >> 16;
+		if (k > 2) dst[o++] = v >> 8;
+	}
+	*dst_len = o;
+	return 1;
+}
+
+#define CHECK(cond, what) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s: %s mismatch, size[%zu]\n", base64_kernel_name(kernel), what, size); \
+		abort(); \
+	} \
+} while (0)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	size_t enc_cap = base64_encoded_len(size) + 1;
+	uint8_t *ref = (uint8_t*)malloc(enc_cap);
+	uint8_t *enc = (uint8_t*)malloc(enc_cap);
+	uint8_t *dec = (uint8_t*)malloc(size + 1);
+	uint8_t *text = (uint8_t*)malloc(size + 1);
+	uint8_t *ref_dec = (uint8_t*)malloc(size + 1);
+	size_t ref_len, enc_len, dec_len, ref_dec_len = 0, n, i, chunk;
+	int kernel, ref_ok, ok, pad_only;
+	base64_encode_state es;
+	base64_decode_state ds;
+
+	ref_len = ref_encode(data, size, ref);
+
+	// 映射为大部分合法的base64字符串，少量'='、非法字符和高位字节；
+	// 一半的输入只混入'='，覆盖'='出现得过早、位置不对、'='之后还有数据等情况
+	pad_only = size > 1 && (data[1] & 1);
+	for (i = 0; i < size; ++i) {
+		uint8_t b = data[i];
+		text[i] = b < 250 ? alphabet[b & 63] : (pad_only ? '=' : "=*\n\x80 ="[b - 250]);
+	}
+	ref_ok = ref_decode(text, size, ref_dec, &ref_dec_len);
+
+	// 流式接口的分块大小
+	chunk = size ? data[0] % 64 + 1 : 1;
+
+	for (kernel = BASE64_KERNEL_SCALAR; kernel <= BASE64_KERNEL_AVX512VBMI; ++kernel) {
+		if (!base64_set_kernel(kernel)) {
+			continue;
+		}
+
+		// 编码
+		ok = base64_encode(data, size, enc, enc_cap, &enc_len);
+		CHECK(ok && enc_len == ref_len && 0 == memcmp(enc, ref, ref_len), "encode");
+
+		ok = base64_encode_parallel(data, size, enc, enc_cap, &enc_len, 4);
+		CHECK(ok && enc_len == ref_len && 0 == memcmp(enc, ref, ref_len), "parallel encode");
+
+		base64_encode_init(&es);
+		for (i = 0, enc_len = 0; i < size; i += chunk) {
+			ok = base64_encode_update(&es, data + i, size - i < chunk ? size - i : chunk, enc + enc_len, enc_cap - enc_len, &n);
+			CHECK(ok, "stream encode");
+			enc_len += n;
+		}
+		ok = base64_encode_final(&es, enc + enc_len, enc_cap - enc_len, &n);
+		enc_len += n;
+		CHECK(ok && enc_len == ref_len && 0 == memcmp(enc, ref, ref_len), "stream encode");
+
+		// 解码编码结果
+		ok = base64_decode(ref, ref_len, dec, size + 1, &dec_len);
+		CHECK(ok && dec_len == size && 0 == memcmp(dec, data, size), "decode");
+
+		ok = base64_decode_parallel(ref, ref_len, dec, size + 1, &dec_len, 4, NULL);
+		CHECK(ok && dec_len == size && 0 == memcmp(dec, data, size), "parallel decode");
+
+		base64_decode_init(&ds);
+		for (i = 0, dec_len = 0; i < ref_len; i += chunk) {
+			ok = base64_decode_update(&ds, ref + i, ref_len - i < chunk ? ref_len - i : chunk, dec + dec_len, size + 1 - dec_len, &n);
+			CHECK(ok, "stream decode");
+			dec_len += n;
+		}
+		ok = base64_decode_final(&ds, dec + dec_len, size + 1 - dec_len, &n);
+		dec_len += n;
+		CHECK(ok && dec_len == size && 0 == memcmp(dec, data, size), "stream decode");
+
+		memcpy(enc, ref, ref_len);
+		ok = base64_decode_inplace(enc, ref_len, &dec_len);
+		CHECK(ok && dec_len == size && 0 == memcmp(enc, data, size), "inplace decode");
+
+		// 解码任意字符串
+		ok = base64_decode(text, size, dec, size + 1, &dec_len);
+		CHECK(ok == ref_ok && (!ok || (dec_len == ref_dec_len && 0 == memcmp(dec, ref_dec, dec_len))), "decode text");
+
+		ok = base64_decode_parallel(text, size, dec, size + 1, &dec_len, 4, NULL);
+		CHECK(ok == ref_ok && (!ok || (dec_len == ref_dec_len && 0 == memcmp(dec, ref_dec, dec_len))), "parallel decode text");
+
+		// 流式解码：任何一次update失败或者final失败都算失败，成功时结果和一次性解码一致
+		base64_decode_init(&ds);
+		ok = 1;
+		for (i = 0, dec_len = 0; ok && i < size; i += chunk) {
+			ok = base64_decode_update(&ds, text + i, size - i < chunk ? size - i : chunk, dec + dec_len, size + 1 - dec_len, &n);
+			if (ok) dec_len += n;
+		}
+		if (ok) {
+			ok = base64_decode_final(&ds, dec + dec_len, size + 1 - dec_len, &n);
+			dec_len += n;
+		}
+		CHECK(ok == ref_ok && (!ok || (dec_len == ref_dec_len && 0 == memcmp(dec, ref_dec, dec_len))), "stream decode text");
+
+		memcpy(enc, text, size);
+		ok = base64_decode_inplace(enc, size, &dec_len);
+		CHECK(ok == ref_ok && (!ok || (dec_len == ref_dec_len && 0 == memcmp(enc, ref_dec, dec_len))), "inplace decode text");
+	}
+
+	base64_set_kernel(BASE64_KERNEL_AUTO);
+	free(ref);
+	free(enc);
+	free(dec);
+	free(text);
+	free(ref_dec);
+	return 0;
+}
+
+#ifndef BASE64_LIBFUZZER
+int main(int argc, char *argv[]) {
+	long iterations = argc > 1 ? atol(argv[1]) : 10000;
+	unsigned seed = argc > 2 ? (unsigned)atol(argv[2]) : 1;
+	static uint8_t buf[1 << 20];
+	long it;
+	size_t size, i;
+
+	srand(seed);
+	for (it = 0; it < iterations; ++it) {
+		// 大部分是短输入，偶尔有足够长的输入覆盖多线程分块
+		size = rand() % 16 ? (size_t)(rand() % 512) : (size_t)(rand() % sizeof(buf));
+		for (i = 0; i < size; ++i) {
+			buf[i] = (uint8_t)rand();
+		}
+		// 少量非法字符，使解码能够走到SIMD的快速路径
+		if (rand() % 2) {
+			for (i = 0; i < size; ++i) {
+				if (buf[i] >= 250 && rand() % 64) buf[i] &= 0x7f;
+			}
+		}
+		LLVMFuzzerTestOneInput(buf, size);
+	}
+	printf("%ld inputs ok\n", iterations);
+	return 0;
+}
+#endif
@@ -1,20 +1,184 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "base64.h"
 
+// 多个线程同时第一次编解码，实现只选择一次，结果都正确（配合-fsanitize=thread检查数据竞争）
+static void *first_call_run(void *arg) {
+	static const char expect[] = "AAECAwQFBgcICQoLDA0ODxAREhMUFRYXGBkaGxwdHh8gISIjJCUmJygpKissLS4vMDEyMzQ1Njc4OTo7PD0+P0BBQkNERUZHSElKS0xNTk9QUVJTVFVWV1hZWltcXV5f";
+	unsigned char src[96], enc[140], dec[100];
+	size_t enc_len, dec_len, i;
+
+	for (i = 0; i < sizeof(src); ++i) {
+		src[i] = (unsigned char)i;
+	}
+	if (!base64_encode(src, sizeof(src), enc, sizeof(enc), &enc_len) || enc_len != strlen(expect) || memcmp(enc, expect, enc_len)
+			|| !base64_decode(enc, enc_len, dec, sizeof(dec), &dec_len) || dec_len != sizeof(src) || memcmp(dec, src, dec_len)) {
+		*(int*)arg = 1;
+	}
+	return NULL;
+}
+
+static void test_first_call() {
+	pthread_t tids[4];
+	int failed[4] = { 0 };
+	int i;
+
+	for (i = 0; i < 4; ++i) {
+		if (pthread_create(&tids[i], NULL, first_call_run, &failed[i]) != 0) {
+			exit(-1);
+		}
+	}
+	for (i = 0; i < 4; ++i) {
+		pthread_join(tids[i], NULL);
+		if (failed[i]) {
+			printf("first call from thread %d failed\n", i);
+			exit(-1);
+		}
+	}
+	printf("first call test success\n");
+}
+
+// 分块流式编解码的结果必须和一次性编解码一致
+static void test_stream() {
+	static unsigned char src[10000], enc[20000], dec[10001], out[20000];
+	size_t src_len = sizeof(src), enc_len, dec_len, out_len, n, i, chunk;
+	base64_encode_state es;
+	base64_decode_state ds;
+
+	for (i = 0; i < src_len; ++i) {
+		src[i] = (unsigned char)(i * 131 + 7);
+	}
+	base64_encode(src, src_len, enc, sizeof(enc), &enc_len);
+
+	for (chunk = 1; chunk <= 1000; chunk = chunk * 3 + 1) {
+		base64_encode_init(&es);
+		for (i = 0, out_len = 0; i < src_len; i += chunk) {
+			n = src_len - i < chunk ? src_len - i : chunk;
+			base64_encode_update(&es, src + i, n, out + out_len, sizeof(out) - out_len, &n);
+			out_len += n;
+		}
+		base64_encode_final(&es, out + out_len, sizeof(out) - out_len, &n);
+		out_len += n;
+		if (out_len != enc_len || memcmp(out, enc, enc_len)) {
+			printf("stream encode failed, chunk[%zu]\n", chunk);
+			exit(-1);
+		}
+
+		base64_decode_init(&ds);
+		for (i = 0, dec_len = 0; i < enc_len; i += chunk) {
+			n = enc_len - i < chunk ? enc_len - i : chunk;
+			if (!base64_decode_update(&ds, enc + i, n, dec + dec_len, sizeof(dec) - dec_len, &n)) {
+				printf("stream decode failed, chunk[%zu]\n", chunk);
+				exit(-1);
+			}
+			dec_len += n;
+		}
+		base64_decode_final(&ds, dec + dec_len, sizeof(dec) - dec_len, &n);
+		dec_len += n;
+		if (dec_len != src_len || memcmp(dec, src, src_len)) {
+			printf("stream decode failed, chunk[%zu]\n", chunk);
+			exit(-1);
+		}
+	}
+	printf("stream test success\n");
+}
+
+// 多线程编解码的结果必须和单线程一致，出错时返回第一个非法字符的位置
+static void test_parallel() {
+	size_t src_len = 3 << 20, enc_len, dec_len, i;
+	size_t penc_len, pdec_len, err_pos = 0;
+	unsigned char *src = (unsigned char*)malloc(src_len + 1);
+	unsigned char *enc = (unsigned char*)malloc(src_len * 2);
+	unsigned char *penc = (unsigned char*)malloc(src_len * 2);
+	unsigned char *dec = (unsigned char*)malloc(src_len * 2);
+
+	for (i = 0; i < src_len; ++i) {
+		src[i] = (unsigned char)(i * 7 + (i >> 9));
+	}
+	for (i = src_len - 2; i <= src_len; ++i) {
+		base64_encode(src, i, enc, src_len * 2, &enc_len);
+		if (!base64_encode_parallel(src, i, penc, src_len * 2, &penc_len, 4)
+			|| penc_len != enc_len || memcmp(enc, penc, enc_len)) {
+			printf("parallel encode failed, len[%zu]\n", i);
+			exit(-1);
+		}
+		if (!base64_decode_parallel(penc, penc_len, dec, src_len * 2, &pdec_len, 4, NULL)
+			|| pdec_len != i || memcmp(dec, src, i)) {
+			printf("parallel decode failed, len[%zu]\n", i);
+			exit(-1);
+		}
+	}
+
+	// 在后面的分块中放入两个非法字符，'='之后的非法字符被忽略
+	penc[penc_len - 100] = '*';
+	penc[penc_len / 2 + 1] = '*';
+	if (base64_decode_parallel(penc, penc_len, dec, src_len * 2, &pdec_len, 4, &err_pos) || err_pos != penc_len / 2 + 1) {
+		printf("parallel decode error position failed\n");
+		exit(-1);
+	}
+	penc[penc_len / 2] = '=';
+	if (!base64_decode_parallel(penc, penc_len, dec, src_len * 2, &pdec_len, 4, &err_pos)
+		|| !base64_decode(penc, penc_len, enc, src_len * 2, &dec_len) || pdec_len != dec_len || memcmp(dec, enc, dec_len)) {
+		printf("parallel decode padding failed\n");
+		exit(-1);
+	}
+
+	free(src);
+	free(enc);
+	free(penc);
+	free(dec);
+	printf("parallel test success\n");
+}
+
+// 输出长度必须精确，原地解码的结果必须和普通解码一致
+static void test_exact_len() {
+	unsigned char src[64], enc[90], dec[64];
+	size_t i, enc_len, dec_len;
+
+	for (i = 0; i < sizeof(src); ++i) {
+		src[i] = (unsigned char)(i * 37);
+	}
+	for (i = 0; i < sizeof(src); ++i) {
+		// 输出空间恰好为长度+1时成功，少1个字节时失败
+		if (base64_encode(src, i, enc, base64_encoded_len(i), &enc_len)
+			|| !base64_encode(src, i, enc, base64_encoded_len(i) + 1, &enc_len) || enc_len != base64_encoded_len(i)) {
+			printf("exact encode len failed, len[%zu]\n", i);
+			exit(-1);
+		}
+		if (base64_decoded_len(enc, enc_len) != i || base64_decoded_len(enc, enc_len - (i % 3 ? 3 - i % 3 : 0)) != i
+			|| base64_decode(enc, enc_len, dec, i, &dec_len)
+			|| !base64_decode(enc, enc_len, dec, i + 1, &dec_len) || dec_len != i || memcmp(dec, src, i)) {
+			printf("exact decode len failed, len[%zu]\n", i);
+			exit(-1);
+		}
+		if (!base64_decode_inplace(enc, enc_len, &dec_len) || dec_len != i || memcmp(enc, src, i)) {
+			printf("inplace decode failed, len[%zu]\n", i);
+			exit(-1);
+		}
+	}
+	printf("exact len test success\n");
+}
+
 int main() {
-	char src[100], dst[100];
-	int src_len, dst_len;
+	char src[100], dst[140];
+	size_t src_len, dst_len;
+
+	test_first_call();
+	test_stream();
+	test_parallel();
+	test_exact_len();
 	
-	while (scanf("%s", src)) {
+	while (1 == scanf("%99s", src)) {
 		printf("%s\n", src);
 		
 		base64_encode(src, strlen(src), dst, sizeof(dst), &dst_len);
-		printf("dst_len[%d]: %s\n", dst_len, dst);	
+		printf("dst_len[%zu]: %s\n", dst_len, dst);	
 		
 		
 		base64_decode(dst, dst_len, src, sizeof(src), &src_len);
-		printf("src_len[%d]: %s\n", src_len, src);
+		printf("src_len[%zu]: %s\n", src_len, src);
 	}
 
 	return 0;
@@ -0,0 +1,344 @@
+// broadcast_channel示例：2个生产者，3个订阅者（日志、统计、业务），每个订阅者都收到全部事件
+// 并与"每个订阅者一个channel，put时复制多份"的做法对比耗时
+// 编译：g++ -O2 -std=c++11 -o broadcast_channel broadcast_channel.cpp -pthread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "broadcast_channel.h"
+#include "channel.h"
+
+static const int PRODUCERS = 2;
+static const int SUBSCRIBERS = 3;
+static const uint64_t EVENTS = 1 << 19;		// 每个生产者
+
+struct event {
+	uint32_t producer;
+	uint64_t seq;
+	char payload[112];
+};
+
+// 每个订阅者检查：每个生产者的事件按顺序、不重复、不遗漏
+struct checker {
+	uint64_t next[PRODUCERS];
+	uint64_t count;
+	uint64_t bytes;
+
+	checker(): count(0), bytes(0) {
+		memset(next, 0, sizeof(next));
+	}
+
+	void on_event(const event &e) {
+		if (e.seq != next[e.producer]) {
+			fprintf(stderr, "producer %u: expect %llu, got %llu\n", e.producer,
+				(unsigned long long)next[e.producer], (unsigned long long)e.seq);
+			exit(-1);
+		}
+		next[e.producer]++;
+		count++;
+		bytes += (unsigned char)e.payload[e.seq % sizeof(e.payload)];
+	}
+
+	void verify() const {
+		if (count != EVENTS * PRODUCERS) {
+			fprintf(stderr, "expect %llu events, got %llu\n", (unsigned long long)(EVENTS * PRODUCERS), (unsigned long long)count);
+			exit(-1);
+		}
+	}
+};
+
+static void fill(event &e, uint32_t producer, uint64_t seq) {
+	e.producer = producer;
+	e.seq = seq;
+	memset(e.payload, (int)(seq & 0xff), sizeof(e.payload));
+}
+
+static double run_broadcast(uint64_t &batches) {
+	broadcast_channel<event> ch(4096);
+	checker checkers[SUBSCRIBERS];
+	uint64_t reads[SUBSCRIBERS] = { 0 };
+	std::vector<std::thread> producers, subscribers;
+	int subs[SUBSCRIBERS];
+
+	// 在生产者开始之前订阅，才能收到全部事件
+	for (int i = 0; i < SUBSCRIBERS; ++i) {
+		subs[i] = ch.subscribe();
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < SUBSCRIBERS; ++i) {
+		subscribers.emplace_back([&ch, &checkers, &reads, &subs, i]() {
+			checker &c = checkers[i];
+			// 一次处理所有已经发布的事件，原地读取，不拷贝
+			while (ch.read(subs[i], [&c](const event &e) { c.on_event(e); }) > 0) {
+				reads[i]++;
+			}
+		});
+	}
+	for (int p = 0; p < PRODUCERS; ++p) {
+		producers.emplace_back([&ch, p]() {
+			event e;
+			for (uint64_t seq = 0; seq < EVENTS; ++seq) {
+				fill(e, p, seq);
+				ch.put(e);
+			}
+		});
+	}
+	for (auto &t : producers) t.join();
+	ch.close();
+	for (auto &t : subscribers) t.join();
+	auto end = std::chrono::steady_clock::now();
+
+	batches = 0;
+	for (int i = 0; i < SUBSCRIBERS; ++i) {
+		checkers[i].verify();
+		batches += reads[i];
+	}
+	return std::chrono::duration<double>(end - begin).count();
+}
+
+// 原来的做法：每个订阅者一个channel，每个事件put多份
+static double run_channels() {
+	channel<event> chs[SUBSCRIBERS];
+	checker checkers[SUBSCRIBERS];
+	std::vector<std::thread> producers, subscribers;
+
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < SUBSCRIBERS; ++i) {
+		subscribers.emplace_back([&chs, &checkers, i]() {
+			event e;
+			while (chs[i].get(e)) {
+				checkers[i].on_event(e);
+			}
+		});
+	}
+	for (int p = 0; p < PRODUCERS; ++p) {
+		producers.emplace_back([&chs, p]() {
+			event e;
+			for (uint64_t seq = 0; seq < EVENTS; ++seq) {
+				fill(e, p, seq);
+				for (int i = 0; i < SUBSCRIBERS; ++i) {
+					chs[i].put(e);
+				}
+			}
+		});
+	}
+	for (auto &t : producers) t.join();
+	for (int i = 0; i < SUBSCRIBERS; ++i) chs[i].close();
+	for (auto &t : subscribers) t.join();
+	auto end = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < SUBSCRIBERS; ++i) {
+		checkers[i].verify();
+	}
+	return std::chrono::duration<double>(end - begin).count();
+}
+
+// 容量很小，多个生产者put std::string，一个订阅者反复订阅、取消订阅：
+// 没有订阅者时put不限流，同一个槽位可能被相差一圈的两个put同时写入，这里检查数据不损坏、不卡住
+// steady为true时另有一个订阅者一直订阅，检查每个生产者的item按顺序到达
+static void run_churn(bool steady) {
+	const int producers = 4;
+	const uint64_t events = 20000;
+	broadcast_channel<std::string> ch(2);
+	std::atomic<int> done(0);
+	std::atomic<bool> stop(false);
+	std::vector<std::thread> threads;
+	uint64_t received = 0;
+	int sub = steady ? ch.subscribe() : -1;
+
+	// 长度超过SSO，赋值会重新申请内存，并发写入时容易暴露问题
+	auto valid = [](const std::string &s, int &p, uint64_t &seq) {
+		unsigned long long v;
+		if (s.size() != 64 || sscanf(s.c_str(), "%d:%llu", &p, &v) != 2 || p < 0 || p >= producers) {
+			return false;
+		}
+		seq = v;
+		return s.find_first_not_of('x', s.find('|') + 1) == std::string::npos;
+	};
+
+	for (int p = 0; p < producers; ++p) {
+		threads.emplace_back([&ch, &done, p]() {
+			char head[32];
+			for (uint64_t seq = 0; seq < events; ++seq) {
+				std::string s(head, snprintf(head, sizeof(head), "%d:%llu|", p, (unsigned long long)seq));
+				s.resize(64, 'x');
+				if (!ch.put(std::move(s))) exit(-1);
+			}
+			done++;
+		});
+	}
+	threads.emplace_back([&ch, &stop, &valid]() {
+		while (!stop.load()) {
+			int s = ch.subscribe();
+			if (s < 0) exit(-1);
+			for (int i = 0; i < 4; ++i) {
+				ch.read(s, [&valid](const std::string &v) {
+					int p;
+					uint64_t seq;
+					if (!valid(v, p, seq)) {
+						fprintf(stderr, "churn: bad item %s\n", v.c_str());
+						exit(-1);
+					}
+				}, 2, 1);
+			}
+			ch.unsubscribe(s);
+		}
+	});
+	if (steady) {
+		threads.emplace_back([&ch, &valid, &received, sub]() {
+			uint64_t next[producers] = { 0 };
+			while (ch.read(sub, [&](const std::string &v) {
+				int p;
+				uint64_t seq;
+				if (!valid(v, p, seq) || seq != next[p]) {
+					fprintf(stderr, "steady: bad item %s\n", v.c_str());
+					exit(-1);
+				}
+				next[p]++;
+				received++;
+			}) > 0) {
+			}
+		});
+	}
+
+	// 生产者30秒内没有完成说明卡住了
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+	while (done.load() < producers) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			fprintf(stderr, "churn: producers stalled, %d done\n", done.load());
+			exit(-1);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	stop.store(true);
+	ch.close();
+	for (auto &t : threads) t.join();
+	if (steady && received != events * producers) {
+		fprintf(stderr, "steady: expect %llu items, got %llu\n", (unsigned long long)(events * producers), (unsigned long long)received);
+		exit(-1);
+	}
+}
+
+static double thread_cpu_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// 没有数据的read、环满的put阻塞时不占用CPU，对端操作后被唤醒；超时按时返回
+static void run_blocking() {
+	broadcast_channel<int> ch(2);
+	int sub = ch.subscribe();
+	double cpu = 0;
+	size_t n = 0;
+	int got = -1;
+
+	std::thread reader([&]() {
+		double begin = thread_cpu_ms();
+		n = ch.read(sub, [&got](int v) { got = v; });
+		cpu = thread_cpu_ms() - begin;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	ch.put(7);
+	reader.join();
+	if (n != 1 || got != 7 || cpu > 10) {
+		fprintf(stderr, "read blocked 300ms, cpu %.1fms\n", cpu);
+		exit(-1);
+	}
+
+	ch.put(1);
+	ch.put(2);
+	bool ok = false;
+	std::thread putter([&]() {
+		double begin = thread_cpu_ms();
+		ok = ch.put(3);
+		cpu = thread_cpu_ms() - begin;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	n = ch.read(sub, [](int) {}, 1);
+	putter.join();
+	if (!ok || n != 1 || cpu > 10) {
+		fprintf(stderr, "put blocked 300ms, cpu %.1fms\n", cpu);
+		exit(-1);
+	}
+
+	// 超时
+	auto begin = std::chrono::steady_clock::now();
+	ok = ch.put(4, 50);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	if (ok || ms < 45 || ms > 1000) {
+		exit(-1);
+	}
+	n = ch.read(sub, [](int) {});
+	if (n != 2) {
+		exit(-1);
+	}
+	begin = std::chrono::steady_clock::now();
+	n = ch.read(sub, [](int) {}, SIZE_MAX, 50);
+	ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	if (n != 0 || ms < 45 || ms > 1000) {
+		exit(-1);
+	}
+
+	// 取消订阅唤醒被它限流的put，close唤醒阻塞的read
+	ch.put(5);
+	ch.put(6);
+	std::thread blocked([&]() { ok = ch.put(8); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ch.unsubscribe(sub);
+	blocked.join();
+	if (!ok) {
+		exit(-1);
+	}
+	sub = ch.subscribe();
+	std::thread waiting([&]() { n = ch.read(sub, [](int) {}); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ch.close();
+	waiting.join();
+	if (n != 0) {
+		exit(-1);
+	}
+}
+
+int main() {
+	uint64_t total = EVENTS * PRODUCERS, batches = 0;
+
+	double sec = run_broadcast(batches);
+	printf("broadcast_channel   %8.3fs  %6.2f M events/s  %.1f events per read\n", sec, total / sec / 1e6,
+		(double)total * SUBSCRIBERS / batches);
+
+	sec = run_channels();
+	printf("channel per reader  %8.3fs  %6.2f M events/s\n", sec, total / sec / 1e6);
+
+	// 订阅者太慢时生产者被限流；取消订阅后不再限制
+	{
+		broadcast_channel<int> ch(4);
+		int fast = ch.subscribe(), slow = ch.subscribe();
+		int sum = 0;
+		for (int i = 0; i < 4; ++i) {
+			if (!ch.try_put(i)) exit(-1);
+		}
+		ch.read(fast, [&sum](int v) { sum += v; });
+		if (ch.try_put(4) || ch.lag(slow) != 4 || sum != 6) exit(-1);
+		ch.unsubscribe(slow);
+		if (!ch.try_put(4)) exit(-1);
+		printf("gating ok\n");
+	}
+
+	run_blocking();
+	printf("blocking ok\n");
+
+	run_churn(false);
+	run_churn(true);
+	printf("subscribe churn ok\n");
+	return 0;
+}
@@ -0,0 +1,335 @@
+#ifndef __BROADCAST_CHANNEL_H
+#define __BROADCAST_CHANNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// 广播channel：每个put的item会被每个订阅者都读到一次（channel中一个item只会被一个get读到）
+// 参考disruptor：所有item放在构造时分配好的环形数组中，每个订阅者只有一个自己的读游标，
+// 订阅者在环中原地读取item，不会为每个订阅者拷贝一份
+//
+//   序号：每个put占用一个全局递增的序号seq，放在槽位seq & mask中
+//   发布：槽位写好后把槽位的published设置为seq，订阅者看到published == seq才读取
+//   限流：最慢的订阅者还没有读过的槽位不能被覆盖，即seq < 最小的读游标 + 容量，否则put等待
+//   独占：没有订阅者限流时前一圈的put可能还没写完，写入前先等槽位的published == seq - 容量
+//
+// 多个线程可以同时put；每个订阅者同时只能由一个线程读取
+// 环满的put、没有数据的read在条件变量上阻塞，不占用CPU；没有线程阻塞时put/read不加锁
+// 订阅之前put的item不会被读到；没有订阅者时put不会等待，item直接被丢弃
+//
+// 注意：item需要可默认构造，put通过赋值写入槽位；槽位在被覆盖之前一直持有最后一次写入的item
+template<typename item>
+class broadcast_channel {
+public:
+	static const int MAX_SUBSCRIBERS = 32;
+
+	explicit broadcast_channel(size_t capacity): _closed(false) {
+		assert(capacity >= 1);
+		_capacity = 1;
+		while (_capacity < capacity) {
+			_capacity <<= 1;
+		}
+		_mask = _capacity - 1;
+		_slots = new slot[_capacity];
+		// 相当于序号i - 容量已经发布，第一圈的put不需要等待；回绕后的值很大，不会等于任何读游标
+		for (size_t i = 0; i < _capacity; ++i) {
+			_slots[i].published.store((uint64_t)i - _capacity, std::memory_order_relaxed);
+		}
+		for (int i = 0; i < MAX_SUBSCRIBERS; ++i) {
+			_cursors[i].value.store(_NONE, std::memory_order_relaxed);
+		}
+		_claim.store(0, std::memory_order_relaxed);
+		_gating.store(0, std::memory_order_relaxed);
+		_put_waiters.store(0, std::memory_order_relaxed);
+		_read_waiters.store(0, std::memory_order_relaxed);
+	}
+
+	virtual ~broadcast_channel() {
+		delete[] _slots;
+	}
+
+	broadcast_channel(const broadcast_channel &rhs) = delete;
+	broadcast_channel& operator = (const broadcast_channel &rhs) = delete;
+
+	size_t capacity() const {
+		return _capacity;
+	}
+
+	// close后put将失败，订阅者读完已经put的item后read返回0
+	void close() {
+		_closed.store(true, std::memory_order_release);
+		std::lock_guard<std::mutex> lock(_wait_mutex);
+		_not_full.notify_all();
+		_not_empty.notify_all();
+	}
+
+	bool is_closed() const {
+		return _closed.load(std::memory_order_acquire);
+	}
+
+	// 返回订阅者编号，从之后put的item开始接收；订阅者已满时返回-1
+	int subscribe() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (int i = 0; i < MAX_SUBSCRIBERS; ++i) {
+			if (_cursors[i].value.load(std::memory_order_relaxed) != _NONE) {
+				continue;
+			}
+			// put先读_claim再扫描游标，这里先写游标再读_claim（都是seq_cst）：
+			// 没有看到这个游标的扫描，算出的_gating不超过它读到的_claim，也就不超过下面读到的now；
+			// 看到了的扫描，算出的_gating不超过start。所以游标最终设为now后，_gating不会超过它
+			uint64_t start = _claim.load();
+			_cursors[i].value.store(start);
+			uint64_t now = _claim.load();
+			_cursors[i].value.store(now);
+			return i;
+		}
+		return -1;
+	}
+
+	// 取消订阅后这个订阅者不再限制put
+	void unsubscribe(int sub) {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			assert(sub >= 0 && sub < MAX_SUBSCRIBERS);
+			_cursors[sub].value.store(_NONE);
+		}
+		wake(_put_waiters, _not_full);
+	}
+
+	// 环满（最慢的订阅者还没有读完一圈）时立即返回false
+	template <typename TT>
+	bool try_put(TT &&in) {
+		uint64_t seq = _claim.load();
+		for (;;) {
+			if (is_closed()) {
+				return false;
+			}
+			// 参考disruptor缓存最慢的游标，只有缓存的值不够用时才扫描所有游标
+			// acquire/release：用缓存值时也要看到订阅者前移游标之前的读取
+			if (seq >= _gating.load(std::memory_order_acquire) + _capacity) {
+				uint64_t gating = min_cursor(seq);
+				_gating.store(gating, std::memory_order_release);
+				if (seq >= gating + _capacity) {
+					return false;
+				}
+			}
+			if (_claim.compare_exchange_weak(seq, seq + 1)) {
+				break;
+			}
+		}
+		slot &s = _slots[seq & _mask];
+		// 已经占用了序号，前一圈的put一定会完成，等待时间很短，只自旋和让出CPU
+		for (int spin = 0; s.published.load(std::memory_order_acquire) != seq - _capacity; ++spin) {
+			relax(spin);
+		}
+		s.data = std::forward<TT>(in);
+		s.published.store(seq, std::memory_order_release);
+		wake(_read_waiters, _not_empty);
+		return true;
+	}
+
+	// 环满时等待最慢的订阅者，close后返回false
+	// timeout单位为毫秒, -1表示不设置超时
+	template <typename TT>
+	bool put(TT &&in, int timeout = -1) {
+		deadline d(timeout);
+		for (int spin = 0; !is_closed(); ++spin) {
+			if (try_put(std::forward<TT>(in))) {
+				return true;
+			}
+			if (spin < _SPINS) {
+				relax(spin);
+				continue;
+			}
+			if (!park(_put_waiters, _not_full, d, [this]() { return !full(); })) {
+				return false;
+			}
+		}
+		return false;
+	}
+
+	// 对所有已发布、还没有读取的item（最多max_batch个）依次调用fn(const item&)，然后一次前移读游标
+	// fn中的引用只在调用期间有效；返回读取的个数，没有数据时返回0
+	template <typename F>
+	size_t try_read(int sub, F &&fn, size_t max_batch = SIZE_MAX) {
+		std::atomic<uint64_t> &cursor = _cursors[sub].value;
+		uint64_t begin = cursor.load(std::memory_order_relaxed);
+		uint64_t end = begin;
+
+		assert(begin != _NONE);
+		while (end - begin < max_batch && _slots[end & _mask].published.load(std::memory_order_acquire) == end) {
+			++end;
+		}
+		for (uint64_t seq = begin; seq < end; ++seq) {
+			fn(static_cast<const item&>(_slots[seq & _mask].data));
+		}
+		if (end != begin) {
+			cursor.store(end, std::memory_order_release);
+			wake(_put_waiters, _not_full);
+		}
+		return (size_t)(end - begin);
+	}
+
+	// 同try_read，没有数据时等待；close后读完所有已经put的item返回0，超时也返回0
+	// timeout单位为毫秒, -1表示不设置超时
+	template <typename F>
+	size_t read(int sub, F &&fn, size_t max_batch = SIZE_MAX, int timeout = -1) {
+		deadline d(timeout);
+		for (int spin = 0; ; ++spin) {
+			size_t n = try_read(sub, fn, max_batch);
+			if (n > 0) {
+				return n;
+			}
+			// close之前已经占用序号的put一定会完成，需要等它发布
+			if (is_closed() && _cursors[sub].value.load(std::memory_order_relaxed) >= _claim.load()) {
+				return 0;
+			}
+			if (spin < _SPINS) {
+				relax(spin);
+				continue;
+			}
+			if (!park(_read_waiters, _not_empty, d, [this, sub]() { return readable(sub); })) {
+				return 0;
+			}
+		}
+	}
+
+	// 订阅者还没有读取的item数，近似值
+	size_t lag(int sub) const {
+		uint64_t cursor = _cursors[sub].value.load(std::memory_order_relaxed);
+		uint64_t claim = _claim.load(std::memory_order_relaxed);
+		return cursor != _NONE && claim > cursor ? (size_t)(claim - cursor) : 0;
+	}
+
+private:
+	static const uint64_t _NONE = UINT64_MAX;
+	static const size_t _CACHE_LINE = 64;
+
+	struct slot {
+		std::atomic<uint64_t> published;
+		item data;
+	};
+
+	// 每个游标独占一个cache line，订阅者前移游标时不会互相影响
+	struct alignas(_CACHE_LINE) cursor {
+		std::atomic<uint64_t> value;
+	};
+
+	// 最慢的订阅者的读游标，没有订阅者时为seq（这一圈内put不受限制）
+	uint64_t min_cursor(uint64_t seq) const {
+		uint64_t min = seq;
+		for (int i = 0; i < MAX_SUBSCRIBERS; ++i) {
+			uint64_t c = _cursors[i].value.load();
+			if (c < min) {
+				min = c;
+			}
+		}
+		return min;
+	}
+
+	// 阻塞之前先短暂自旋、让出CPU，数据很快到来时不必加锁等待
+	static const int _SPINS = 128;
+
+	static void relax(int spin) {
+		if (spin < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#endif
+		} else {
+			std::this_thread::yield();
+		}
+	}
+
+	// 近似判断，只用于决定是否继续阻塞，真正的读写仍然由try_put/try_read完成
+	bool full() const {
+		uint64_t seq = _claim.load();
+		return seq >= min_cursor(seq) + _capacity;
+	}
+
+	bool readable(int sub) const {
+		uint64_t cursor = _cursors[sub].value.load(std::memory_order_relaxed);
+		return _slots[cursor & _mask].published.load(std::memory_order_acquire) == cursor;
+	}
+
+	// timeout单位为毫秒, -1表示不设置超时
+	class deadline {
+	public:
+		explicit deadline(int timeout): _timeout(timeout) {
+			if (_timeout >= 0) {
+				_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(_timeout);
+			}
+		}
+
+		bool forever() const {
+			return _timeout < 0;
+		}
+
+		// 剩余时间，已经超时返回0
+		std::chrono::steady_clock::duration remaining() const {
+			auto now = std::chrono::steady_clock::now();
+			return now < _at ? _at - now : std::chrono::steady_clock::duration::zero();
+		}
+
+	private:
+		int _timeout;
+		std::chrono::steady_clock::time_point _at;
+	};
+
+	// 在cond上阻塞直到ready()或者close，超时返回false
+	// 先增加等待者计数再检查条件，wake先修改槽位/游标再检查计数，两边的seq_cst fence保证至少一方看到对方；
+	// 检查和wait之间一直持有锁，不会漏掉唤醒
+	template <typename F>
+	bool park(std::atomic<int> &waiters, std::condition_variable &cond, const deadline &d, F ready) {
+		std::unique_lock<std::mutex> lock(_wait_mutex);
+		bool ok = true;
+
+		waiters.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (!is_closed() && !ready()) {
+			if (d.forever()) {
+				cond.wait(lock);
+				continue;
+			}
+			auto left = d.remaining();
+			if (left == std::chrono::steady_clock::duration::zero()
+					|| cond.wait_for(lock, left) == std::cv_status::timeout) {
+				ok = is_closed() || ready();
+				break;
+			}
+		}
+		waiters.fetch_sub(1, std::memory_order_relaxed);
+		return ok;
+	}
+
+	void wake(std::atomic<int> &waiters, std::condition_variable &cond) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiters.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lock(_wait_mutex);
+			cond.notify_all();
+		}
+	}
+
+	slot                               *_slots;
+	size_t                              _capacity;
+	size_t                              _mask;
+	std::mutex                          _mutex;		// 只保护订阅和取消订阅
+	cursor                              _cursors[MAX_SUBSCRIBERS];
+	alignas(_CACHE_LINE) std::atomic<uint64_t> _claim;
+	alignas(_CACHE_LINE) std::atomic<uint64_t> _gating;	// 缓存的最慢游标，不大于任何订阅者的读游标
+	alignas(_CACHE_LINE) std::atomic<bool>     _closed;
+	std::atomic<int>                    _put_waiters;
+	std::atomic<int>                    _read_waiters;
+	std::mutex                          _wait_mutex;	// 只在阻塞和唤醒时使用
+	std::condition_variable             _not_full;
+	std::condition_variable             _not_empty;
+};
+
+
+#endif	// __BROADCAST_CHANNEL_H
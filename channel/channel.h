@@ -0,0 +1,73 @@
+#ifndef __CHANNEL_H
+#define __CHANNEL_H
+
+#include <list>
+#include <string>
+#include <pthread.h>
+
+#include "../trace/trace.h"
+
+template<typename item>
+class channel {
+public:
+	channel(): closed(false) {
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&cond, NULL);
+	}
+
+	virtual ~channel() {
+		pthread_mutex_destroy(&mutex);
+		pthread_cond_destroy(&cond);
+		queue.clear();
+	}
+
+	void close() {
+		pthread_mutex_lock(&mutex);
+		closed = true;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&mutex);
+	}
+
+	bool is_closed() {
+		pthread_mutex_lock(&mutex);
+		bool ret = closed;
+		pthread_mutex_unlock(&mutex);
+		return ret;
+	}
+
+	void put(const item &in) {
+		pthread_mutex_lock(&mutex);
+		if (closed) {
+			throw std::string("put to closed channel");
+		}
+		queue.push_back(in);
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+	}
+
+	bool get(item &out, bool wait = true) {
+		TRACE_SCOPE("channel::get");
+		pthread_mutex_lock(&mutex);
+		while (!closed && queue.empty()) {
+			pthread_cond_wait(&cond, &mutex);
+		}
+		if (queue.empty()) {
+			pthread_mutex_unlock(&mutex);
+			return false;
+		}
+
+		out = queue.front();
+		queue.pop_front();
+		pthread_mutex_unlock(&mutex);
+		return true;
+	}
+
+private:
+	std::list<item> queue;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool closed;
+};
+
+
+#endif	// __CHANNEL_H
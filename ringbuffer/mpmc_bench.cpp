@@ -0,0 +1,88 @@
+// mpmc_ring与TXCGradeBlockingQueue、channel的吞吐对比
+// 编译：g++ -O2 -std=c++11 -o mpmc_bench mpmc_bench.cpp -pthread
+// 每轮启动n个生产者和n个消费者，n = 1, 2, 4, 8, 16, 32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "mpmc_ring.h"
+#include "../BlockingQueue/TXCGradeBlockingQueue.h"
+#include "../channel/channel.h"
+
+static const uint64_t ITEMS = 1 << 21;
+
+struct ring_adapter {
+	mpmc_ring<uint64_t> q;
+	ring_adapter(): q(1024) { }
+	void put(uint64_t v) { q.push(v); }
+	bool get(uint64_t &v) { return q.pop(v); }
+	void close() { q.close(); }
+};
+
+struct grade_queue_adapter {
+	TXCGradeBlockingQueue<uint64_t> q;
+	void put(uint64_t v) { q.push(v, 1); }
+	bool get(uint64_t &v) { return q.pop(v); }
+	void close() { q.close(); }
+};
+
+struct channel_adapter {
+	channel<uint64_t> q;
+	void put(uint64_t v) { q.put(v); }
+	bool get(uint64_t &v) { return q.get(v); }
+	void close() { q.close(); }
+};
+
+template<typename Q>
+double run(int n) {
+	Q q;
+	std::atomic<uint64_t> sum(0);
+	std::vector<std::thread> producers, consumers;
+	uint64_t per = ITEMS / n;
+
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < n; ++i) {
+		consumers.emplace_back([&q, &sum]() {
+			uint64_t v = 0, s = 0;
+			while (q.get(v)) {
+				s += v;
+			}
+			sum += s;
+		});
+	}
+	for (int i = 0; i < n; ++i) {
+		producers.emplace_back([&q, i, per]() {
+			for (uint64_t v = i * per + 1; v <= (i + 1) * per; ++v) {
+				q.put(v);
+			}
+		});
+	}
+	for (auto &t : producers) t.join();
+	q.close();
+	for (auto &t : consumers) t.join();
+	auto end = std::chrono::steady_clock::now();
+
+	uint64_t total = per * n;
+	if (sum != total * (total + 1) / 2) {
+		fprintf(stderr, "checksum mismatch\n");
+		exit(-1);
+	}
+	double sec = std::chrono::duration<double>(end - begin).count();
+	return total / sec / 1e6;
+}
+
+int main() {
+	printf("%8s %14s %14s %14s\n", "threads", "mpmc_ring", "grade_queue", "channel");
+	for (int n = 1; n <= 32; n *= 2) {
+		double a = run<ring_adapter>(n);
+		double b = run<grade_queue_adapter>(n);
+		double c = run<channel_adapter>(n);
+		printf("%8d %9.2f Mops %9.2f Mops %9.2f Mops\n", n, a, b, c);
+	}
+	return 0;
+}
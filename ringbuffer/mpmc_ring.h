@@ -0,0 +1,268 @@
+#ifndef __MPMC_RING_H
+#define __MPMC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// 有界的多生产者多消费者环形队列（每个槽位带序号，参考Dmitry Vyukov的bounded MPMC queue）
+// 容量向上取整为2的幂（至少为2），所有槽位在构造时一次性分配，之后push/pop不再申请内存
+//
+// 槽位序号seq的含义（pos为全局递增的读写位置）：
+//   seq == pos       槽位空闲，可以写入位置pos
+//   seq == pos + 1   槽位已写入位置pos的数据，可以读取
+//   seq == pos + cap 槽位已被读走，等待下一圈写入
+//
+// push/pop先自旋、再让出CPU，仍然满/空时在条件变量上阻塞，不占用CPU；
+// try_push/try_pop成功后只有在有线程阻塞时才加锁唤醒，没有等待者时不碰锁
+//
+// 注意：T需要可默认构造，pop通过移动赋值取出数据
+template<typename T>
+class mpmc_ring {
+public:
+	explicit mpmc_ring(size_t capacity): _closed(false) {
+		assert(capacity >= 1);
+		// 只有一个槽位时"已写入位置pos"和"可以写入位置pos + 1"的序号相同，至少需要两个
+		_capacity = 2;
+		while (_capacity < capacity) {
+			_capacity <<= 1;
+		}
+		_mask = _capacity - 1;
+		_cells = new cell[_capacity];
+		for (size_t i = 0; i < _capacity; ++i) {
+			_cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+		_enqueue_pos.store(0, std::memory_order_relaxed);
+		_dequeue_pos.store(0, std::memory_order_relaxed);
+		_push_waiters.store(0, std::memory_order_relaxed);
+		_pop_waiters.store(0, std::memory_order_relaxed);
+	}
+
+	virtual ~mpmc_ring() {
+		delete[] _cells;
+	}
+
+	mpmc_ring(const mpmc_ring &rhs) = delete;
+	mpmc_ring& operator = (const mpmc_ring &rhs) = delete;
+
+	// close后push将失败，pop在读空后不再阻塞
+	void close() {
+		_closed.store(true, std::memory_order_release);
+		std::lock_guard<std::mutex> lock(_mutex);
+		_not_full.notify_all();
+		_not_empty.notify_all();
+	}
+
+	bool is_closed() const {
+		return _closed.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const {
+		return _capacity;
+	}
+
+	// 近似值，并发读写时仅供参考
+	size_t size() const {
+		size_t w = _enqueue_pos.load(std::memory_order_relaxed);
+		size_t r = _dequeue_pos.load(std::memory_order_relaxed);
+		return w > r ? w - r : 0;
+	}
+
+	// 队列满时立即返回false
+	template <typename TT>
+	bool try_push(TT &&item) {
+		cell *c;
+		size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+		for (;;) {
+			c = &_cells[pos & _mask];
+			size_t seq = c->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (0 == diff) {
+				if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = _enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+		c->data = std::forward<TT>(item);
+		c->seq.store(pos + 1, std::memory_order_release);
+		wake(_pop_waiters, _not_empty);
+		return true;
+	}
+
+	// 队列空时立即返回false
+	bool try_pop(T &item) {
+		cell *c;
+		size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+		for (;;) {
+			c = &_cells[pos & _mask];
+			size_t seq = c->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (0 == diff) {
+				if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = _dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+		item = std::move(c->data);
+		c->seq.store(pos + _mask + 1, std::memory_order_release);
+		wake(_push_waiters, _not_full);
+		return true;
+	}
+
+	// 队列满时等待，close后返回false
+	// timeout单位为毫秒, -1表示不设置超时
+	template <typename TT>
+	bool push(TT &&item, int timeout = -1) {
+		backoff b(timeout);
+		while (!is_closed()) {
+			if (try_push(std::forward<TT>(item))) {
+				return true;
+			}
+			if (b.spin()) {
+				continue;
+			}
+			if (!park(_push_waiters, _not_full, b, [this]() { return !full(); })) {
+				return false;
+			}
+		}
+		return false;
+	}
+
+	// 队列空时等待，若已close则读空后返回false
+	// timeout单位为毫秒, -1表示不设置超时
+	bool pop(T &item, int timeout = -1) {
+		backoff b(timeout);
+		for (;;) {
+			if (try_pop(item)) {
+				return true;
+			}
+			if (is_closed()) {
+				// close之前写入的数据仍然可以读到
+				return try_pop(item);
+			}
+			if (b.spin()) {
+				continue;
+			}
+			if (!park(_pop_waiters, _not_empty, b, [this]() { return !empty(); })) {
+				return false;
+			}
+		}
+	}
+
+private:
+	struct cell {
+		std::atomic<size_t> seq;
+		T data;
+	};
+
+	// 近似判断，只用于决定是否继续阻塞，真正的读写仍然由try_push/try_pop完成
+	bool full() const {
+		size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+		return (intptr_t)_cells[pos & _mask].seq.load(std::memory_order_acquire) - (intptr_t)pos < 0;
+	}
+
+	bool empty() const {
+		size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+		return (intptr_t)_cells[pos & _mask].seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1) < 0;
+	}
+
+	// 先自旋，再让出CPU，之后由park阻塞
+	class backoff {
+	public:
+		explicit backoff(int timeout): _count(0), _timeout(timeout) {
+			if (_timeout >= 0) {
+				_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_timeout);
+			}
+		}
+
+		// 还在自旋阶段返回true，自旋结束后返回false
+		bool spin() {
+			if (_count >= 128) {
+				return false;
+			}
+			if (_count < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+				__builtin_ia32_pause();
+#endif
+			} else {
+				std::this_thread::yield();
+			}
+			_count++;
+			return true;
+		}
+
+		bool has_deadline() const {
+			return _timeout >= 0;
+		}
+
+		std::chrono::steady_clock::time_point deadline() const {
+			return _deadline;
+		}
+
+	private:
+		int _count;
+		int _timeout;
+		std::chrono::steady_clock::time_point _deadline;
+	};
+
+	// 在cond上阻塞直到ready()或者close，超时返回false
+	// 先增加等待者计数再检查条件，wake先修改槽位再检查计数，两边的seq_cst fence保证至少一方看到对方：
+	// 要么这里看到槽位已经可用，要么wake看到等待者并在锁内唤醒；检查和wait之间一直持有锁，不会漏掉唤醒
+	template <typename F>
+	bool park(std::atomic<int> &waiters, std::condition_variable &cond, const backoff &b, F ready) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		bool ok = true;
+
+		waiters.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (!is_closed() && !ready()) {
+			if (!b.has_deadline()) {
+				cond.wait(lock);
+			} else if (cond.wait_until(lock, b.deadline()) == std::cv_status::timeout) {
+				ok = is_closed() || ready();
+				break;
+			}
+		}
+		waiters.fetch_sub(1, std::memory_order_relaxed);
+		return ok;
+	}
+
+	void wake(std::atomic<int> &waiters, std::condition_variable &cond) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiters.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			cond.notify_all();
+		}
+	}
+
+	static const size_t _CACHE_LINE = 64;
+
+	cell                               *_cells;
+	size_t                              _capacity;
+	size_t                              _mask;
+	alignas(_CACHE_LINE) std::atomic<size_t> _enqueue_pos;
+	alignas(_CACHE_LINE) std::atomic<size_t> _dequeue_pos;
+	alignas(_CACHE_LINE) std::atomic<bool>   _closed;
+	std::atomic<int>                    _push_waiters;
+	std::atomic<int>                    _pop_waiters;
+	std::mutex                          _mutex;		// 只在阻塞和唤醒时使用
+	std::condition_variable             _not_full;
+	std::condition_variable             _not_empty;
+};
+
+
+#endif	// __MPMC_RING_H
@@ -0,0 +1,222 @@
+// mpmc_ring的测试
+// 编译：g++ -O2 -std=c++11 -o mpmc_test mpmc_test.cpp -pthread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "mpmc_ring.h"
+
+static double thread_cpu_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point begin) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void test1() {
+	puts("begin test1");
+
+	mpmc_ring<int> q(3);
+	int v = 0;
+	if (q.capacity() != 4 || q.size() != 0 || q.try_pop(v)) {
+		exit(-1);
+	}
+
+	for (int i = 0; i < 4; ++i) {
+		if (!q.try_push(i)) {
+			exit(-1);
+		}
+	}
+	if (q.try_push(4) || q.size() != 4) {
+		exit(-1);
+	}
+
+	// 先进先出，读走一个之后可以再写一个
+	if (!q.try_pop(v) || v != 0 || !q.try_push(4)) {
+		exit(-1);
+	}
+	for (int i = 1; i <= 4; ++i) {
+		if (!q.try_pop(v) || v != i) {
+			exit(-1);
+		}
+	}
+	if (q.try_pop(v) || q.size() != 0) {
+		exit(-1);
+	}
+
+	puts("test1 success");
+}
+
+// 阻塞的pop/push不占用CPU，对端操作后被唤醒
+void test2() {
+	puts("begin test2");
+
+	mpmc_ring<int> q(2);
+	double cpu = 0;
+	int v = 0;
+	bool ok = false;
+
+	std::thread consumer([&]() {
+		double begin = thread_cpu_ms();
+		ok = q.pop(v);
+		cpu = thread_cpu_ms() - begin;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	q.push(7);
+	consumer.join();
+	if (!ok || v != 7 || cpu > 10) {
+		printf("pop blocked 300ms, cpu %.1fms\n", cpu);
+		exit(-1);
+	}
+
+	q.push(1);
+	q.push(2);
+	std::thread producer([&]() {
+		double begin = thread_cpu_ms();
+		ok = q.push(3);
+		cpu = thread_cpu_ms() - begin;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	q.pop(v);
+	producer.join();
+	if (!ok || v != 1 || cpu > 10) {
+		printf("push blocked 300ms, cpu %.1fms\n", cpu);
+		exit(-1);
+	}
+	if (!q.try_pop(v) || v != 2 || !q.try_pop(v) || v != 3) {
+		exit(-1);
+	}
+
+	puts("test2 success");
+}
+
+// 超时
+void test3() {
+	puts("begin test3");
+
+	mpmc_ring<int> q(1);
+	int v = 0;
+	if (q.capacity() != 2) {
+		exit(-1);
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	bool ok = q.pop(v, 50);
+	double ms = elapsed_ms(begin);
+	if (ok || ms < 45 || ms > 1000) {
+		exit(-1);
+	}
+
+	q.push(1);
+	q.push(2);
+	begin = std::chrono::steady_clock::now();
+	ok = q.push(3, 50);
+	ms = elapsed_ms(begin);
+	if (ok || ms < 45 || ms > 1000 || q.size() != 2) {
+		exit(-1);
+	}
+
+	puts("test3 success");
+}
+
+// close唤醒阻塞的push和pop，close之前写入的数据仍然可以读到
+void test4() {
+	puts("begin test4");
+
+	mpmc_ring<int> empty(2), full(2);
+	std::atomic<int> woken(0);
+	int v = 0;
+
+	full.push(1);
+	full.push(2);
+	std::thread consumer([&]() {
+		int x;
+		if (!empty.pop(x)) woken++;
+	});
+	std::thread producer([&]() {
+		if (!full.push(3)) woken++;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	empty.close();
+	full.close();
+	consumer.join();
+	producer.join();
+	if (woken != 2) {
+		exit(-1);
+	}
+
+	bool ok = full.pop(v);
+	if (!ok || v != 1) {
+		exit(-1);
+	}
+	ok = full.pop(v);
+	if (!ok || v != 2) {
+		exit(-1);
+	}
+	ok = full.pop(v);
+	if (ok) {
+		exit(-1);
+	}
+
+	puts("test4 success");
+}
+
+// 容量很小，生产者和消费者频繁阻塞，检查不丢失、不重复、不卡住
+void test5() {
+	puts("begin test5");
+
+	const int n = 4;
+	const uint64_t per = 100000;
+	mpmc_ring<uint64_t> q(2);
+	std::atomic<uint64_t> sum(0), count(0);
+	std::vector<std::thread> producers, consumers;
+
+	for (int i = 0; i < n; ++i) {
+		consumers.emplace_back([&]() {
+			uint64_t v = 0, s = 0, c = 0;
+			while (q.pop(v)) {
+				s += v;
+				c++;
+			}
+			sum += s;
+			count += c;
+		});
+	}
+	for (int i = 0; i < n; ++i) {
+		producers.emplace_back([&q, i, per]() {
+			for (uint64_t v = i * per + 1; v <= (i + 1) * per; ++v) {
+				if (!q.push(v)) exit(-1);
+			}
+		});
+	}
+	for (auto &t : producers) t.join();
+	q.close();
+	for (auto &t : consumers) t.join();
+
+	uint64_t total = n * per;
+	if (count != total || sum != total * (total + 1) / 2) {
+		exit(-1);
+	}
+
+	puts("test5 success");
+}
+
+int main() {
+
+	test1();
+	test2();
+	test3();
+	test4();
+	test5();
+
+	return 0;
+}
@@ -0,0 +1,170 @@
+#ifndef __RB_LOSSY_H
+#define __RB_LOSSY_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <string.h>
+
+// 覆盖写的ringbuffer：只保留最新的capacity个字节，写满后直接覆盖最旧的数据，写入永远不会失败
+// 适用于一个写线程 + 多个读线程（监控数据、调试轨迹等），读线程通过序号检测读到的数据是否被覆盖：
+//   1. 写线程先把rb_seq_begin推进到本次写入的结束位置，再拷贝数据，最后把rb_seq_end推进到同一位置
+//   2. 读线程根据rb_seq_end确定要读的区间[start, end)，拷贝数据后再读取rb_seq_begin，
+//      若rb_seq_begin - start > capacity，说明拷贝过程中start处的数据已被覆盖，需要重试
+// 位置rb_seq_*是从创建开始累计写入的字节数，不会回绕
+
+typedef struct {
+	size_t rb_capacity;		// 容量，2的幂
+	size_t rb_mask;
+	uint64_t rb_seq_begin;	// [0, rb_seq_begin) 已经写入或正在写入
+	uint64_t rb_seq_end;	// [0, rb_seq_end) 已经写入完成
+	char *rb_buf;
+}rb_lossy_t;
+
+
+// 申请一个ringbuffer，容量向上取整为2的幂
+static inline rb_lossy_t* rb_lossy_malloc(size_t capacity);
+
+// 释放指定ringbuffer的内存
+static inline void rb_lossy_free(rb_lossy_t *rb);
+
+// 返回ringbuffer的容量
+static inline size_t rb_lossy_get_capacity(const rb_lossy_t *rb);
+
+// 返回累计写入的字节数（即最新数据的结束位置）
+static inline uint64_t rb_lossy_get_position(const rb_lossy_t *rb);
+
+// 写入n个字节，空间不足时覆盖最旧的数据，n大于容量时只保留最后capacity个字节
+// 只允许一个线程写入
+static inline void rb_lossy_write(rb_lossy_t *rb, const void *input, size_t n);
+
+// 读取最新的n个字节, [output, output+n)，不足n个字节时读取全部
+// 可以和写线程并发调用，读到被覆盖的数据时自动重试，返回读取的字节数
+static inline size_t rb_lossy_read_latest(rb_lossy_t *rb, void *output, size_t n);
+
+// 从位置*pos开始读取最多n个字节，读取成功后更新*pos，用于持续跟踪新写入的数据
+// 若*pos处的数据已被覆盖，则从仍然有效的最旧数据开始读取（*pos会向前跳跃，调用者可据此统计丢失的字节数）
+static inline size_t rb_lossy_read_from(rb_lossy_t *rb, uint64_t *pos, void *output, size_t n);
+
+
+static inline rb_lossy_t* rb_lossy_malloc(size_t capacity) {
+	rb_lossy_t *rb = (rb_lossy_t*)malloc(sizeof(rb_lossy_t));
+	if (!rb) return NULL;
+
+	size_t cap = 1;
+	while (cap < capacity) {
+		cap <<= 1;
+	}
+
+	rb->rb_capacity		= cap;
+	rb->rb_mask			= cap - 1;
+	rb->rb_seq_begin	= 0;
+	rb->rb_seq_end		= 0;
+	rb->rb_buf			= (char*)malloc(cap);
+
+	if (!rb->rb_buf) {
+		free(rb);
+		return NULL;
+	}
+	return rb;
+}
+
+static inline void rb_lossy_free(rb_lossy_t *rb) {
+	free(rb->rb_buf);
+	free(rb);
+}
+
+static inline size_t rb_lossy_get_capacity(const rb_lossy_t *rb) {
+	return rb->rb_capacity;
+}
+
+static inline uint64_t rb_lossy_get_position(const rb_lossy_t *rb) {
+	return __atomic_load_n(&rb->rb_seq_end, __ATOMIC_ACQUIRE);
+}
+
+// 将[start, start+n)拷贝到output，n不超过容量
+static inline void rb_lossy_copy_out(const rb_lossy_t *rb, uint64_t start, char *output, size_t n) {
+	size_t off = start & rb->rb_mask;
+	size_t m = rb->rb_capacity - off;
+
+	if (n <= m) {
+		memcpy(output, rb->rb_buf + off, n);
+	} else {
+		memcpy(output, rb->rb_buf + off, m);
+		memcpy(output + m, rb->rb_buf, n - m);
+	}
+}
+
+static inline void rb_lossy_write(rb_lossy_t *rb, const void *input, size_t n) {
+	assert(rb != NULL);
+	assert(input != NULL || n == 0);
+
+	const char *src = (const char*)input;
+	uint64_t end = rb->rb_seq_end + n;
+
+	if (n > rb->rb_capacity) {
+		src += n - rb->rb_capacity;
+		n = rb->rb_capacity;
+	}
+
+	__atomic_store_n(&rb->rb_seq_begin, end, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	size_t off = (end - n) & rb->rb_mask;
+	size_t m = rb->rb_capacity - off;
+	if (n <= m) {
+		memcpy(rb->rb_buf + off, src, n);
+	} else {
+		memcpy(rb->rb_buf + off, src, m);
+		memcpy(rb->rb_buf, src + m, n - m);
+	}
+
+	__atomic_store_n(&rb->rb_seq_end, end, __ATOMIC_RELEASE);
+}
+
+static inline size_t rb_lossy_read_latest(rb_lossy_t *rb, void *output, size_t n) {
+	assert(rb != NULL);
+	assert(output != NULL);
+
+	for (;;) {
+		uint64_t end = __atomic_load_n(&rb->rb_seq_end, __ATOMIC_ACQUIRE);
+		size_t len = n;
+		if (len > end) len = (size_t)end;
+		if (len > rb->rb_capacity) len = rb->rb_capacity;
+
+		uint64_t start = end - len;
+		rb_lossy_copy_out(rb, start, (char*)output, len);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&rb->rb_seq_begin, __ATOMIC_RELAXED) - start <= rb->rb_capacity) {
+			return len;
+		}
+	}
+}
+
+static inline size_t rb_lossy_read_from(rb_lossy_t *rb, uint64_t *pos, void *output, size_t n) {
+	assert(rb != NULL);
+	assert(pos != NULL);
+	assert(output != NULL);
+
+	for (;;) {
+		uint64_t end = __atomic_load_n(&rb->rb_seq_end, __ATOMIC_ACQUIRE);
+		uint64_t start = *pos;
+
+		if (start > end) start = end;
+		if (end - start > rb->rb_capacity) start = end - rb->rb_capacity;
+
+		size_t len = n;
+		if (len > end - start) len = (size_t)(end - start);
+		rb_lossy_copy_out(rb, start, (char*)output, len);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&rb->rb_seq_begin, __ATOMIC_RELAXED) - start <= rb->rb_capacity) {
+			*pos = start + len;
+			return len;
+		}
+	}
+}
+
+
+#endif	// __RB_LOSSY_H
@@ -0,0 +1,136 @@
+#ifndef __RB_RECORD_H
+#define __RB_RECORD_H
+
+#include <stdint.h>
+#include "ringbuffer.h"
+
+// 基于ringbuffer_t的变长记录层，每条记录 = 4字节长度头 + 数据，
+// 记录在buffer中总是连续存放，因此可以直接原地读取，不需要拷贝。
+// 若尾部剩余空间放不下一条完整记录，则写入一个跳过标记(RB_RECORD_SKIP)后回绕到buffer开头；
+// 若尾部剩余空间连长度头都放不下，则直接回绕（读端按同样的规则跳过）。
+//
+// 注意：同一个ringbuffer_t不要混用rb_write/rb_read和记录接口
+
+#define RB_RECORD_HDR_SIZE	sizeof(uint32_t)
+#define RB_RECORD_SKIP		((uint32_t)0xFFFFFFFF)
+
+// 写入一条长度为n(n>0)的记录, [input, input+n)
+// 若没有足够的连续空间，则写入失败返回0，否则写入成功返回n
+static inline size_t rb_push_record(ringbuffer_t *rb, const void *input, size_t n);
+
+// 读取最旧的一条记录（不删除），*data指向buffer内部，在下一次pop之前有效
+// 没有记录返回0，否则返回1
+static inline int rb_peek_record(ringbuffer_t *rb, const void **data, size_t *n);
+
+// 读取并删除最旧的一条记录, [output, output+n)
+// 没有记录或者output_max不足返回0，否则返回记录长度
+// output为NULL时只删除不读取，即O(1)丢弃最旧的记录，用于过载时丢弃消息
+static inline size_t rb_pop_record(ringbuffer_t *rb, void *output, size_t output_max);
+
+
+// 读取位置为pos的长度头，处理尾部回绕和跳过标记，返回记录的起始位置
+static inline size_t rb_record_locate(const ringbuffer_t *rb, size_t pos, uint32_t *len) {
+	size_t total = rb->rb_capacity + 1;
+
+	if (total - pos < RB_RECORD_HDR_SIZE) {
+		pos = 0;
+	}
+	memcpy(len, rb->rb_buf + pos, RB_RECORD_HDR_SIZE);
+	if (RB_RECORD_SKIP == *len) {
+		pos = 0;
+		memcpy(len, rb->rb_buf, RB_RECORD_HDR_SIZE);
+	}
+	return pos;
+}
+
+static inline size_t rb_push_record(ringbuffer_t *rb, const void *input, size_t n) {
+	assert(rb != NULL);
+	assert(input != NULL);
+
+	size_t total = rb->rb_capacity + 1;
+	size_t need = RB_RECORD_HDR_SIZE + n;
+	size_t pos = rb->rb_pw;
+	uint32_t len = (uint32_t)n;
+
+	if (0 == n || n >= RB_RECORD_SKIP) {
+		return 0;
+	}
+	if (pos == total) {
+		pos = 0;
+	}
+
+	if (rb->rb_pr <= pos) {
+		// 尾部可用空间，rb_pr为0时需要保留一个字节区分空和满
+		size_t tail = total - pos - (0 == rb->rb_pr ? 1 : 0);
+		if (need > tail) {
+			// 尾部放不下，回绕到开头，开头的可用空间为[0, rb_pr-1)
+			if (0 == rb->rb_pr || need > rb->rb_pr - 1) {
+				return 0;
+			}
+			if (total - pos >= RB_RECORD_HDR_SIZE) {
+				len = RB_RECORD_SKIP;
+				memcpy(rb->rb_buf + pos, &len, RB_RECORD_HDR_SIZE);
+				len = (uint32_t)n;
+			}
+			pos = 0;
+		}
+	} else if (need > rb->rb_pr - pos - 1) {
+		return 0;
+	}
+
+	memcpy(rb->rb_buf + pos, &len, RB_RECORD_HDR_SIZE);
+	memcpy(rb->rb_buf + pos + RB_RECORD_HDR_SIZE, input, n);
+	rb->rb_pw = pos + need;
+	rb_commit(rb);
+
+	return n;
+}
+
+static inline int rb_peek_record(ringbuffer_t *rb, const void **data, size_t *n) {
+	assert(rb != NULL);
+
+	uint32_t len;
+	size_t pos;
+
+	if (rb->rb_pr == rb->rb_pw) {
+		return 0;
+	}
+
+	pos = rb_record_locate(rb, rb->rb_pr, &len);
+	if (data) *data = rb->rb_buf + pos + RB_RECORD_HDR_SIZE;
+	if (n) *n = len;
+
+	return 1;
+}
+
+static inline size_t rb_pop_record(ringbuffer_t *rb, void *output, size_t output_max) {
+	assert(rb != NULL);
+
+	uint32_t len;
+	size_t pos;
+
+	if (rb->rb_pr == rb->rb_pw) {
+		return 0;
+	}
+
+	pos = rb_record_locate(rb, rb->rb_pr, &len);
+	if (output) {
+		if (output_max < len) {
+			return 0;
+		}
+		memcpy(output, rb->rb_buf + pos + RB_RECORD_HDR_SIZE, len);
+	}
+
+	rb->rb_pr = pos + RB_RECORD_HDR_SIZE + len;
+	if (rb->rb_pr == rb->rb_pw) {
+		// 读空后回到开头，尽量留出连续空间
+		rb_reset(rb);
+	} else {
+		rb_commit(rb);
+	}
+
+	return len;
+}
+
+
+#endif	// __RB_RECORD_H
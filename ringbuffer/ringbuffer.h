@@ -2,51 +2,100 @@
 #define __RINGBUFFER_H
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 文件映射模式的持久化策略
+#define RB_SYNC_NONE		0	// 不主动msync，由内核回写，进程重启不丢数据
+#define RB_SYNC_COMMIT		1	// 每次修改后msync，机器掉电也不丢已提交的数据
+#define RB_SYNC_PERIODIC	2	// 距上次msync超过指定间隔时才msync
+
+// 文件映射模式下的文件头，单独占一个页，之后是capacity+1字节的buffer
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t capacity;
+	uint64_t pr;
+	uint64_t pw;
+}rb_file_header_t;
+
+#define RB_FILE_MAGIC		0x46554252	// "RBUF"
+#define RB_FILE_VERSION		1
 
 typedef struct {
 	size_t rb_capacity;	// 容量
 	size_t rb_pr;		// 开始读的位置
 	size_t rb_pw;		// 开始写的位置
 	char *rb_buf;		// 实际buffer
+
+	rb_file_header_t *rb_hdr;	// 文件映射模式下的文件头，malloc模式为NULL
+	size_t rb_map_size;			// 映射的总大小
+	int rb_fd;					// 映射的文件
+	int rb_sync_policy;			// 持久化策略
+	uint32_t rb_sync_interval_ms;
+	uint64_t rb_last_sync_ms;
 }ringbuffer_t;
 
 
 // 申请一个容量为capacity的ringbuffer
-ringbuffer_t* rb_malloc(size_t capacity);
+static inline ringbuffer_t* rb_malloc(size_t capacity);
+
+// 释放指定ringbuffer的内存（文件映射模式等同于rb_close）
+static inline void rb_free(ringbuffer_t *rb);
+
+// 打开（不存在则创建）文件path，映射为容量为capacity的ringbuffer
+// 文件中已写入但未读取的数据在重新打开后仍然可以读取
+// 创建时在写好文件头之前崩溃留下的文件头全为0，重新打开时按新文件处理
+// 已有文件的容量与capacity不一致或者文件损坏时返回NULL
+static inline ringbuffer_t* rb_open(const char *path, size_t capacity);
+
+// 提交读写位置并msync，然后解除映射、关闭文件
+static inline void rb_close(ringbuffer_t *rb);
 
-// 释放指定ringbuffer的内存
-void rb_free(ringbuffer_t *rb);
+// 设置文件映射模式的持久化策略，interval_ms仅对RB_SYNC_PERIODIC有效
+static inline void rb_set_sync_policy(ringbuffer_t *rb, int policy, uint32_t interval_ms);
+
+// 将读写位置写入文件头，并按持久化策略决定是否msync，malloc模式下什么也不做
+// 所有修改读写位置的接口都会自动调用
+static inline void rb_commit(ringbuffer_t *rb);
+
+// 立即msync数据和文件头
+static inline int rb_sync(ringbuffer_t *rb);
 
 // 重置ringbuffer
-void rb_reset(ringbuffer_t *rb);
+static inline void rb_reset(ringbuffer_t *rb);
 
 // 返回ringbuffer的容量
-size_t rb_get_capacity(const ringbuffer_t *rb);
+static inline size_t rb_get_capacity(const ringbuffer_t *rb);
 
 // 返回ringbuffer中的已用空间大小
-size_t rb_get_size(const ringbuffer_t *rb);
+static inline size_t rb_get_size(const ringbuffer_t *rb);
 
 // 返回ringbuffer中的未用空间大小
-size_t rb_get_free_size(const ringbuffer_t *rb);
+static inline size_t rb_get_free_size(const ringbuffer_t *rb);
 
 // 从ringbuffer中读取n个字节, [output, output+n)
 // 若ringbuffer的size小于n，则读取失败返回0，否则读取成功返回n
-size_t rb_read(ringbuffer_t *rb, void *output, size_t n);
+static inline size_t rb_read(ringbuffer_t *rb, void *output, size_t n);
 
 // 向ringbuffer中写入n个字节, [input, input+n)
 // 若ringbuffer的free_size小于n，则写入失败返回0，否则写入成功返回n
-size_t rb_write(ringbuffer_t *rb, void *input, size_t n);
+static inline size_t rb_write(ringbuffer_t *rb, void *input, size_t n);
 
 // 删除最新的n个字节，若size不足n，则重置ringbuffer
-void rb_remove_newest(ringbuffer_t *rb, size_t n);
+static inline void rb_remove_newest(ringbuffer_t *rb, size_t n);
 
 // 删除最旧的n个字节，若size不足n，则重置ringbuffer
-void rb_remove_oldest(ringbuffer_t *rb, size_t n);
+static inline void rb_remove_oldest(ringbuffer_t *rb, size_t n);
 
 
-ringbuffer_t* rb_malloc(size_t capacity) {
+static inline ringbuffer_t* rb_malloc(size_t capacity) {
 	ringbuffer_t *rb = (ringbuffer_t*)malloc(sizeof(ringbuffer_t));
 	if (!rb) return NULL;
 
@@ -54,25 +103,179 @@ ringbuffer_t* rb_malloc(size_t capacity) {
 	rb->rb_pr		= 0;
 	rb->rb_pw		= 0;
 	rb->rb_buf		= (char*)malloc(capacity + 1);
+	rb->rb_hdr		= NULL;
+	rb->rb_map_size	= 0;
+	rb->rb_fd		= -1;
+	rb->rb_sync_policy		= RB_SYNC_NONE;
+	rb->rb_sync_interval_ms	= 0;
+	rb->rb_last_sync_ms		= 0;
 	
 	if (!rb->rb_buf) return NULL;
 	else return rb;
 }
 
-void rb_free(ringbuffer_t *rb) {
+static inline void rb_free(ringbuffer_t *rb) {
+	if (rb->rb_hdr) {
+		rb_close(rb);
+		return;
+	}
 	free(rb->rb_buf);
 	free(rb);
 }
 
-void rb_reset(ringbuffer_t *rb) {
+static inline uint64_t rb_now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline size_t rb_header_size() {
+	long page = sysconf(_SC_PAGESIZE);
+	return page > (long)sizeof(rb_file_header_t) ? (size_t)page : sizeof(rb_file_header_t);
+}
+
+static inline ringbuffer_t* rb_open(const char *path, size_t capacity) {
+	struct stat st;
+	size_t hdr_size = rb_header_size();
+	size_t map_size = hdr_size + capacity + 1;
+	rb_file_header_t *hdr;
+	rb_file_header_t zero;
+	void *map;
+	int created = 0;
+
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) return NULL;
+
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+	if (0 == st.st_size) {
+		if (ftruncate(fd, map_size) < 0) {
+			close(fd);
+			return NULL;
+		}
+		created = 1;
+	} else if ((size_t)st.st_size != map_size) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == map) {
+		close(fd);
+		return NULL;
+	}
+	hdr = (rb_file_header_t*)map;
+
+	// ftruncate之后、文件头落盘之前崩溃，文件大小正确但文件头全为0
+	memset(&zero, 0, sizeof(zero));
+	if (!created && 0 == memcmp(hdr, &zero, sizeof(zero))) {
+		created = 1;
+	}
+
+	if (created) {
+		// magic最后写入并立即落盘，magic有效时其他字段一定已经写好
+		hdr->version	= RB_FILE_VERSION;
+		hdr->capacity	= capacity;
+		hdr->pr			= 0;
+		hdr->pw			= 0;
+		hdr->magic		= RB_FILE_MAGIC;
+		if (msync(map, hdr_size, MS_SYNC) < 0) {
+			munmap(map, map_size);
+			close(fd);
+			return NULL;
+		}
+	} else if (hdr->magic != RB_FILE_MAGIC || hdr->version != RB_FILE_VERSION || hdr->capacity != capacity
+			|| hdr->pr > capacity + 1 || hdr->pw > capacity + 1) {
+		munmap(map, map_size);
+		close(fd);
+		return NULL;
+	}
+
+	ringbuffer_t *rb = (ringbuffer_t*)malloc(sizeof(ringbuffer_t));
+	if (!rb) {
+		munmap(map, map_size);
+		close(fd);
+		return NULL;
+	}
+
+	// 恢复上次提交的读写位置
+	rb->rb_capacity	= capacity;
+	rb->rb_pr		= hdr->pr;
+	rb->rb_pw		= hdr->pw;
+	rb->rb_buf		= (char*)map + hdr_size;
+	rb->rb_hdr		= hdr;
+	rb->rb_map_size	= map_size;
+	rb->rb_fd		= fd;
+	rb->rb_sync_policy		= RB_SYNC_NONE;
+	rb->rb_sync_interval_ms	= 0;
+	rb->rb_last_sync_ms		= rb_now_ms();
+
+	return rb;
+}
+
+static inline void rb_close(ringbuffer_t *rb) {
+	assert(rb->rb_hdr != NULL);
+
+	rb->rb_hdr->pr = rb->rb_pr;
+	rb->rb_hdr->pw = rb->rb_pw;
+	msync(rb->rb_hdr, rb->rb_map_size, MS_SYNC);
+	munmap(rb->rb_hdr, rb->rb_map_size);
+	close(rb->rb_fd);
+	free(rb);
+}
+
+static inline void rb_set_sync_policy(ringbuffer_t *rb, int policy, uint32_t interval_ms) {
+	rb->rb_sync_policy		= policy;
+	rb->rb_sync_interval_ms	= interval_ms;
+}
+
+static inline int rb_sync(ringbuffer_t *rb) {
+	if (!rb->rb_hdr) return 0;
+
+	// 先落盘数据，再落盘文件头，保证文件头中的读写位置不会领先于数据
+	if (msync(rb->rb_hdr, rb->rb_map_size, MS_SYNC) < 0) {
+		return -1;
+	}
+	rb->rb_hdr->pr = rb->rb_pr;
+	rb->rb_hdr->pw = rb->rb_pw;
+	rb->rb_last_sync_ms = rb_now_ms();
+	return msync(rb->rb_hdr, rb_header_size(), MS_SYNC);
+}
+
+static inline void rb_commit(ringbuffer_t *rb) {
+	if (!rb->rb_hdr) return;
+
+	switch (rb->rb_sync_policy) {
+	case RB_SYNC_COMMIT:
+		rb_sync(rb);
+		break;
+	case RB_SYNC_PERIODIC:
+		if (rb_now_ms() - rb->rb_last_sync_ms >= rb->rb_sync_interval_ms) {
+			rb_sync(rb);
+			break;
+		}
+		// fall through
+	default:
+		// 数据写完后才更新文件头，进程崩溃时文件头中的位置总是对应完整的数据
+		__asm__ __volatile__("" ::: "memory");
+		rb->rb_hdr->pr = rb->rb_pr;
+		rb->rb_hdr->pw = rb->rb_pw;
+		break;
+	}
+}
+
+static inline void rb_reset(ringbuffer_t *rb) {
 	rb->rb_pr = rb->rb_pw = 0;
+	rb_commit(rb);
 }
 
-size_t rb_get_capacity(const ringbuffer_t *rb) {
+static inline size_t rb_get_capacity(const ringbuffer_t *rb) {
 	return rb->rb_capacity;
 }
 
-size_t rb_get_size(const ringbuffer_t *rb) {
+static inline size_t rb_get_size(const ringbuffer_t *rb) {
 	if (rb->rb_pr <= rb->rb_pw) {
 		return rb->rb_pw - rb->rb_pr;
 	} else {
@@ -80,11 +283,11 @@ size_t rb_get_size(const ringbuffer_t *rb) {
 	}
 }
 
-size_t rb_get_free_size(const ringbuffer_t *rb) {
+static inline size_t rb_get_free_size(const ringbuffer_t *rb) {
 	return rb_get_capacity(rb) - rb_get_size(rb);
 }
 
-size_t rb_read(ringbuffer_t *rb, void *output, size_t n) {
+static inline size_t rb_read(ringbuffer_t *rb, void *output, size_t n) {
 	assert(rb != NULL);
 	assert(output != NULL);
 
@@ -102,11 +305,12 @@ size_t rb_read(ringbuffer_t *rb, void *output, size_t n) {
 		memcpy(output + m, rb->rb_buf, n-m);
 		rb->rb_pr = n-m;
 	}
+	rb_commit(rb);
 
 	return n;
 }
 
-size_t rb_write(ringbuffer_t *rb, void *input, size_t n) {
+static inline size_t rb_write(ringbuffer_t *rb, void *input, size_t n) {
 	assert(rb != NULL);
 	assert(input != NULL);
 
@@ -124,11 +328,12 @@ size_t rb_write(ringbuffer_t *rb, void *input, size_t n) {
 		memcpy(rb->rb_buf, input + m, n-m);
 		rb->rb_pw = n-m;
 	}
+	rb_commit(rb);
 
 	return n;
 }
 
-void rb_remove_newest(ringbuffer_t *rb, size_t n) {
+static inline void rb_remove_newest(ringbuffer_t *rb, size_t n) {
 	if (rb_get_size(rb) <= n) {
 		rb_reset(rb);
 		return;
@@ -138,9 +343,10 @@ void rb_remove_newest(ringbuffer_t *rb, size_t n) {
 	} else {
 		rb->rb_pw = rb->rb_capacity + 1 - n + rb->rb_pw;
 	}
+	rb_commit(rb);
 }
 
-void rb_remove_oldest(ringbuffer_t *rb, size_t n) {
+static inline void rb_remove_oldest(ringbuffer_t *rb, size_t n) {
 	if (rb_get_size(rb) <= n) {
 		rb_reset(rb);
 		return;
@@ -150,6 +356,7 @@ void rb_remove_oldest(ringbuffer_t *rb, size_t n) {
 	} else {
 		rb->rb_pr = n - rb->rb_capacity - 1 + rb->rb_pr;
 	}
+	rb_commit(rb);
 }
 
 
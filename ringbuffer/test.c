@@ -1,5 +1,9 @@
 #include <stdio.h>
+#include <sys/wait.h>
+#include <pthread.h>
 #include "ringbuffer.h"
+#include "rb_record.h"
+#include "rb_lossy.h"
 
 void test1() {
 	puts("begin test1");
@@ -80,10 +84,257 @@ void test2() {
 	puts("test2 success");
 }
 
+void test3() {
+	puts("begin test3");
+
+	ringbuffer_t *r = rb_malloc(20);
+	const void *data;
+	size_t n;
+	char p[20];
+
+	if (rb_peek_record(r, &data, &n) || rb_pop_record(r, p, sizeof(p))) {
+		exit(-1);
+	}
+
+	// 4+5, 4+6 共19字节
+	if (rb_push_record(r, "hello", 5) != 5 || rb_push_record(r, "world!", 6) != 6) {
+		exit(-1);
+	}
+	if (rb_push_record(r, "x", 1) != 0) {
+		exit(-1);
+	}
+
+	if (!rb_peek_record(r, &data, &n) || n != 5 || strncmp(data, "hello", 5)) {
+		exit(-1);
+	}
+	if (rb_pop_record(r, p, sizeof(p)) != 5 || strncmp(p, "hello", 5)) {
+		exit(-1);
+	}
+
+	// 尾部只剩2字节，放不下长度头，回绕到开头
+	if (rb_push_record(r, "abc", 3) != 3) {
+		exit(-1);
+	}
+	if (rb_pop_record(r, p, sizeof(p)) != 6 || strncmp(p, "world!", 6)) {
+		exit(-1);
+	}
+	if (!rb_peek_record(r, &data, &n) || n != 3 || strncmp(data, "abc", 3)) {
+		exit(-1);
+	}
+
+	// 读空后重置到开头
+	if (rb_pop_record(r, p, sizeof(p)) != 3 || rb_get_size(r) != 0) {
+		exit(-1);
+	}
+
+	// 尾部能放下长度头但放不下记录，写入跳过标记后回绕
+	if (rb_push_record(r, "01234", 5) != 5 || rb_push_record(r, "zzz", 3) != 3) {
+		exit(-1);
+	}
+	rb_pop_record(r, NULL, 0);
+	if (rb_push_record(r, "abcdef", 6) != 0 || rb_push_record(r, "abc", 3) != 3) {
+		exit(-1);
+	}
+	if (rb_pop_record(r, p, sizeof(p)) != 3 || strncmp(p, "zzz", 3)) {
+		exit(-1);
+	}
+	if (!rb_peek_record(r, &data, &n) || n != 3 || strncmp(data, "abc", 3)) {
+		exit(-1);
+	}
+	if (rb_pop_record(r, p, 1) != 0 || rb_pop_record(r, p, sizeof(p)) != 3) {
+		exit(-1);
+	}
+	if (rb_get_size(r) != 0 || rb_peek_record(r, &data, &n)) {
+		exit(-1);
+	}
+
+	rb_free(r);
+
+	// 随机读写，和简单的FIFO对比
+	r = rb_malloc(101);
+	char fifo[64][32];
+	size_t fifo_len[64];
+	int head = 0, tail = 0, i, j;
+	srand(1);
+	for (i = 0; i < 100000; ++i) {
+		if (rand() % 2 && tail - head < 64) {
+			size_t len = rand() % 31 + 1;
+			for (j = 0; j < (int)len; ++j) {
+				fifo[tail % 64][j] = (char)rand();
+			}
+			if (rb_push_record(r, fifo[tail % 64], len) == len) {
+				fifo_len[tail % 64] = len;
+				tail++;
+			}
+		} else if (head < tail) {
+			if (!rb_peek_record(r, &data, &n) || n != fifo_len[head % 64] || memcmp(data, fifo[head % 64], n)) {
+				exit(-1);
+			}
+			rb_pop_record(r, NULL, 0);
+			head++;
+		} else if (rb_peek_record(r, &data, &n)) {
+			exit(-1);
+		}
+	}
+	rb_free(r);
+
+	puts("test3 success");
+}
+
+void test4() {
+	puts("begin test4");
+
+	const char *path = "/tmp/rb_test4.dat";
+	char p[16];
+	unlink(path);
+
+	ringbuffer_t *r = rb_open(path, 16);
+	if (!r || rb_get_size(r) != 0 || rb_get_capacity(r) != 16) {
+		exit(-1);
+	}
+	rb_set_sync_policy(r, RB_SYNC_COMMIT, 0);
+	rb_write(r, "hello,world", 11);
+	rb_read(r, p, 6);
+	rb_close(r);
+
+	// 重新打开后恢复未读取的数据
+	r = rb_open(path, 16);
+	if (!r || rb_get_size(r) != 5) {
+		exit(-1);
+	}
+	rb_free(r);
+
+	// 子进程写入后不关闭直接退出，模拟进程崩溃
+	if (0 == fork()) {
+		r = rb_open(path, 16);
+		rb_write(r, "!!", 2);
+		_exit(0);
+	}
+	wait(NULL);
+
+	if (rb_open(path, 32) != NULL) {
+		exit(-1);
+	}
+
+	r = rb_open(path, 16);
+	if (!r || rb_get_size(r) != 7) {
+		exit(-1);
+	}
+	size_t n = rb_read(r, p, 7);
+	if (n != 7 || strncmp(p, "world!!", 7)) {
+		exit(-1);
+	}
+	rb_free(r);
+	unlink(path);
+
+	// 创建时ftruncate之后、写文件头之前崩溃：大小正确、内容全为0，按新文件处理
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0 || ftruncate(fd, rb_header_size() + 16 + 1) < 0) {
+		exit(-1);
+	}
+	close(fd);
+	r = rb_open(path, 16);
+	if (!r || rb_get_size(r) != 0) {
+		exit(-1);
+	}
+	rb_write(r, "abc", 3);
+	rb_close(r);
+	r = rb_open(path, 16);
+	if (!r || rb_get_size(r) != 3) {
+		exit(-1);
+	}
+	rb_free(r);
+
+	// 文件头不全为0但是损坏，仍然拒绝
+	fd = open(path, O_RDWR);
+	if (fd < 0 || pwrite(fd, "x", 1, 0) != 1) {
+		exit(-1);
+	}
+	close(fd);
+	if (rb_open(path, 16) != NULL) {
+		exit(-1);
+	}
+	unlink(path);
+
+	puts("test4 success");
+}
+
+static volatile int test5_stop = 0;
+
+static void *test5_writer(void *arg) {
+	rb_lossy_t *r = (rb_lossy_t*)arg;
+	unsigned char buf[37];
+	unsigned char c = 0;
+	int i;
+	while (!test5_stop) {
+		for (i = 0; i < (int)sizeof(buf); ++i) {
+			buf[i] = c++;
+		}
+		rb_lossy_write(r, buf, sizeof(buf));
+	}
+	return NULL;
+}
+
+void test5() {
+	puts("begin test5");
+
+	rb_lossy_t *r = rb_lossy_malloc(6);
+	char p[16];
+	uint64_t pos = 0;
+	if (rb_lossy_get_capacity(r) != 8 || rb_lossy_read_latest(r, p, 8) != 0) {
+		exit(-1);
+	}
+
+	rb_lossy_write(r, "hello", 5);
+	if (rb_lossy_read_latest(r, p, 8) != 5 || strncmp(p, "hello", 5)) {
+		exit(-1);
+	}
+	if (rb_lossy_read_from(r, &pos, p, 3) != 3 || pos != 3 || strncmp(p, "hel", 3)) {
+		exit(-1);
+	}
+
+	// 覆盖最旧的数据
+	rb_lossy_write(r, ",world", 6);
+	if (rb_lossy_read_latest(r, p, 16) != 8 || strncmp(p, "lo,world", 8)) {
+		exit(-1);
+	}
+	if (rb_lossy_read_from(r, &pos, p, 16) != 8 || pos != 11 || strncmp(p, "lo,world", 8)) {
+		exit(-1);
+	}
+	rb_lossy_write(r, "0123456789", 10);
+	if (rb_lossy_read_latest(r, p, 4) != 4 || strncmp(p, "6789", 4) || rb_lossy_get_position(r) != 21) {
+		exit(-1);
+	}
+	rb_lossy_free(r);
+
+	// 并发读写，读到的数据必须是连续写入的
+	pthread_t t;
+	unsigned char q[200];
+	int i, j;
+	r = rb_lossy_malloc(256);
+	pthread_create(&t, NULL, test5_writer, r);
+	for (i = 0; i < 100000; ++i) {
+		size_t n = rb_lossy_read_latest(r, q, sizeof(q));
+		for (j = 1; j < (int)n; ++j) {
+			if ((unsigned char)(q[j-1] + 1) != q[j]) {
+				exit(-1);
+			}
+		}
+	}
+	test5_stop = 1;
+	pthread_join(t, NULL);
+	rb_lossy_free(r);
+
+	puts("test5 success");
+}
+
 int main() {
 	
 	test1();
 	test2();
+	test3();
+	test4();
+	test5();
 
 	return 0;
 }
\ No newline at end of file
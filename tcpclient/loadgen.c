@@ -0,0 +1,646 @@
+// 压测工具：N个连接向服务端发送固定大小的请求，每个回应也是固定大小，统计延迟分布和每秒吞吐
+// 编译：gcc -O2 -o loadgen loadgen.c tcp_loop.c tcp_writer.c tcpclient.c -pthread
+//
+// 闭环（默认）：每个连接保持depth个请求，收到回应后立即发出下一个，延迟从实际发出时计算
+// 开环（-r）：按固定速率发出请求，不管之前的请求是否已经回应；延迟从计划发出的时间计算，
+//            服务端变慢时排队等待的时间也计入延迟（coordinated omission修正）
+// 阻塞（-b）：每个连接一个线程，用tcp_write + tcp_read闭环请求，测量阻塞接口本身
+//
+// 配合server.cpp：
+//   ./server -s &
+//   ./loadgen -c 100 -d 10						// echo，闭环，每个连接1个请求
+//   ./loadgen -c 100 -r 50000 -d 10			// 开环，总共每秒5万个请求
+//   ./server -m reply -q 64 -r 1024 -s &
+//   ./loadgen -s 64 -S 1024 -n 8 -j > result.json
+//
+// 开环模式用tcp_loop的定时器发送，精度为1ms，下一毫秒内到期的请求提前一起发出，
+// 请求的发送时间有最多1ms的误差，测量回环上微秒级的延迟时闭环更准确
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "tcpclient.h"
+#include "tcp_loop.h"
+#include "tcp_writer.h"
+
+// ----------------------------------------------------------------
+// HDR直方图：小于2048ns的值每个纳秒一格，之后每个2的幂区间分为1024格，
+// 相对误差不超过0.1%，最大约137秒，超过的记入最后一格
+
+#define HDR_SUB_BITS		11
+#define HDR_HALF			(1 << (HDR_SUB_BITS - 1))
+#define HDR_MAX_SHIFT		26
+#define HDR_BUCKETS			((HDR_MAX_SHIFT + 2) * HDR_HALF)
+
+typedef struct {
+	uint64_t counts[HDR_BUCKETS];
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	double sum;
+} hdr_hist;
+
+static int hdr_index(uint64_t v) {
+	int shift;
+
+	if (v < (1 << HDR_SUB_BITS)) {
+		return (int)v;
+	}
+	shift = 63 - __builtin_clzll(v) - HDR_SUB_BITS + 1;
+	if (shift > HDR_MAX_SHIFT) {
+		return HDR_BUCKETS - 1;
+	}
+	return shift * HDR_HALF + (int)(v >> shift);
+}
+
+// 格子中最大的值
+static uint64_t hdr_value(int index) {
+	int shift, sub;
+
+	if (index < (1 << HDR_SUB_BITS)) {
+		return (uint64_t)index;
+	}
+	shift = index / HDR_HALF - 1;
+	sub = index - shift * HDR_HALF;
+	return ((uint64_t)(sub + 1) << shift) - 1;
+}
+
+static void hdr_reset(hdr_hist *h) {
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+static void hdr_record(hdr_hist *h, uint64_t v) {
+	h->counts[hdr_index(v)]++;
+	h->total++;
+	h->sum += (double)v;
+	if (v < h->min) h->min = v;
+	if (v > h->max) h->max = v;
+}
+
+static void hdr_merge(hdr_hist *dst, const hdr_hist *src) {
+	int i;
+
+	if (0 == src->total) {
+		return;
+	}
+	for (i = 0; i < HDR_BUCKETS; ++i) {
+		dst->counts[i] += src->counts[i];
+	}
+	dst->total += src->total;
+	dst->sum += src->sum;
+	if (src->min < dst->min) dst->min = src->min;
+	if (src->max > dst->max) dst->max = src->max;
+}
+
+static uint64_t hdr_percentile(const hdr_hist *h, double p) {
+	uint64_t target, seen = 0;
+	int i;
+
+	if (0 == h->total) {
+		return 0;
+	}
+	target = (uint64_t)(p / 100.0 * h->total + 0.5);
+	if (target < 1) target = 1;
+	for (i = 0; i < HDR_BUCKETS; ++i) {
+		seen += h->counts[i];
+		if (seen >= target) {
+			uint64_t v = hdr_value(i);
+			return v > h->max ? h->max : v;
+		}
+	}
+	return h->max;
+}
+
+// ----------------------------------------------------------------
+// 配置和结果
+
+static const char *opt_host = "127.0.0.1";
+static uint16_t opt_port = 8989;
+static int opt_conns = 100;
+static int opt_duration = 10;
+static double opt_rate = 0;
+static int opt_depth = 0;
+static uint32_t opt_req_size = 64;
+static uint32_t opt_resp_size = 0;
+static int opt_interval = 1;
+static int opt_blocking = 0;
+static int opt_json = 0;
+
+typedef struct {
+	double t;
+	uint64_t count;
+	uint64_t p50, p99, max;
+} lg_sample;
+
+static hdr_hist g_total;
+static hdr_hist g_interval;
+static uint64_t g_errors;
+static uint64_t g_unfinished;	// 开环：结束时还没有回应的请求，也计入g_total
+static lg_sample *g_samples;
+static int g_nsamples;
+static uint8_t *g_req;
+
+// 人类可读的输出在JSON模式下写到stderr，stdout只有JSON
+static FILE *g_out;
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static const char* fmt_ns(char *buf, uint64_t ns) {
+	if (ns < 1000) {
+		sprintf(buf, "%lluns", (unsigned long long)ns);
+	} else if (ns < 1000000) {
+		sprintf(buf, "%.1fus", ns / 1e3);
+	} else if (ns < 1000000000) {
+		sprintf(buf, "%.2fms", ns / 1e6);
+	} else {
+		sprintf(buf, "%.2fs", ns / 1e9);
+	}
+	return buf;
+}
+
+// 每个统计周期结束时调用，interval为这个周期的直方图
+static void lg_sample_interval(double t, double sec) {
+	char a[32], b[32], c[32];
+	lg_sample *s;
+
+	g_samples = (lg_sample*)realloc(g_samples, sizeof(lg_sample) * (g_nsamples + 1));
+	s = &g_samples[g_nsamples++];
+	s->t = t;
+	s->count = g_interval.total;
+	s->p50 = hdr_percentile(&g_interval, 50);
+	s->p99 = hdr_percentile(&g_interval, 99);
+	s->max = g_interval.max;
+
+	fprintf(g_out, "%6.1fs %12.0f req/s   p50 %10s   p99 %10s   max %10s\n", t, s->count / sec,
+		fmt_ns(a, s->p50), fmt_ns(b, s->p99), fmt_ns(c, s->max));
+	fflush(g_out);
+	hdr_merge(&g_total, &g_interval);
+	hdr_reset(&g_interval);
+}
+
+// ----------------------------------------------------------------
+// 事件循环模式
+
+typedef struct {
+	tcp_conn conn;
+	tcp_writer *w;
+	int alive;
+	int connected;
+	uint64_t *starts;		// 已发出请求的开始时间（开环时为计划时间），环形队列
+	uint32_t head;
+	uint32_t count;
+	uint32_t resp_bytes;	// 当前回应已经收到的字节数
+	uint64_t next_ns;		// 开环：下一个请求的计划时间
+} lg_conn;
+
+// 开环发送的时间粒度，和tcp_loop定时器的精度一致
+#define LG_TICK_NS			1000000ull
+
+static tcp_loop *g_loop;
+static lg_conn *g_conns;
+static uint32_t g_cap;			// 每个连接同时进行的请求数上限
+static uint64_t g_gap_ns;		// 开环：每个连接两个请求之间的间隔
+static int g_pending_connects;
+static int g_alive;
+static int g_started;
+
+static void lg_close(lg_conn *c) {
+	if (!c->alive) {
+		return;
+	}
+	if (!c->connected) {
+		g_pending_connects--;
+	}
+	c->alive = 0;
+	g_alive--;
+	tcp_loop_remove(g_loop, &c->conn);
+	tcp_close(&c->conn.sock);
+}
+
+static void lg_send(lg_conn *c, uint64_t start) {
+	// writer的容量足够放下g_cap个请求，不会只接受一部分
+	tcp_writer_write(c->w, g_req, opt_req_size);
+	c->starts[(c->head + c->count) % g_cap] = start;
+	c->count++;
+}
+
+static void lg_flush(lg_conn *c) {
+	int32_t r = tcp_writer_flush(c->w);
+	if (r < 0) {
+		g_errors++;
+		lg_close(c);
+		return;
+	}
+	tcp_loop_want_write(g_loop, &c->conn, 0 == r);
+}
+
+// 发出所有已经到期的请求，并把定时器设置到下一个请求的计划时间
+static void lg_schedule(lg_conn *c) {
+	uint64_t now = now_ns();
+	int sent = 0;
+
+	if (0 == opt_rate) {
+		while (c->count < g_cap) {
+			lg_send(c, now);
+			sent = 1;
+		}
+	} else {
+		// 定时器精度为1ms，下一毫秒内到期的请求提前一起发出，提前发出的从实际发出时计算延迟
+		while (c->next_ns <= now + LG_TICK_NS && c->count < g_cap) {
+			lg_send(c, c->next_ns > now ? now : c->next_ns);
+			c->next_ns += g_gap_ns;
+			sent = 1;
+		}
+		// 请求数达到上限时不设置定时器，收到回应后再继续；到期的请求延迟发出，仍然按计划时间计算延迟
+		if (c->count < g_cap) {
+			uint64_t wait = c->next_ns - LG_TICK_NS - now;
+			tcp_loop_set_timer(g_loop, &c->conn, (uint32_t)((wait + 999999) / 1000000));
+		}
+	}
+	if (sent) {
+		lg_flush(c);
+	}
+}
+
+static void lg_read(lg_conn *c) {
+	uint8_t buf[64 * 1024];
+	int32_t n;
+
+	while ((n = tcp_nb_read(&c->conn.sock, buf, sizeof(buf))) > 0) {
+		uint64_t now = now_ns();
+		c->resp_bytes += n;
+		while (c->resp_bytes >= opt_resp_size) {
+			c->resp_bytes -= opt_resp_size;
+			if (0 == c->count) {
+				// 收到的数据比请求多，服务端的回应大小和-S不一致
+				g_errors++;
+				lg_close(c);
+				return;
+			}
+			hdr_record(&g_interval, now - c->starts[c->head]);
+			c->head = (c->head + 1) % g_cap;
+			c->count--;
+		}
+	}
+	if (n < 0) {
+		g_errors++;
+		lg_close(c);
+		return;
+	}
+	lg_schedule(c);
+}
+
+static void lg_event(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	lg_conn *c = (lg_conn*)conn->udata;
+
+	(void)loop;
+	if (events & (TCP_EV_ERROR | (c->connected ? 0 : TCP_EV_TIMEOUT))) {
+		g_errors++;
+		lg_close(c);
+		return;
+	}
+	if (events & TCP_EV_CONNECTED) {
+		c->connected = 1;
+		g_pending_connects--;
+	}
+	if (!g_started) {
+		return;
+	}
+	if (events & TCP_EV_READ) {
+		lg_read(c);
+	}
+	if (c->alive && (events & TCP_EV_WRITE)) {
+		lg_flush(c);
+	}
+	if (c->alive && (events & TCP_EV_TIMEOUT)) {
+		lg_schedule(c);
+	}
+}
+
+// 开环：结束时已经发出但没有回应、以及达到请求数上限而没有发出的请求，延迟至少是end - 计划时间，
+// 不计入的话服务端卡住时这些最慢的请求会从统计中消失
+static void lg_record_unfinished(uint64_t end) {
+	uint64_t planned;
+	uint32_t k;
+	int i;
+
+	for (i = 0; i < opt_conns; ++i) {
+		lg_conn *c = &g_conns[i];
+		if (!c->alive) {
+			continue;
+		}
+		for (k = 0; k < c->count; ++k) {
+			planned = c->starts[(c->head + k) % g_cap];
+			hdr_record(&g_total, end > planned ? end - planned : 0);
+			g_unfinished++;
+		}
+		for (planned = c->next_ns; planned < end; planned += g_gap_ns) {
+			hdr_record(&g_total, end - planned);
+			g_unfinished++;
+		}
+	}
+}
+
+static double run_loop() {
+	uint64_t start, end, next_report, last_report;
+	int i;
+
+	g_cap = opt_depth;
+	g_loop = tcp_loop_create(opt_conns);
+	g_conns = (lg_conn*)calloc(opt_conns, sizeof(lg_conn));
+	if (!g_loop || !g_conns) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < opt_conns; ++i) {
+		lg_conn *c = &g_conns[i];
+		c->starts = (uint64_t*)malloc(sizeof(uint64_t) * g_cap);
+		c->w = tcp_writer_create(&c->conn.sock, (size_t)g_cap * opt_req_size + 4096, 0);
+		if (!c->starts || !c->w || tcp_loop_connect(g_loop, &c->conn, opt_host, opt_port, 3000, lg_event, c) < 0) {
+			fprintf(stderr, "connect failed\n");
+			exit(1);
+		}
+		c->alive = 1;
+		g_alive++;
+		g_pending_connects++;
+	}
+	while (g_pending_connects > 0) {
+		tcp_loop_run_once(g_loop, 100);
+	}
+	if (0 == g_alive) {
+		fprintf(stderr, "no connection to %s:%u\n", opt_host, opt_port);
+		exit(1);
+	}
+
+	// 开环时各个连接的发送时间错开
+	start = now_ns();
+	g_started = 1;
+	for (i = 0; i < opt_conns; ++i) {
+		lg_conn *c = &g_conns[i];
+		if (c->alive) {
+			c->next_ns = start + g_gap_ns * i / opt_conns;
+			lg_schedule(c);
+		}
+	}
+
+	end = start + (uint64_t)opt_duration * 1000000000ull;
+	last_report = start;
+	next_report = start + (uint64_t)opt_interval * 1000000000ull;
+	while (g_alive > 0) {
+		uint64_t now = now_ns();
+		if (now >= next_report) {
+			lg_sample_interval((now - start) / 1e9, (now - last_report) / 1e9);
+			last_report = now;
+			next_report += (uint64_t)opt_interval * 1000000000ull;
+		}
+		if (now >= end) {
+			break;
+		}
+		tcp_loop_run_once(g_loop, (int)(((next_report < end ? next_report : end) - now) / 1000000) + 1);
+	}
+	end = now_ns();
+	if (g_interval.total > 0) {
+		lg_sample_interval((end - start) / 1e9, (end - last_report) / 1e9);
+	}
+	if (opt_rate > 0) {
+		lg_record_unfinished(end);
+	}
+
+	for (i = 0; i < opt_conns; ++i) {
+		lg_close(&g_conns[i]);
+		tcp_writer_destroy(g_conns[i].w);
+		free(g_conns[i].starts);
+	}
+	free(g_conns);
+	tcp_loop_destroy(g_loop);
+	return (end - start) / 1e9;
+}
+
+// ----------------------------------------------------------------
+// 阻塞模式：每个连接一个线程
+
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile int g_stop;
+
+static void* blocking_worker(void *arg) {
+	tcp_socket sock;
+	uint8_t *buf = (uint8_t*)malloc(opt_resp_size);
+	int32_t n;
+	uint32_t got, off;
+
+	(void)arg;
+	if (tcp_connect(&sock, (uint8_t*)opt_host, opt_port, 3000) < 0) {
+		tcp_close(&sock);
+		free(buf);
+		pthread_mutex_lock(&g_mutex);
+		g_errors++;
+		pthread_mutex_unlock(&g_mutex);
+		return NULL;
+	}
+
+	while (!g_stop) {
+		uint64_t t0 = now_ns();
+		for (off = 0; off < opt_req_size; off += n) {
+			n = tcp_write(&sock, g_req + off, opt_req_size - off, 1000);
+			if (n <= 0) goto fail;
+		}
+		for (got = 0; got < opt_resp_size; got += n) {
+			n = tcp_read(&sock, buf + got, opt_resp_size - got, 1000);
+			if (n <= 0) goto fail;
+		}
+		uint64_t t1 = now_ns();
+		pthread_mutex_lock(&g_mutex);
+		hdr_record(&g_interval, t1 - t0);
+		pthread_mutex_unlock(&g_mutex);
+	}
+	tcp_close(&sock);
+	free(buf);
+	return NULL;
+
+fail:
+	pthread_mutex_lock(&g_mutex);
+	if (!g_stop) g_errors++;
+	pthread_mutex_unlock(&g_mutex);
+	tcp_close(&sock);
+	free(buf);
+	return NULL;
+}
+
+static double run_blocking() {
+	pthread_t *tids = (pthread_t*)malloc(sizeof(pthread_t) * opt_conns);
+	uint64_t start, end, last_report, now;
+	int i;
+
+	start = now_ns();
+	for (i = 0; i < opt_conns; ++i) {
+		if (pthread_create(&tids[i], NULL, blocking_worker, NULL) != 0) {
+			fprintf(stderr, "pthread_create failed\n");
+			exit(1);
+		}
+	}
+
+	end = start + (uint64_t)opt_duration * 1000000000ull;
+	last_report = start;
+	for (;;) {
+		uint64_t next = last_report + (uint64_t)opt_interval * 1000000000ull;
+		if (next > end) next = end;
+		now = now_ns();
+		if (next > now) {
+			usleep((useconds_t)((next - now) / 1000));
+		}
+		now = now_ns();
+		pthread_mutex_lock(&g_mutex);
+		lg_sample_interval((now - start) / 1e9, (now - last_report) / 1e9);
+		pthread_mutex_unlock(&g_mutex);
+		last_report = now;
+		if (now >= end) {
+			break;
+		}
+	}
+	g_stop = 1;
+	for (i = 0; i < opt_conns; ++i) {
+		pthread_join(tids[i], NULL);
+	}
+	// 停止之后完成的请求不计入
+	hdr_reset(&g_interval);
+	free(tids);
+	return (now - start) / 1e9;
+}
+
+// ----------------------------------------------------------------
+
+static void print_human(double sec) {
+	static const double ps[] = { 50, 90, 99, 99.9 };
+	char a[32];
+	int i;
+
+	fprintf(g_out, "\n%llu requests in %.2fs, %.0f req/s, %llu errors", (unsigned long long)(g_total.total - g_unfinished), sec,
+		(g_total.total - g_unfinished) / sec, (unsigned long long)g_errors);
+	if (g_unfinished > 0) {
+		fprintf(g_out, ", %llu unfinished (counted in latency)", (unsigned long long)g_unfinished);
+	}
+	fprintf(g_out, "\n");
+	if (0 == g_total.total) {
+		return;
+	}
+	fprintf(g_out, "latency  min %s", fmt_ns(a, g_total.min));
+	fprintf(g_out, "  mean %s", fmt_ns(a, (uint64_t)(g_total.sum / g_total.total)));
+	for (i = 0; i < 4; ++i) {
+		fprintf(g_out, "  p%g %s", ps[i], fmt_ns(a, hdr_percentile(&g_total, ps[i])));
+	}
+	fprintf(g_out, "  max %s\n", fmt_ns(a, g_total.max));
+}
+
+static void print_json(double sec) {
+	int i;
+
+	printf("{\n");
+	printf("  \"config\": {\"host\": \"%s\", \"port\": %u, \"connections\": %d, \"mode\": \"%s\", "
+		"\"rate\": %.0f, \"depth\": %d, \"request_size\": %u, \"response_size\": %u, \"duration\": %d},\n",
+		opt_host, opt_port, opt_conns, opt_blocking ? "blocking" : (opt_rate > 0 ? "open" : "closed"),
+		opt_rate, opt_blocking ? 1 : opt_depth, opt_req_size, opt_resp_size, opt_duration);
+	printf("  \"requests\": %llu,\n", (unsigned long long)(g_total.total - g_unfinished));
+	printf("  \"unfinished\": %llu,\n", (unsigned long long)g_unfinished);
+	printf("  \"errors\": %llu,\n", (unsigned long long)g_errors);
+	printf("  \"seconds\": %.3f,\n", sec);
+	printf("  \"throughput\": %.1f,\n", (g_total.total - g_unfinished) / sec);
+	printf("  \"latency_us\": {\"min\": %.1f, \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p99.9\": %.1f, \"max\": %.1f},\n",
+		g_total.total ? g_total.min / 1e3 : 0.0, g_total.total ? g_total.sum / g_total.total / 1e3 : 0.0,
+		hdr_percentile(&g_total, 50) / 1e3, hdr_percentile(&g_total, 90) / 1e3, hdr_percentile(&g_total, 99) / 1e3,
+		hdr_percentile(&g_total, 99.9) / 1e3, g_total.max / 1e3);
+	printf("  \"timeline\": [");
+	for (i = 0; i < g_nsamples; ++i) {
+		const lg_sample *s = &g_samples[i];
+		double len = s->t - (i > 0 ? g_samples[i - 1].t : 0);
+		printf("%s\n    {\"t\": %.3f, \"requests\": %llu, \"throughput\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}",
+			i > 0 ? "," : "", s->t, (unsigned long long)s->count, len > 0 ? s->count / len : 0.0,
+			s->p50 / 1e3, s->p99 / 1e3, s->max / 1e3);
+	}
+	printf("\n  ]\n}\n");
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr,
+		"usage: %s [-h host] [-p port] [-c conns] [-d seconds] [-r rate] [-n depth] [-s req_size] [-S resp_size] [-i interval] [-b] [-j]\n"
+		"  -h  server address, default 127.0.0.1\n"
+		"  -p  server port, default 8989\n"
+		"  -c  connections, default 100\n"
+		"  -d  duration in seconds, default 10\n"
+		"  -r  open loop: total requests per second; default 0 (closed loop)\n"
+		"  -n  requests in flight per connection, default 1 (closed loop) or 1024 (open loop)\n"
+		"  -s  request size, default 64\n"
+		"  -S  response size, default same as request (echo)\n"
+		"  -i  report interval in seconds, default 1\n"
+		"  -b  blocking mode: one thread per connection using tcp_write/tcp_read\n"
+		"  -j  print JSON result to stdout\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+	double sec;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "h:p:c:d:r:n:s:S:i:bj")) != -1) {
+		switch (opt) {
+		case 'h': opt_host = optarg; break;
+		case 'p': opt_port = (uint16_t)atoi(optarg); break;
+		case 'c': opt_conns = atoi(optarg); break;
+		case 'd': opt_duration = atoi(optarg); break;
+		case 'r': opt_rate = atof(optarg); break;
+		case 'n': opt_depth = atoi(optarg); break;
+		case 's': opt_req_size = (uint32_t)atoi(optarg); break;
+		case 'S': opt_resp_size = (uint32_t)atoi(optarg); break;
+		case 'i': opt_interval = atoi(optarg); break;
+		case 'b': opt_blocking = 1; break;
+		case 'j': opt_json = 1; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (opt_conns <= 0 || opt_duration <= 0 || opt_interval <= 0 || 0 == opt_req_size || opt_rate < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (opt_blocking && (opt_rate > 0 || opt_depth > 1)) {
+		fprintf(stderr, "blocking mode is closed loop with one request per connection\n");
+		return 1;
+	}
+	if (0 == opt_resp_size) opt_resp_size = opt_req_size;
+	if (opt_depth <= 0) opt_depth = opt_rate > 0 ? 1024 : 1;
+	if (opt_rate > 0) {
+		g_gap_ns = (uint64_t)(1e9 * opt_conns / opt_rate);
+		if (0 == g_gap_ns) g_gap_ns = 1;
+	}
+
+	g_out = opt_json ? stderr : stdout;
+	g_req = (uint8_t*)malloc(opt_req_size);
+	memset(g_req, 'x', opt_req_size);
+	hdr_reset(&g_total);
+	hdr_reset(&g_interval);
+
+	fprintf(g_out, "%s:%u  %d connections  %s", opt_host, opt_port, opt_conns,
+		opt_blocking ? "blocking" : (opt_rate > 0 ? "open loop" : "closed loop"));
+	if (opt_rate > 0) fprintf(g_out, " %.0f req/s", opt_rate);
+	if (!opt_blocking) fprintf(g_out, "  depth %d", opt_depth);
+	fprintf(g_out, "  request %u bytes  response %u bytes  %ds\n\n", opt_req_size, opt_resp_size, opt_duration);
+
+	sec = opt_blocking ? run_blocking() : run_loop();
+
+	print_human(sec);
+	if (opt_json) {
+		print_json(sec);
+	}
+	free(g_samples);
+	free(g_req);
+	return 0;
+}
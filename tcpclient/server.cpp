@@ -0,0 +1,457 @@
+// 多核测试服务端，用来在本机压测客户端
+// 编译：g++ -O2 -std=c++11 -o server server.cpp -pthread
+//
+// 每个线程一个epoll（边缘触发）和一个监听socket，监听socket都设置SO_REUSEPORT绑定同一个端口，
+// 由内核把新连接分散到各个线程，线程之间不共享任何状态。连接保持到客户端关闭。
+//
+// 模式：
+//   echo   原样返回收到的数据（默认）
+//   reply  每收到req_size字节回复reply_size字节（req_size为0时每次读到数据回复一次）
+//   -d ms  回复延迟ms毫秒后发出，用来模拟后端处理时间，两种模式都可以用
+//
+// ./server -p 8989 -t 4 -m reply -q 64 -r 1024 -d 5
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum server_mode {
+	MODE_ECHO,
+	MODE_REPLY,
+};
+
+struct server_config {
+	uint16_t port = 8989;
+	int threads = 0;
+	server_mode mode = MODE_ECHO;
+	uint32_t req_size = 0;
+	uint32_t reply_size = 15;
+	uint32_t delay_ms = 0;
+	bool quiet = false;
+};
+
+// 没有发出的回复（发送缓冲区加上延迟队列中的）超过这个大小时暂停读取，客户端只写不读时不会无限占用内存
+static const size_t OUT_LIMIT = 4 * 1024 * 1024;
+
+static std::atomic<bool> g_stop(false);
+
+static uint64_t now_ms() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct connection {
+	int fd = -1;
+	uint32_t gen = 0;			// fd会被复用，延迟回复用gen判断是不是同一个连接
+	std::string out;
+	size_t out_off = 0;
+	uint32_t req_bytes = 0;		// reply模式下当前请求已经收到的字节数
+	size_t delayed = 0;			// 延迟队列中属于这个连接的字节数
+	bool paused = false;		// 没有发出的回复太多，暂停读取
+
+	size_t backlog() const {
+		return out.size() - out_off + delayed;
+	}
+};
+
+struct delayed_reply {
+	uint64_t due_ms;
+	int fd;
+	uint32_t gen;
+	std::string data;
+};
+
+class worker {
+public:
+	worker(const server_config &cfg, const std::string &reply): cfg_(cfg), reply_(reply) { }
+
+	~worker() {
+		for (auto c : conns_) {
+			if (c) {
+				close(c->fd);
+				delete c;
+			}
+		}
+		if (listen_fd_ >= 0) close(listen_fd_);
+		if (epfd_ >= 0) close(epfd_);
+	}
+
+	bool init() {
+		int on = 1;
+		struct sockaddr_in addr;
+
+		listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		if (listen_fd_ < 0) {
+			return false;
+		}
+		setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if (setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+			return false;
+		}
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(cfg_.port);
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		if (bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd_, 4096) < 0) {
+			return false;
+		}
+
+		epfd_ = epoll_create1(0);
+		if (epfd_ < 0) {
+			return false;
+		}
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.ptr = nullptr;		// nullptr表示监听socket
+		return epoll_ctl(epfd_, EPOLL_CTL_ADD, listen_fd_, &ev) == 0;
+	}
+
+	void run() {
+		std::vector<struct epoll_event> events(1024);
+
+		while (!g_stop.load(std::memory_order_relaxed)) {
+			int timeout = 100;
+			if (!delayed_.empty()) {
+				uint64_t now = now_ms();
+				timeout = delayed_.front().due_ms > now ? (int)(delayed_.front().due_ms - now) : 0;
+				if (timeout > 100) timeout = 100;
+			}
+
+			int n = epoll_wait(epfd_, events.data(), (int)events.size(), timeout);
+			for (int i = 0; i < n; ++i) {
+				connection *c = (connection*)events[i].data.ptr;
+				if (!c) {
+					on_accept();
+					continue;
+				}
+				// 同一批事件中前面的事件可能已经关闭了这个连接
+				if (c->fd < 0) {
+					continue;
+				}
+				if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+					close_conn(c);
+					continue;
+				}
+				if (events[i].events & EPOLLOUT) {
+					on_write(c);
+				}
+				if (c->fd >= 0 && (events[i].events & EPOLLIN)) {
+					on_read(c);
+				}
+			}
+			flush_delayed();
+			free_closed();
+		}
+	}
+
+	std::atomic<uint64_t> accepted{0};
+	std::atomic<uint64_t> active{0};
+	std::atomic<uint64_t> bytes_in{0};
+	std::atomic<uint64_t> bytes_out{0};
+
+private:
+	void on_accept() {
+		for (;;) {
+			int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK);
+			if (fd < 0) {
+				// EMFILE等错误也直接返回，边缘触发下剩余的连接会在下一个新连接到来时继续accept
+				return;
+			}
+			int on = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+			if ((size_t)fd >= conns_.size()) {
+				conns_.resize(fd + 1024, nullptr);
+			}
+			connection *c = new connection();
+			c->fd = fd;
+			c->gen = ++gen_;
+			conns_[fd] = c;
+
+			// 同时监听可读和可写，边缘触发下不需要再修改
+			struct epoll_event ev;
+			ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+			ev.data.ptr = c;
+			if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+				close_conn(c);
+				continue;
+			}
+			accepted.fetch_add(1, std::memory_order_relaxed);
+			active.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void on_read(connection *c) {
+		char buf[64 * 1024];
+
+		while (!c->paused) {
+			ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+			if (n == 0) {
+				close_conn(c);
+				return;
+			}
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				if (errno != EAGAIN && errno != EWOULDBLOCK) close_conn(c);
+				return;
+			}
+			bytes_in.fetch_add(n, std::memory_order_relaxed);
+
+			if (MODE_ECHO == cfg_.mode) {
+				respond(c, buf, (size_t)n);
+			} else if (0 == cfg_.req_size) {
+				respond(c, reply_.data(), reply_.size());
+			} else {
+				// 一次可能读到多个请求，也可能只读到半个
+				uint32_t count = 0;
+				c->req_bytes += (uint32_t)n;
+				while (c->req_bytes >= cfg_.req_size) {
+					c->req_bytes -= cfg_.req_size;
+					count++;
+				}
+				if (count > 0) {
+					std::string batch;
+					batch.reserve(reply_.size() * count);
+					for (uint32_t i = 0; i < count; ++i) batch += reply_;
+					respond(c, batch.data(), batch.size());
+				}
+			}
+			if (c->fd < 0) {
+				return;
+			}
+		}
+	}
+
+	void respond(connection *c, const char *data, size_t n) {
+		if (cfg_.delay_ms > 0) {
+			// 延迟固定，队列按到期时间有序，不需要堆
+			delayed_.push_back(delayed_reply{now_ms() + cfg_.delay_ms, c->fd, c->gen, std::string(data, n)});
+			c->delayed += n;
+			if (c->backlog() >= OUT_LIMIT) {
+				c->paused = true;
+			}
+			return;
+		}
+		send_data(c, data, n);
+	}
+
+	// 缓冲区为空时直接发送，避免一次拷贝
+	void send_data(connection *c, const char *data, size_t n) {
+		if (c->out.size() == c->out_off) {
+			ssize_t w = send(c->fd, data, n, MSG_NOSIGNAL);
+			if (w < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+					close_conn(c);
+					return;
+				}
+				w = 0;
+			}
+			bytes_out.fetch_add(w, std::memory_order_relaxed);
+			data += w;
+			n -= w;
+			if (0 == n) {
+				return;
+			}
+		}
+		c->out.append(data, n);
+		if (c->backlog() >= OUT_LIMIT) {
+			c->paused = true;
+		}
+	}
+
+	// 发送缓冲区清空、延迟队列也降到限制以下后恢复读取，边缘触发下需要主动读一次
+	void resume(connection *c) {
+		if (c->paused && c->out_off == c->out.size() && c->backlog() < OUT_LIMIT) {
+			c->paused = false;
+			on_read(c);
+		}
+	}
+
+	void on_write(connection *c) {
+		while (c->out_off < c->out.size()) {
+			ssize_t w = send(c->fd, c->out.data() + c->out_off, c->out.size() - c->out_off, MSG_NOSIGNAL);
+			if (w < 0) {
+				if (errno == EINTR) continue;
+				if (errno != EAGAIN && errno != EWOULDBLOCK) close_conn(c);
+				return;
+			}
+			bytes_out.fetch_add(w, std::memory_order_relaxed);
+			c->out_off += w;
+		}
+		c->out.clear();
+		c->out_off = 0;
+		resume(c);
+	}
+
+	void flush_delayed() {
+		uint64_t now = now_ms();
+		while (!delayed_.empty() && delayed_.front().due_ms <= now) {
+			// 先取出来，resume中的on_read会往队列中追加新的回复
+			delayed_reply d = std::move(delayed_.front());
+			delayed_.pop_front();
+			connection *c = (size_t)d.fd < conns_.size() ? conns_[d.fd] : nullptr;
+			if (c && c->fd >= 0 && c->gen == d.gen) {
+				c->delayed -= d.data.size();
+				send_data(c, d.data.data(), d.data.size());
+				if (c->fd >= 0) {
+					resume(c);
+				}
+			}
+		}
+	}
+
+	// 连接在事件处理中关闭，本轮事件处理完之后才释放
+	void close_conn(connection *c) {
+		if (c->fd < 0) {
+			return;
+		}
+		close(c->fd);
+		conns_[c->fd] = nullptr;
+		c->fd = -1;
+		closed_.push_back(c);
+		active.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	void free_closed() {
+		for (auto c : closed_) {
+			delete c;
+		}
+		closed_.clear();
+	}
+
+	const server_config &cfg_;
+	const std::string &reply_;
+	int listen_fd_ = -1;
+	int epfd_ = -1;
+	uint32_t gen_ = 0;
+	std::vector<connection*> conns_;		// 下标为fd
+	std::vector<connection*> closed_;
+	std::deque<delayed_reply> delayed_;
+};
+
+static void on_signal(int) {
+	g_stop = true;
+}
+
+// 把文件描述符上限调到硬上限，支持上万个连接
+static void raise_nofile() {
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr,
+		"usage: %s [-p port] [-t threads] [-m echo|reply] [-q req_size] [-r reply_size] [-d delay_ms] [-s]\n"
+		"  -p  listen port, default 8989\n"
+		"  -t  worker threads, default number of cores\n"
+		"  -m  echo: send back what is received; reply: send reply_size bytes per request\n"
+		"  -q  request size in reply mode, 0 means one reply per read, default 0\n"
+		"  -r  reply size in reply mode, default 15 (\"hellohellohello\")\n"
+		"  -d  delay every reply by delay_ms\n"
+		"  -s  do not print per-second stats\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+	server_config cfg;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:t:m:q:r:d:sh")) != -1) {
+		switch (opt) {
+		case 'p': cfg.port = (uint16_t)atoi(optarg); break;
+		case 't': cfg.threads = atoi(optarg); break;
+		case 'm':
+			if (0 == strcmp(optarg, "echo")) {
+				cfg.mode = MODE_ECHO;
+			} else if (0 == strcmp(optarg, "reply")) {
+				cfg.mode = MODE_REPLY;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'q': cfg.req_size = (uint32_t)atoi(optarg); break;
+		case 'r': cfg.reply_size = (uint32_t)atoi(optarg); break;
+		case 'd': cfg.delay_ms = (uint32_t)atoi(optarg); break;
+		case 's': cfg.quiet = true; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (cfg.threads <= 0) {
+		cfg.threads = (int)std::thread::hardware_concurrency();
+		if (cfg.threads <= 0) cfg.threads = 1;
+	}
+
+	// 回复内容为"hello"重复到reply_size字节，默认和原来的server.go相同
+	std::string reply;
+	while (reply.size() < cfg.reply_size) reply += "hello";
+	reply.resize(cfg.reply_size);
+
+	raise_nofile();
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	std::vector<worker*> workers;
+	for (int i = 0; i < cfg.threads; ++i) {
+		worker *w = new worker(cfg, reply);
+		if (!w->init()) {
+			fprintf(stderr, "listen on port %u failed: %s\n", cfg.port, strerror(errno));
+			return 1;
+		}
+		workers.push_back(w);
+	}
+
+	std::vector<std::thread> threads;
+	for (auto w : workers) {
+		threads.emplace_back([w]() { w->run(); });
+	}
+	printf("listening on port %u, %d threads, mode %s, delay %ums\n", cfg.port, cfg.threads,
+		MODE_ECHO == cfg.mode ? "echo" : "reply", cfg.delay_ms);
+	fflush(stdout);
+
+	uint64_t last_in = 0, last_out = 0;
+	while (!g_stop) {
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		if (cfg.quiet) {
+			continue;
+		}
+		uint64_t active = 0, in = 0, out = 0;
+		for (auto w : workers) {
+			active += w->active.load(std::memory_order_relaxed);
+			in += w->bytes_in.load(std::memory_order_relaxed);
+			out += w->bytes_out.load(std::memory_order_relaxed);
+		}
+		printf("conns %8llu   in %9.2f MB/s   out %9.2f MB/s\n", (unsigned long long)active,
+			(in - last_in) / 1048576.0, (out - last_out) / 1048576.0);
+		fflush(stdout);
+		last_in = in;
+		last_out = out;
+	}
+
+	for (auto &t : threads) t.join();
+	for (auto w : workers) delete w;
+	return 0;
+}
@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "tcp_framer.h"
+#include "../ringbuffer/ringbuffer.h"
+
+#define FRAMER_MAX_DELIM	16
+
+struct tcp_framer {
+	ringbuffer_t *rb;
+	uint32_t max_frame;
+	uint8_t delim[FRAMER_MAX_DELIM];
+	uint32_t delim_len;		// 0表示长度前缀模式
+	size_t release;			// 上一次返回的帧占用的字节数，下一次调用时才从buffer中删除
+	size_t scan;			// 分隔符模式下已经查找过的字节数，避免重复查找
+	uint8_t *scratch;		// 跨越回绕的帧拷贝到这里
+	uint64_t copies;
+};
+
+static tcp_framer* framer_create(size_t capacity, uint32_t max_frame, uint32_t extra) {
+	tcp_framer *f = (tcp_framer*)calloc(1, sizeof(tcp_framer));
+	if (!f) return NULL;
+
+	// 至少能放下一个最大的帧
+	if (capacity < (size_t)max_frame + extra) {
+		capacity = (size_t)max_frame + extra;
+	}
+	f->rb = rb_malloc(capacity);
+	f->max_frame = max_frame;
+	f->scratch = (uint8_t*)malloc(max_frame ? max_frame : 1);
+	if (!f->rb || !f->scratch) {
+		if (f->rb) rb_free(f->rb);
+		free(f->scratch);
+		free(f);
+		return NULL;
+	}
+	return f;
+}
+
+tcp_framer* tcp_framer_create(size_t capacity, uint32_t max_frame) {
+	return framer_create(capacity, max_frame, TCP_FRAME_HDR_SIZE);
+}
+
+tcp_framer* tcp_framer_create_delim(size_t capacity, uint32_t max_frame, const uint8_t *delim, uint32_t delim_len) {
+	tcp_framer *f;
+
+	if (0 == delim_len || delim_len > FRAMER_MAX_DELIM) {
+		return NULL;
+	}
+	f = framer_create(capacity, max_frame, delim_len);
+	if (f) {
+		memcpy(f->delim, delim, delim_len);
+		f->delim_len = delim_len;
+	}
+	return f;
+}
+
+void tcp_framer_destroy(tcp_framer *f) {
+	rb_free(f->rb);
+	free(f->scratch);
+	free(f);
+}
+
+// 删除上一次返回的帧，buffer读空时rb_remove_oldest会回到开头，留出最大的连续空间
+static void framer_release(tcp_framer *f) {
+	if (f->release) {
+		rb_remove_oldest(f->rb, f->release);
+		f->release = 0;
+		f->scan = 0;
+	}
+}
+
+// 距离读位置off处的字节在buffer中的下标
+static size_t framer_phys(const tcp_framer *f, size_t off) {
+	size_t total = f->rb->rb_capacity + 1;
+	size_t pos = f->rb->rb_pr + off;
+	return pos >= total ? pos - total : pos;
+}
+
+static void framer_copy(const tcp_framer *f, size_t off, uint8_t *dst, size_t n) {
+	size_t total = f->rb->rb_capacity + 1;
+	size_t phys = framer_phys(f, off);
+	size_t m = total - phys;
+
+	if (n <= m) {
+		memcpy(dst, f->rb->rb_buf + phys, n);
+	} else {
+		memcpy(dst, f->rb->rb_buf + phys, m);
+		memcpy(dst + m, f->rb->rb_buf, n - m);
+	}
+}
+
+// [off, off+n)连续时直接返回buffer内的指针，否则拷贝到scratch
+static const uint8_t* framer_span(tcp_framer *f, size_t off, size_t n) {
+	size_t phys = framer_phys(f, off);
+
+	if (phys + n <= f->rb->rb_capacity + 1) {
+		return (const uint8_t*)f->rb->rb_buf + phys;
+	}
+	framer_copy(f, off, f->scratch, n);
+	f->copies++;
+	return f->scratch;
+}
+
+int32_t tcp_framer_read(tcp_framer *f, tcp_socket *sock) {
+	ringbuffer_t *rb = f->rb;
+	size_t total = rb->rb_capacity + 1;
+	struct iovec iov[2];
+	ssize_t n;
+	int cnt = 0;
+
+	framer_release(f);
+
+	// 空闲空间最多两段，需要保留一个字节区分空和满
+	if (rb->rb_pr <= rb->rb_pw) {
+		iov[0].iov_base = rb->rb_buf + rb->rb_pw;
+		iov[0].iov_len = total - rb->rb_pw - (0 == rb->rb_pr ? 1 : 0);
+		if (iov[0].iov_len > 0) cnt++;
+		if (rb->rb_pr > 1) {
+			iov[cnt].iov_base = rb->rb_buf;
+			iov[cnt].iov_len = rb->rb_pr - 1;
+			cnt++;
+		}
+	} else if (rb->rb_pr - rb->rb_pw > 1) {
+		iov[0].iov_base = rb->rb_buf + rb->rb_pw;
+		iov[0].iov_len = rb->rb_pr - rb->rb_pw - 1;
+		cnt++;
+	}
+	if (0 == cnt) {
+		return 0;
+	}
+
+	do {
+		n = readv(sock->fd, iov, cnt);
+	} while (n < 0 && errno == EINTR);
+
+	if (0 == n) {
+		return -1;
+	}
+	if (n < 0) {
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	}
+
+	if ((size_t)n <= iov[0].iov_len && iov[0].iov_base == rb->rb_buf + rb->rb_pw) {
+		rb->rb_pw += n;
+	} else if (iov[0].iov_base == rb->rb_buf + rb->rb_pw) {
+		rb->rb_pw = n - iov[0].iov_len;
+	} else {
+		// 写位置在尾部，第一段为空
+		rb->rb_pw = n;
+	}
+	rb_commit(rb);
+
+	return (int32_t)n;
+}
+
+uint32_t tcp_framer_feed(tcp_framer *f, const uint8_t *data, uint32_t n) {
+	size_t room;
+
+	framer_release(f);
+	room = rb_get_free_size(f->rb);
+	if (n > room) {
+		n = (uint32_t)room;
+	}
+	rb_write(f->rb, (void*)data, n);
+	return n;
+}
+
+// 从f->scan开始查找分隔符，返回分隔符的位置，没有找到返回-1
+static int64_t framer_find_delim(tcp_framer *f, size_t size) {
+	size_t total = f->rb->rb_capacity + 1;
+	size_t pos = f->scan;
+	uint8_t tmp[FRAMER_MAX_DELIM];
+
+	while (pos + f->delim_len <= size) {
+		size_t phys = framer_phys(f, pos);
+		size_t run = total - phys;
+		const uint8_t *start, *p;
+
+		if (run > size - pos) run = size - pos;
+		start = (const uint8_t*)f->rb->rb_buf + phys;
+		p = (const uint8_t*)memchr(start, f->delim[0], run);
+		if (!p) {
+			pos += run;
+			continue;
+		}
+		pos += p - start;
+		if (pos + f->delim_len > size) {
+			break;
+		}
+		// 分隔符本身也可能跨越回绕
+		framer_copy(f, pos, tmp, f->delim_len);
+		if (0 == memcmp(tmp, f->delim, f->delim_len)) {
+			return (int64_t)pos;
+		}
+		pos++;
+	}
+
+	f->scan = pos;
+	return -1;
+}
+
+int tcp_framer_next(tcp_framer *f, tcp_frame *frame) {
+	size_t size;
+	uint8_t hdr[TCP_FRAME_HDR_SIZE];
+	uint32_t len;
+
+	framer_release(f);
+	size = rb_get_size(f->rb);
+
+	if (0 == f->delim_len) {
+		if (size < TCP_FRAME_HDR_SIZE) {
+			return 0;
+		}
+		framer_copy(f, 0, hdr, TCP_FRAME_HDR_SIZE);
+		len = ((uint32_t)hdr[0] << 24) | ((uint32_t)hdr[1] << 16) | ((uint32_t)hdr[2] << 8) | hdr[3];
+		if (len > f->max_frame) {
+			return -1;
+		}
+		if (size < TCP_FRAME_HDR_SIZE + (size_t)len) {
+			return 0;
+		}
+		frame->data = framer_span(f, TCP_FRAME_HDR_SIZE, len);
+		frame->len = len;
+		f->release = TCP_FRAME_HDR_SIZE + len;
+		return 1;
+	} else {
+		int64_t pos = framer_find_delim(f, size);
+		if (pos < 0) {
+			// 已经超过最大帧长度还没有找到分隔符
+			return size >= (size_t)f->max_frame + f->delim_len ? -1 : 0;
+		}
+		if (pos > f->max_frame) {
+			return -1;
+		}
+		frame->data = framer_span(f, 0, (size_t)pos);
+		frame->len = (uint32_t)pos;
+		f->release = (size_t)pos + f->delim_len;
+		return 1;
+	}
+}
+
+size_t tcp_framer_buffered(const tcp_framer *f) {
+	return rb_get_size(f->rb) - f->release;
+}
+
+uint64_t tcp_framer_copies(const tcp_framer *f) {
+	return f->copies;
+}
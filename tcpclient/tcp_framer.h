@@ -0,0 +1,85 @@
+#ifndef __TCP_FRAMER_H__
+#define __TCP_FRAMER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "tcpclient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 分帧读取：每个连接一个ringbuffer，一次readv尽量多读，然后在buffer中原地解析出完整的帧，
+// 一次系统调用可以得到很多个小消息，不需要每个服务自己处理半包、粘包
+//
+// 两种分帧方式：
+//   长度前缀：每帧 = 4字节大端长度 + 数据
+//   分隔符：  每帧以指定的分隔符（例如"\r\n"）结尾，返回的帧不包含分隔符
+//
+// 返回的帧直接指向ringbuffer内部，不拷贝；只有帧跨越ringbuffer尾部回绕时才拷贝到一个临时buffer中
+// 帧在下一次调用tcp_framer_next、tcp_framer_read或者tcp_framer_feed之前有效
+//
+// 用法（非阻塞socket，配合tcp_loop）：
+//   while ((n = tcp_framer_read(f, &sock)) > 0) {
+//       while (1 == tcp_framer_next(f, &frame)) {
+//           handle(frame.data, frame.len);
+//       }
+//   }
+//   if (n < 0) 连接断开
+
+typedef struct tcp_framer tcp_framer;
+
+typedef struct {
+	const uint8_t *data;
+	uint32_t len;
+} tcp_frame;
+
+#define TCP_FRAME_HDR_SIZE	4
+
+/*
+ * 长度前缀模式，max_frame为帧数据的最大长度，capacity为ringbuffer大小（不足一帧时自动扩大）
+ * 失败返回NULL
+ */
+tcp_framer* tcp_framer_create(size_t capacity, uint32_t max_frame);
+
+/*
+ * 分隔符模式，delim长度为1~16字节
+ * 失败返回NULL
+ */
+tcp_framer* tcp_framer_create_delim(size_t capacity, uint32_t max_frame, const uint8_t *delim, uint32_t delim_len);
+
+void tcp_framer_destroy(tcp_framer *f);
+
+/*
+ * 从socket读取数据到ringbuffer，不等待
+ * 返回值为-1：表示连接断开或者出错
+ * 返回值为0：表示当前没有数据可读(EAGAIN)，或者buffer已满需要先取出帧
+ * 返回值为正数：表示读取到的字节数
+ */
+int32_t tcp_framer_read(tcp_framer *f, tcp_socket *sock);
+
+/*
+ * 放入从其他途径收到的数据（例如tcp_uring的接收回调）
+ * 返回放入的字节数，buffer不足时可能小于n
+ */
+uint32_t tcp_framer_feed(tcp_framer *f, const uint8_t *data, uint32_t n);
+
+/*
+ * 取出下一个完整的帧
+ * 返回值为1：表示取到一个帧
+ * 返回值为0：表示数据还不够一个完整的帧
+ * 返回值为-1：表示帧超过max_frame，协议错误，应该关闭连接
+ */
+int tcp_framer_next(tcp_framer *f, tcp_frame *frame);
+
+// ringbuffer中还没有取出的字节数
+size_t tcp_framer_buffered(const tcp_framer *f);
+
+// 因为帧跨越回绕而拷贝的次数
+uint64_t tcp_framer_copies(const tcp_framer *f);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __TCP_FRAMER_H__ */
@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "tcp_loop.h"
+
+struct tcp_loop {
+	int epfd;
+	int max_events;
+	struct epoll_event *events;
+	int event_index;		// 正在分发的事件下标
+	int event_count;		// 本轮epoll_wait返回的事件数
+	int conn_count;
+	int stopped;
+	uint64_t now_ms;
+
+	// 定时器最小堆，按deadline_ms排序
+	tcp_conn **heap;
+	int heap_size;
+	int heap_capacity;
+};
+
+static uint64_t loop_clock_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void heap_swap(tcp_loop *loop, int i, int j) {
+	tcp_conn *t = loop->heap[i];
+	loop->heap[i] = loop->heap[j];
+	loop->heap[j] = t;
+	loop->heap[i]->heap_index = i;
+	loop->heap[j]->heap_index = j;
+}
+
+static void heap_up(tcp_loop *loop, int i) {
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (loop->heap[parent]->deadline_ms <= loop->heap[i]->deadline_ms) {
+			break;
+		}
+		heap_swap(loop, i, parent);
+		i = parent;
+	}
+}
+
+static void heap_down(tcp_loop *loop, int i) {
+	for (;;) {
+		int l = 2 * i + 1, r = l + 1, min = i;
+		if (l < loop->heap_size && loop->heap[l]->deadline_ms < loop->heap[min]->deadline_ms) min = l;
+		if (r < loop->heap_size && loop->heap[r]->deadline_ms < loop->heap[min]->deadline_ms) min = r;
+		if (min == i) {
+			break;
+		}
+		heap_swap(loop, i, min);
+		i = min;
+	}
+}
+
+static void heap_remove(tcp_loop *loop, tcp_conn *conn) {
+	int i = conn->heap_index;
+	if (i < 0) {
+		return;
+	}
+	conn->heap_index = -1;
+	loop->heap_size--;
+	if (i == loop->heap_size) {
+		return;
+	}
+	loop->heap[i] = loop->heap[loop->heap_size];
+	loop->heap[i]->heap_index = i;
+	heap_up(loop, i);
+	heap_down(loop, loop->heap[i]->heap_index);
+}
+
+static int heap_push(tcp_loop *loop, tcp_conn *conn) {
+	if (loop->heap_size == loop->heap_capacity) {
+		int capacity = loop->heap_capacity ? loop->heap_capacity * 2 : 64;
+		tcp_conn **heap = (tcp_conn**)realloc(loop->heap, sizeof(tcp_conn*) * capacity);
+		if (!heap) {
+			return -1;
+		}
+		loop->heap = heap;
+		loop->heap_capacity = capacity;
+	}
+	conn->heap_index = loop->heap_size++;
+	loop->heap[conn->heap_index] = conn;
+	heap_up(loop, conn->heap_index);
+	return 0;
+}
+
+tcp_loop* tcp_loop_create(int max_events) {
+	tcp_loop *loop = (tcp_loop*)calloc(1, sizeof(tcp_loop));
+	if (!loop) return NULL;
+
+	if (max_events <= 0) max_events = 1024;
+	loop->max_events = max_events;
+	loop->events = (struct epoll_event*)malloc(sizeof(struct epoll_event) * max_events);
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	loop->now_ms = loop_clock_ms();
+	if (!loop->events || loop->epfd < 0) {
+		tcp_loop_destroy(loop);
+		return NULL;
+	}
+	return loop;
+}
+
+void tcp_loop_destroy(tcp_loop *loop) {
+	if (loop->epfd >= 0) close(loop->epfd);
+	free(loop->events);
+	free(loop->heap);
+	free(loop);
+}
+
+static int32_t loop_register(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = conn;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, conn->sock.fd, &ev) < 0) {
+		return -1;
+	}
+	conn->epoll_events = events;
+	loop->conn_count++;
+	return 0;
+}
+
+static void conn_init(tcp_conn *conn, tcp_conn_cb cb, void *udata) {
+	conn->cb = cb;
+	conn->udata = udata;
+	conn->epoll_events = 0;
+	conn->connecting = 0;
+	conn->want_write = 0;
+	conn->heap_index = -1;
+	conn->deadline_ms = 0;
+}
+
+int32_t tcp_loop_connect(tcp_loop *loop, tcp_conn *conn, const char *ip, uint16_t port, uint32_t timeout_ms, tcp_conn_cb cb, void *udata) {
+	struct sockaddr_in addr;
+
+	conn_init(conn, cb, udata);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) {
+		conn->sock.fd = -1;
+		return -1;
+	}
+
+	conn->sock.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (conn->sock.fd < 0) {
+		return -1;
+	}
+
+	// 连接结果在socket可写时通过SO_ERROR判断，本地连接也可能立即成功，同样等可写事件统一处理
+	if (connect(conn->sock.fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+		close(conn->sock.fd);
+		conn->sock.fd = -1;
+		return -1;
+	}
+	conn->connecting = 1;
+	if (loop_register(loop, conn, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) < 0) {
+		close(conn->sock.fd);
+		conn->sock.fd = -1;
+		return -1;
+	}
+	if (timeout_ms > 0) {
+		tcp_loop_set_timer(loop, conn, timeout_ms);
+	}
+	return 0;
+}
+
+int32_t tcp_loop_add(tcp_loop *loop, tcp_conn *conn, tcp_socket sock, tcp_conn_cb cb, void *udata) {
+	conn_init(conn, cb, udata);
+	conn->sock = sock;
+	fcntl(sock.fd, F_SETFL, fcntl(sock.fd, F_GETFL) | O_NONBLOCK);
+	return loop_register(loop, conn, EPOLLIN | EPOLLRDHUP | EPOLLET);
+}
+
+void tcp_loop_remove(tcp_loop *loop, tcp_conn *conn) {
+	int i;
+
+	heap_remove(loop, conn);
+	if (conn->epoll_events) {
+		epoll_ctl(loop->epfd, EPOLL_CTL_DEL, conn->sock.fd, NULL);
+		conn->epoll_events = 0;
+		loop->conn_count--;
+	}
+
+	// 丢弃本轮还没有分发的事件，conn可能在回调返回后被释放
+	for (i = loop->event_index + 1; i < loop->event_count; ++i) {
+		if (loop->events[i].data.ptr == conn) {
+			loop->events[i].data.ptr = NULL;
+		}
+	}
+}
+
+void tcp_loop_set_timer(tcp_loop *loop, tcp_conn *conn, uint32_t timeout_ms) {
+	heap_remove(loop, conn);
+	if (0 == timeout_ms) {
+		return;
+	}
+	conn->deadline_ms = loop_clock_ms() + timeout_ms;
+	heap_push(loop, conn);
+}
+
+int32_t tcp_loop_want_write(tcp_loop *loop, tcp_conn *conn, int on) {
+	struct epoll_event ev;
+	uint32_t events = on ? (conn->epoll_events | EPOLLOUT) : (conn->epoll_events & ~EPOLLOUT);
+
+	if (!conn->epoll_events) {
+		return -1;
+	}
+	// 连接建立之前一直需要EPOLLOUT，只记下调用者的意图
+	if (conn->connecting) {
+		conn->want_write = on;
+		return 0;
+	}
+	if (events == conn->epoll_events && !on) {
+		return 0;
+	}
+
+	// 即使已经注册了EPOLLOUT也重新MOD一次，边缘触发下这样可以在socket可写时再通知一次
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = conn;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, conn->sock.fd, &ev) < 0) {
+		return -1;
+	}
+	conn->epoll_events = events;
+	return 0;
+}
+
+// 分发一个epoll事件
+static void loop_dispatch(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	uint32_t ev = 0;
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	if (conn->connecting) {
+		if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+			return;
+		}
+		conn->connecting = 0;
+		heap_remove(loop, conn);
+		if (getsockopt(conn->sock.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+			conn->cb(loop, conn, TCP_EV_ERROR);
+			return;
+		}
+		// 连接成功后按连接期间的请求设置可写通知，默认不关心
+		tcp_loop_want_write(loop, conn, conn->want_write);
+		ev |= TCP_EV_CONNECTED;
+		if (events & EPOLLIN) ev |= TCP_EV_READ;
+		conn->cb(loop, conn, ev);
+		return;
+	}
+
+	// 错误队列中有通知时也会收到EPOLLERR，用SO_ERROR区分socket是否真的出错
+	if ((events & EPOLLERR) && (getsockopt(conn->sock.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)) {
+		ev |= TCP_EV_ERROR;
+	} else {
+		if (events & EPOLLERR) ev |= TCP_EV_ERRQUEUE;
+		if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) ev |= TCP_EV_READ;
+		if ((events & EPOLLOUT) && (conn->epoll_events & EPOLLOUT)) ev |= TCP_EV_WRITE;
+	}
+	if (ev) {
+		conn->cb(loop, conn, ev);
+	}
+}
+
+static void loop_expire_timers(tcp_loop *loop) {
+	while (loop->heap_size > 0 && loop->heap[0]->deadline_ms <= loop->now_ms) {
+		tcp_conn *conn = loop->heap[0];
+		heap_remove(loop, conn);
+		conn->cb(loop, conn, TCP_EV_TIMEOUT);
+	}
+}
+
+int tcp_loop_run_once(tcp_loop *loop, int timeout_ms) {
+	int n, dispatched = 0;
+
+	// 等待时间不超过最近的定时器
+	if (loop->heap_size > 0) {
+		uint64_t now = loop_clock_ms();
+		uint64_t deadline = loop->heap[0]->deadline_ms;
+		int wait = deadline > now ? (int)(deadline - now) : 0;
+		if (timeout_ms < 0 || wait < timeout_ms) {
+			timeout_ms = wait;
+		}
+	}
+
+	n = epoll_wait(loop->epfd, loop->events, loop->max_events, timeout_ms);
+	loop->now_ms = loop_clock_ms();
+	if (n < 0) {
+		n = 0;
+	}
+
+	loop->event_count = n;
+	for (loop->event_index = 0; loop->event_index < n; ++loop->event_index) {
+		tcp_conn *conn = (tcp_conn*)loop->events[loop->event_index].data.ptr;
+		if (conn) {
+			loop_dispatch(loop, conn, loop->events[loop->event_index].events);
+			dispatched++;
+		}
+	}
+	loop->event_count = 0;
+	loop->event_index = 0;
+
+	loop_expire_timers(loop);
+	return dispatched;
+}
+
+void tcp_loop_run(tcp_loop *loop) {
+	loop->stopped = 0;
+	while (!loop->stopped && (loop->conn_count > 0 || loop->heap_size > 0)) {
+		tcp_loop_run_once(loop, -1);
+	}
+}
+
+void tcp_loop_stop(tcp_loop *loop) {
+	loop->stopped = 1;
+}
+
+int tcp_loop_conn_count(const tcp_loop *loop) {
+	return loop->conn_count;
+}
+
+uint64_t tcp_loop_now_ms(const tcp_loop *loop) {
+	return loop->now_ms;
+}
@@ -0,0 +1,93 @@
+#ifndef __TCP_LOOP_H__
+#define __TCP_LOOP_H__
+
+#include <stdint.h>
+#include "tcpclient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 基于边缘触发epoll的事件循环，一个线程同时驱动大量tcp_socket，不受FD_SETSIZE限制
+// 每个连接对应一个tcp_conn（由调用者分配，通常嵌在自己的连接结构体中），
+// 连接、可读、可写、定时器超时都通过回调通知，定时器用最小堆管理
+//
+// 注意：
+//   1. 边缘触发，收到TCP_EV_READ后需要一直读到tcp_nb_read返回0(EAGAIN)，否则不会再次通知
+//   2. 回调中可以调用tcp_loop_remove并释放tcp_conn，本轮尚未分发的事件会被丢弃
+//   3. 不是线程安全的，所有接口都需要在事件循环所在的线程调用
+
+#define TCP_EV_CONNECTED	0x01	// 连接成功
+#define TCP_EV_READ			0x02	// 可读，或者对端关闭（此时tcp_nb_read返回-1）
+#define TCP_EV_WRITE		0x04	// 可写，需要先通过tcp_loop_want_write打开
+#define TCP_EV_TIMEOUT		0x08	// 定时器超时，连接超时也通过它通知
+#define TCP_EV_ERROR		0x10	// 连接失败或者socket出错
+#define TCP_EV_ERRQUEUE		0x20	// socket的错误队列中有通知（例如MSG_ZEROCOPY的完成通知），连接本身没有出错
+
+typedef struct tcp_loop tcp_loop;
+typedef struct tcp_conn tcp_conn;
+
+typedef void (*tcp_conn_cb)(tcp_loop *loop, tcp_conn *conn, uint32_t events);
+
+struct tcp_conn {
+	tcp_socket sock;
+	tcp_conn_cb cb;
+	void *udata;
+
+	// 以下由tcp_loop维护
+	uint32_t epoll_events;	// 当前注册的epoll事件
+	int connecting;			// 正在连接
+	int want_write;			// 连接建立之前请求的可写通知，连接成功后生效
+	int heap_index;			// 在定时器堆中的位置，-1表示没有定时器
+	uint64_t deadline_ms;	// 定时器到期时间
+};
+
+// max_events为每次epoll_wait最多返回的事件数，失败返回NULL
+tcp_loop* tcp_loop_create(int max_events);
+
+// 不会关闭还在循环中的连接
+void tcp_loop_destroy(tcp_loop *loop);
+
+/*
+ * 初始化conn，并发起非阻塞连接，连接结果通过TCP_EV_CONNECTED或者TCP_EV_ERROR通知，
+ * timeout_ms内没有连接成功则通知TCP_EV_TIMEOUT（0表示不设置超时）
+ * 返回值为0：表示已经发起连接
+ * 返回值为-1：表示发起连接失败
+ */
+int32_t tcp_loop_connect(tcp_loop *loop, tcp_conn *conn, const char *ip, uint16_t port, uint32_t timeout_ms, tcp_conn_cb cb, void *udata);
+
+/*
+ * 把已经连接好的socket加入循环（例如tcp_connect的结果），socket会被设置为非阻塞
+ * 返回值为0：成功，-1：失败
+ */
+int32_t tcp_loop_add(tcp_loop *loop, tcp_conn *conn, tcp_socket sock, tcp_conn_cb cb, void *udata);
+
+// 从循环中移除conn并取消定时器，不会关闭socket
+void tcp_loop_remove(tcp_loop *loop, tcp_conn *conn);
+
+// 设置conn的定时器，timeout_ms后通知TCP_EV_TIMEOUT，0表示取消；重复设置会覆盖之前的定时器
+void tcp_loop_set_timer(tcp_loop *loop, tcp_conn *conn, uint32_t timeout_ms);
+
+// 打开/关闭TCP_EV_WRITE通知，打开时若socket当前可写，下一轮循环就会通知
+// 连接建立之前调用时先记下来，连接成功后生效
+int32_t tcp_loop_want_write(tcp_loop *loop, tcp_conn *conn, int on);
+
+// 运行一轮：最多等待timeout_ms（-1表示一直等到有事件或者定时器到期），返回分发的事件数
+int tcp_loop_run_once(tcp_loop *loop, int timeout_ms);
+
+// 一直运行，直到调用tcp_loop_stop或者循环中没有连接
+void tcp_loop_run(tcp_loop *loop);
+
+void tcp_loop_stop(tcp_loop *loop);
+
+// 当前循环中的连接数
+int tcp_loop_conn_count(const tcp_loop *loop);
+
+// 本轮循环开始时的时间（CLOCK_MONOTONIC，毫秒）
+uint64_t tcp_loop_now_ms(const tcp_loop *loop);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __TCP_LOOP_H__ */
@@ -0,0 +1,371 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tcp_mux.h"
+#include "tcp_writer.h"
+#include "tcp_framer.h"
+
+#define MUX_ID_SIZE			4
+#define MUX_WRITER_SIZE		(1024 * 1024)
+
+#define MUX_NO_SLOT			UINT32_MAX
+
+#define MUX_CONNECTING		0
+#define MUX_CONNECTED		1
+#define MUX_CLOSED			2
+
+// 请求槽位，从空闲链表分配；id的低位为槽位下标，高位为槽位的代数，
+// 槽位被复用后，之前已经超时的请求的回应不会匹配到新的请求
+typedef struct {
+	uint32_t id;
+	uint32_t gen;			// 槽位的代数，每次分配加1
+	uint32_t next_free;		// 空闲链表中的下一个槽位
+	int used;
+	tcp_mux_cb cb;
+	void *arg;
+	uint64_t deadline_ms;
+	int heap_index;			// 在超时堆中的位置，-1表示没有超时
+} mux_req;
+
+struct tcp_mux {
+	tcp_loop *loop;
+	tcp_conn conn;
+	tcp_writer *writer;
+	tcp_framer *framer;
+	int state;
+	int write_armed;		// 已经打开可写通知，等待批量发出
+	uint64_t connect_deadline_ms;	// 连接超时时间，0表示不超时
+	uint32_t mask;
+	uint32_t slot_bits;		// id中槽位下标的位数
+	uint32_t free_head;		// 空闲链表头，没有空闲槽位时为MUX_NO_SLOT
+	uint32_t inflight;
+	mux_req *reqs;
+
+	// 超时最小堆，保存槽位下标
+	uint32_t *heap;
+	int heap_size;
+};
+
+static uint64_t mux_now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int heap_less(tcp_mux *mux, int i, int j) {
+	return mux->reqs[mux->heap[i]].deadline_ms < mux->reqs[mux->heap[j]].deadline_ms;
+}
+
+static void heap_swap(tcp_mux *mux, int i, int j) {
+	uint32_t t = mux->heap[i];
+	mux->heap[i] = mux->heap[j];
+	mux->heap[j] = t;
+	mux->reqs[mux->heap[i]].heap_index = i;
+	mux->reqs[mux->heap[j]].heap_index = j;
+}
+
+static void heap_up(tcp_mux *mux, int i) {
+	while (i > 0 && heap_less(mux, i, (i - 1) / 2)) {
+		heap_swap(mux, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void heap_down(tcp_mux *mux, int i) {
+	for (;;) {
+		int l = 2 * i + 1, r = l + 1, min = i;
+		if (l < mux->heap_size && heap_less(mux, l, min)) min = l;
+		if (r < mux->heap_size && heap_less(mux, r, min)) min = r;
+		if (min == i) {
+			break;
+		}
+		heap_swap(mux, i, min);
+		i = min;
+	}
+}
+
+static void heap_remove(tcp_mux *mux, mux_req *req) {
+	int i = req->heap_index;
+	if (i < 0) {
+		return;
+	}
+	req->heap_index = -1;
+	mux->heap_size--;
+	if (i == mux->heap_size) {
+		return;
+	}
+	mux->heap[i] = mux->heap[mux->heap_size];
+	mux->reqs[mux->heap[i]].heap_index = i;
+	heap_up(mux, i);
+	heap_down(mux, mux->reqs[mux->heap[i]].heap_index);
+}
+
+// 按最近的超时时间设置连接的定时器，连接建立之前还要考虑连接超时
+static void mux_rearm_timer(tcp_mux *mux) {
+	uint64_t now, deadline = 0;
+
+	if (MUX_CLOSED == mux->state) {
+		return;
+	}
+	if (MUX_CONNECTING == mux->state) {
+		deadline = mux->connect_deadline_ms;
+	}
+	if (mux->heap_size > 0 && (0 == deadline || mux->reqs[mux->heap[0]].deadline_ms < deadline)) {
+		deadline = mux->reqs[mux->heap[0]].deadline_ms;
+	}
+	if (0 == deadline) {
+		tcp_loop_set_timer(mux->loop, &mux->conn, 0);
+		return;
+	}
+	now = mux_now_ms();
+	tcp_loop_set_timer(mux->loop, &mux->conn, deadline > now ? (uint32_t)(deadline - now) : 1);
+}
+
+// 结束一个请求并通知调用者，槽位放回空闲链表
+static void mux_finish(tcp_mux *mux, mux_req *req, int status, const uint8_t *data, uint32_t len) {
+	tcp_mux_cb cb = req->cb;
+	void *arg = req->arg;
+
+	heap_remove(mux, req);
+	req->used = 0;
+	req->next_free = mux->free_head;
+	mux->free_head = (uint32_t)(req - mux->reqs);
+	mux->inflight--;
+	cb(mux, arg, status, data, len);
+}
+
+static void mux_fail_all(tcp_mux *mux) {
+	uint32_t i;
+
+	mux->state = MUX_CLOSED;
+	for (i = 0; i <= mux->mask && mux->inflight > 0; ++i) {
+		if (mux->reqs[i].used) {
+			mux_finish(mux, &mux->reqs[i], TCP_MUX_CLOSED, NULL, 0);
+		}
+	}
+}
+
+static void mux_close(tcp_mux *mux) {
+	if (MUX_CLOSED == mux->state) {
+		return;
+	}
+	tcp_loop_remove(mux->loop, &mux->conn);
+	tcp_close(&mux->conn.sock);
+	mux_fail_all(mux);
+}
+
+static void mux_expire(tcp_mux *mux) {
+	uint64_t now = mux_now_ms();
+
+	while (mux->heap_size > 0 && mux->reqs[mux->heap[0]].deadline_ms <= now) {
+		mux_finish(mux, &mux->reqs[mux->heap[0]], TCP_MUX_TIMEOUT, NULL, 0);
+	}
+	mux_rearm_timer(mux);
+}
+
+static void mux_flush(tcp_mux *mux) {
+	int32_t r = tcp_writer_flush(mux->writer);
+	if (r < 0) {
+		mux_close(mux);
+		return;
+	}
+	// 全部发出后关闭可写通知，下一次请求时再打开
+	mux->write_armed = (0 == r);
+	tcp_loop_want_write(mux->loop, &mux->conn, 0 == r);
+}
+
+static void mux_read(tcp_mux *mux) {
+	tcp_frame frame;
+	int32_t n;
+	int r;
+
+	while ((n = tcp_framer_read(mux->framer, &mux->conn.sock)) > 0) {
+		while (1 == (r = tcp_framer_next(mux->framer, &frame))) {
+			uint32_t id;
+			mux_req *req;
+
+			if (frame.len < MUX_ID_SIZE) {
+				r = -1;
+				break;
+			}
+			id = ((uint32_t)frame.data[0] << 24) | ((uint32_t)frame.data[1] << 16) | ((uint32_t)frame.data[2] << 8) | frame.data[3];
+			req = &mux->reqs[id & mux->mask];
+			// 已经超时的请求的回应直接丢弃
+			if (req->used && req->id == id) {
+				mux_finish(mux, req, TCP_MUX_OK, frame.data + MUX_ID_SIZE, frame.len - MUX_ID_SIZE);
+			}
+		}
+		if (r < 0) {
+			n = -1;
+			break;
+		}
+	}
+	if (n < 0) {
+		mux_close(mux);
+	} else {
+		mux_rearm_timer(mux);
+	}
+}
+
+static void mux_event(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	tcp_mux *mux = (tcp_mux*)conn->udata;
+
+	(void)loop;
+	if (events & TCP_EV_ERROR) {
+		mux_close(mux);
+		return;
+	}
+	if (events & TCP_EV_TIMEOUT) {
+		if (MUX_CONNECTING == mux->state && mux->connect_deadline_ms > 0 && mux_now_ms() >= mux->connect_deadline_ms) {
+			mux_close(mux);
+			return;
+		}
+		mux_expire(mux);
+	}
+	// 连接建立之前排队的请求已经打开了可写通知，连接成功后由TCP_EV_WRITE发出
+	if (events & TCP_EV_CONNECTED) {
+		mux->state = MUX_CONNECTED;
+		mux_rearm_timer(mux);
+	}
+	if (MUX_CONNECTED == mux->state && (events & TCP_EV_READ)) {
+		mux_read(mux);
+	}
+	if (MUX_CONNECTED == mux->state && (events & TCP_EV_WRITE)) {
+		mux_flush(mux);
+	}
+}
+
+tcp_mux* tcp_mux_create(tcp_loop *loop, const char *ip, uint16_t port, uint32_t connect_timeout_ms,
+	uint32_t max_inflight, uint32_t max_frame) {
+	tcp_mux *mux = (tcp_mux*)calloc(1, sizeof(tcp_mux));
+	uint32_t cap = 1, bits = 0, i;
+
+	if (!mux) return NULL;
+	if (0 == max_inflight) max_inflight = 1;
+	while (cap < max_inflight) {
+		cap <<= 1;
+		bits++;
+	}
+
+	mux->loop = loop;
+	mux->mask = cap - 1;
+	mux->slot_bits = bits;
+	mux->reqs = (mux_req*)calloc(cap, sizeof(mux_req));
+	mux->heap = (uint32_t*)malloc(sizeof(uint32_t) * cap);
+	mux->writer = tcp_writer_create(&mux->conn.sock, MUX_WRITER_SIZE, 0);
+	mux->framer = tcp_framer_create(4 * ((size_t)max_frame + 8), max_frame + MUX_ID_SIZE);
+	if (!mux->reqs || !mux->heap || !mux->writer || !mux->framer) {
+		goto fail;
+	}
+	// 只有max_inflight个槽位放入空闲链表，没有空闲槽位即达到上限
+	mux->free_head = MUX_NO_SLOT;
+	for (i = cap; i-- > 0; ) {
+		mux->reqs[i].heap_index = -1;
+		if (i < max_inflight) {
+			mux->reqs[i].next_free = mux->free_head;
+			mux->free_head = i;
+		}
+	}
+
+	if (tcp_loop_connect(loop, &mux->conn, ip, port, connect_timeout_ms, mux_event, mux) < 0) {
+		goto fail;
+	}
+	mux->state = MUX_CONNECTING;
+	mux->connect_deadline_ms = connect_timeout_ms > 0 ? mux_now_ms() + connect_timeout_ms : 0;
+	return mux;
+
+fail:
+	if (mux->writer) tcp_writer_destroy(mux->writer);
+	if (mux->framer) tcp_framer_destroy(mux->framer);
+	free(mux->reqs);
+	free(mux->heap);
+	free(mux);
+	return NULL;
+}
+
+void tcp_mux_destroy(tcp_mux *mux) {
+	mux_close(mux);
+	tcp_writer_destroy(mux->writer);
+	tcp_framer_destroy(mux->framer);
+	free(mux->reqs);
+	free(mux->heap);
+	free(mux);
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+int64_t tcp_mux_request(tcp_mux *mux, const uint8_t *data, uint32_t n, uint32_t timeout_ms, tcp_mux_cb cb, void *arg) {
+	uint8_t hdr[TCP_FRAME_HDR_SIZE + MUX_ID_SIZE];
+	size_t need = sizeof(hdr) + n;
+	uint32_t slot = mux->free_head, gen, id;
+	mux_req *req;
+
+	if (MUX_CLOSED == mux->state || MUX_NO_SLOT == slot) {
+		return -1;
+	}
+	// 代数只用id的高位，回绕时跳过0，保证id为正数
+	req = &mux->reqs[slot];
+	gen = (req->gen + 1) & (UINT32_MAX >> mux->slot_bits);
+	if (0 == gen) gen = 1;
+	id = (uint32_t)(((uint64_t)gen << mux->slot_bits) | slot);
+	// 整个帧必须一次放入缓冲区，否则会把半个帧留在流中
+	if (tcp_writer_pending(mux->writer) + need > MUX_WRITER_SIZE) {
+		if (MUX_CONNECTED == mux->state) {
+			mux_flush(mux);
+		}
+		if (MUX_CLOSED == mux->state || tcp_writer_pending(mux->writer) + need > MUX_WRITER_SIZE) {
+			return -1;
+		}
+	}
+
+	put_be32(hdr, MUX_ID_SIZE + n);
+	put_be32(hdr + TCP_FRAME_HDR_SIZE, id);
+	tcp_writer_write(mux->writer, hdr, sizeof(hdr));
+	if (n > 0) {
+		tcp_writer_write(mux->writer, data, n);
+	}
+
+	mux->free_head = req->next_free;
+	mux->inflight++;
+	req->gen = gen;
+	req->id = id;
+	req->used = 1;
+	req->cb = cb;
+	req->arg = arg;
+	req->heap_index = -1;
+	if (timeout_ms > 0) {
+		req->deadline_ms = mux_now_ms() + timeout_ms;
+		req->heap_index = mux->heap_size;
+		mux->heap[mux->heap_size++] = slot;
+		heap_up(mux, req->heap_index);
+		if (0 == req->heap_index) {
+			mux_rearm_timer(mux);
+		}
+	}
+
+	// 只在每一批的第一个请求时打开可写通知，这一批请求在下一轮循环中一起发出；
+	// 连接建立之前打开的通知在连接成功后生效
+	if (!mux->write_armed) {
+		mux->write_armed = 1;
+		tcp_loop_want_write(mux->loop, &mux->conn, 1);
+	}
+	return id;
+}
+
+uint32_t tcp_mux_inflight(const tcp_mux *mux) {
+	return mux->inflight;
+}
+
+int tcp_mux_closed(const tcp_mux *mux) {
+	return MUX_CLOSED == mux->state;
+}
+
+int tcp_mux_over_high_water(const tcp_mux *mux) {
+	return tcp_writer_over_high_water(mux->writer);
+}
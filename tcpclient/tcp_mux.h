@@ -0,0 +1,65 @@
+#ifndef __TCP_MUX_H__
+#define __TCP_MUX_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "tcp_loop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 单连接上的流水线请求/回应：每个请求带一个id，同一个连接上可以同时有很多个请求，
+// 回应按id匹配到请求的回调，回应的顺序可以和请求不同；每个请求可以设置超时时间
+//
+// 帧格式（请求和回应相同）：[4字节大端长度][4字节大端id][数据]，长度 = 4 + 数据长度
+//
+// 写入是批量的：tcp_mux_request只把帧放入tcp_writer，并打开可写通知，
+// 下一轮循环收到TCP_EV_WRITE时一次writev发出这期间所有的请求
+//
+// 注意：
+//   1. 依附于一个tcp_loop，所有接口都需要在循环所在的线程调用
+//   2. 连接断开后所有未完成的请求以TCP_MUX_CLOSED通知，之后的请求直接失败，不会自动重连
+//   3. 不要在回调中调用tcp_mux_destroy
+
+#define TCP_MUX_OK			0	// 收到回应
+#define TCP_MUX_TIMEOUT		-1	// 超时
+#define TCP_MUX_CLOSED		-2	// 连接失败或者断开
+
+typedef struct tcp_mux tcp_mux;
+
+// status为TCP_MUX_OK时data/len为回应的数据（不含id），只在回调中有效
+typedef void (*tcp_mux_cb)(tcp_mux *mux, void *arg, int status, const uint8_t *data, uint32_t len);
+
+/*
+ * 发起连接，连接建立之前的请求会排队，连接后一起发出
+ * max_inflight为同时进行的请求数上限，max_frame为单个回应的最大长度
+ * 失败返回NULL
+ */
+tcp_mux* tcp_mux_create(tcp_loop *loop, const char *ip, uint16_t port, uint32_t connect_timeout_ms,
+	uint32_t max_inflight, uint32_t max_frame);
+
+// 关闭连接，未完成的请求以TCP_MUX_CLOSED通知
+void tcp_mux_destroy(tcp_mux *mux);
+
+/*
+ * 发送请求，timeout_ms内没有回应则以TCP_MUX_TIMEOUT通知（0表示不设置超时），连接建立之前的请求同样计时
+ * 返回值为正数：请求的id
+ * 返回值为-1：连接已断开、同时进行的请求太多或者发送缓冲区已满，调用者应稍后重试
+ */
+int64_t tcp_mux_request(tcp_mux *mux, const uint8_t *data, uint32_t n, uint32_t timeout_ms, tcp_mux_cb cb, void *arg);
+
+// 正在进行的请求数
+uint32_t tcp_mux_inflight(const tcp_mux *mux);
+
+// 连接是否已断开
+int tcp_mux_closed(const tcp_mux *mux);
+
+// 发送缓冲区是否达到高水位，达到时应暂停发送请求
+int tcp_mux_over_high_water(const tcp_mux *mux);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __TCP_MUX_H__ */
@@ -0,0 +1,344 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "tcp_pool.h"
+
+// 后台线程的检查间隔
+#define POOL_MAINTAIN_INTERVAL_MS	100
+
+struct tcp_pool_endpoint {
+	char ip[64];
+	uint16_t port;
+	tcp_pool_conn *idle;		// 空闲连接，最近归还的在前面
+	uint32_t idle_count;
+	uint32_t checking;			// 后台线程取出来在锁外检查的空闲连接数
+	uint32_t total;				// 空闲 + 借出 + 正在建立 + 正在检查
+	tcp_pool_endpoint *next;
+};
+
+struct tcp_pool {
+	tcp_pool_config cfg;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;		// 有连接归还，或者连接总数减少
+	pthread_cond_t wakeup;		// 唤醒后台线程
+	pthread_t thread;
+	int stopped;
+	tcp_pool_endpoint *endpoints;
+};
+
+static uint64_t pool_now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void pool_deadline(struct timespec *ts, uint32_t timeout_ms) {
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	ts->tv_sec += timeout_ms / 1000;
+	ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+// 空闲的连接不应该有数据可读：读到0表示对端已关闭，读到数据说明协议状态已经乱了
+static int pool_healthy(tcp_pool_conn *conn) {
+	char c;
+	ssize_t n = recv(conn->sock.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// 需要持有锁
+static tcp_pool_endpoint* pool_find(tcp_pool *pool, const char *ip, uint16_t port, int create) {
+	tcp_pool_endpoint *ep;
+
+	for (ep = pool->endpoints; ep; ep = ep->next) {
+		if (ep->port == port && 0 == strcmp(ep->ip, ip)) {
+			return ep;
+		}
+	}
+	if (!create || strlen(ip) >= sizeof(ep->ip)) {
+		return NULL;
+	}
+	ep = (tcp_pool_endpoint*)calloc(1, sizeof(tcp_pool_endpoint));
+	if (!ep) {
+		return NULL;
+	}
+	strcpy(ep->ip, ip);
+	ep->port = port;
+	ep->next = pool->endpoints;
+	pool->endpoints = ep;
+	return ep;
+}
+
+// 建立一个新连接，调用前已经在ep->total中占了位置，不持有锁
+static tcp_pool_conn* pool_connect(tcp_pool *pool, tcp_pool_endpoint *ep) {
+	tcp_pool_conn *conn = (tcp_pool_conn*)malloc(sizeof(tcp_pool_conn));
+	if (!conn) {
+		return NULL;
+	}
+	if (tcp_connect(&conn->sock, (uint8_t*)ep->ip, ep->port, pool->cfg.connect_timeout_ms) < 0) {
+		tcp_close(&conn->sock);
+		free(conn);
+		return NULL;
+	}
+	conn->ep = ep;
+	conn->last_used_ms = pool_now_ms();
+	conn->next = NULL;
+	return conn;
+}
+
+static void pool_close_conn(tcp_pool_conn *conn) {
+	tcp_close(&conn->sock);
+	free(conn);
+}
+
+// 关闭空闲太久的多余连接，以及已经断开的空闲连接
+// 调用时持有锁，返回时仍持有锁；健康检查和关闭连接都在锁外进行，不阻塞tcp_pool_get
+static void pool_evict(tcp_pool *pool, tcp_pool_endpoint *ep, uint64_t now) {
+	tcp_pool_conn *checking, *expired = NULL, *alive = NULL, *conn, **pp;
+	uint32_t kept = 0, count = 0, closed = 0;
+
+	// 空闲太久的直接摘下来，其余的整个取出来检查，检查期间tcp_pool_get等待而不是新建连接
+	for (pp = &ep->idle; *pp; ) {
+		conn = *pp;
+		if (pool->cfg.idle_timeout_ms > 0 && kept >= pool->cfg.min_idle
+			&& now - conn->last_used_ms >= pool->cfg.idle_timeout_ms) {
+			*pp = conn->next;
+			conn->next = expired;
+			expired = conn;
+			closed++;
+			continue;
+		}
+		kept++;
+		pp = &conn->next;
+	}
+	checking = ep->idle;
+	ep->idle = NULL;
+	ep->idle_count = 0;
+	ep->checking = kept;
+	pthread_mutex_unlock(&pool->mutex);
+
+	while (expired) {
+		conn = expired;
+		expired = conn->next;
+		pool_close_conn(conn);
+	}
+	// 保持原来的顺序，放回时接在检查期间归还的连接后面
+	pp = &alive;
+	while (checking) {
+		conn = checking;
+		checking = conn->next;
+		if (pool_healthy(conn)) {
+			*pp = conn;
+			pp = &conn->next;
+			count++;
+		} else {
+			pool_close_conn(conn);
+			closed++;
+		}
+	}
+	*pp = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (pp = &ep->idle; *pp; pp = &(*pp)->next) {
+	}
+	*pp = alive;
+	ep->idle_count += count;
+	ep->checking = 0;
+	ep->total -= closed;
+	pthread_cond_broadcast(&pool->cond);
+}
+
+static void* pool_maintain(void *arg) {
+	tcp_pool *pool = (tcp_pool*)arg;
+	tcp_pool_endpoint *ep;
+	struct timespec ts;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (!pool->stopped) {
+		uint64_t now = pool_now_ms();
+		for (ep = pool->endpoints; ep && !pool->stopped; ep = ep->next) {
+			pool_evict(pool, ep, now);
+
+			// 预热：连接在锁外建立，先占住位置，避免超过上限
+			while (!pool->stopped && ep->idle_count < pool->cfg.min_idle && ep->total < pool->cfg.max_conns) {
+				tcp_pool_conn *conn;
+				ep->total++;
+				pthread_mutex_unlock(&pool->mutex);
+				conn = pool_connect(pool, ep);
+				pthread_mutex_lock(&pool->mutex);
+				if (!conn) {
+					ep->total--;
+					break;
+				}
+				conn->next = ep->idle;
+				ep->idle = conn;
+				ep->idle_count++;
+				pthread_cond_broadcast(&pool->cond);
+			}
+		}
+		pool_deadline(&ts, POOL_MAINTAIN_INTERVAL_MS);
+		pthread_cond_timedwait(&pool->wakeup, &pool->mutex, &ts);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+tcp_pool* tcp_pool_create(const tcp_pool_config *cfg) {
+	tcp_pool *pool = (tcp_pool*)calloc(1, sizeof(tcp_pool));
+	pthread_condattr_t attr;
+
+	if (!pool) return NULL;
+	pool->cfg = *cfg;
+	if (0 == pool->cfg.max_conns) pool->cfg.max_conns = 64;
+	if (pool->cfg.min_idle > pool->cfg.max_conns) pool->cfg.min_idle = pool->cfg.max_conns;
+	if (0 == pool->cfg.connect_timeout_ms) pool->cfg.connect_timeout_ms = 1000;
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&pool->cond, &attr);
+	pthread_cond_init(&pool->wakeup, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (pthread_create(&pool->thread, NULL, pool_maintain, pool) != 0) {
+		pthread_mutex_destroy(&pool->mutex);
+		pthread_cond_destroy(&pool->cond);
+		pthread_cond_destroy(&pool->wakeup);
+		free(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+void tcp_pool_destroy(tcp_pool *pool) {
+	tcp_pool_endpoint *ep;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stopped = 1;
+	pthread_cond_broadcast(&pool->wakeup);
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+	pthread_join(pool->thread, NULL);
+
+	while ((ep = pool->endpoints) != NULL) {
+		pool->endpoints = ep->next;
+		while (ep->idle) {
+			tcp_pool_conn *conn = ep->idle;
+			ep->idle = conn->next;
+			pool_close_conn(conn);
+		}
+		free(ep);
+	}
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->cond);
+	pthread_cond_destroy(&pool->wakeup);
+	free(pool);
+}
+
+int32_t tcp_pool_warm(tcp_pool *pool, const char *ip, uint16_t port) {
+	tcp_pool_endpoint *ep;
+
+	pthread_mutex_lock(&pool->mutex);
+	ep = pool_find(pool, ip, port, 1);
+	if (ep) {
+		pthread_cond_signal(&pool->wakeup);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return ep ? 0 : -1;
+}
+
+tcp_pool_conn* tcp_pool_get(tcp_pool *pool, const char *ip, uint16_t port, uint32_t timeout_ms) {
+	tcp_pool_endpoint *ep;
+	tcp_pool_conn *conn;
+	struct timespec ts;
+
+	pool_deadline(&ts, timeout_ms);
+	pthread_mutex_lock(&pool->mutex);
+	ep = pool_find(pool, ip, port, 1);
+
+	while (ep && !pool->stopped) {
+		if (ep->idle) {
+			conn = ep->idle;
+			ep->idle = conn->next;
+			ep->idle_count--;
+			if (ep->idle_count < pool->cfg.min_idle) {
+				// 让后台线程补充空闲连接
+				pthread_cond_signal(&pool->wakeup);
+			}
+			pthread_mutex_unlock(&pool->mutex);
+
+			if (pool_healthy(conn)) {
+				conn->next = NULL;
+				return conn;
+			}
+			pool_close_conn(conn);
+			pthread_mutex_lock(&pool->mutex);
+			ep->total--;
+			continue;
+		}
+
+		// 空闲连接正在被后台线程检查，很快就会放回
+		if (ep->total < pool->cfg.max_conns && 0 == ep->checking) {
+			ep->total++;
+			pthread_mutex_unlock(&pool->mutex);
+			conn = pool_connect(pool, ep);
+			if (conn) {
+				return conn;
+			}
+			pthread_mutex_lock(&pool->mutex);
+			ep->total--;
+			pthread_cond_broadcast(&pool->cond);
+			break;
+		}
+
+		// 达到上限，等待其他线程归还或者检查结束
+		if (pthread_cond_timedwait(&pool->cond, &pool->mutex, &ts) == ETIMEDOUT) {
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+void tcp_pool_put(tcp_pool *pool, tcp_pool_conn *conn, int reusable) {
+	tcp_pool_endpoint *ep = conn->ep;
+	uint64_t now = pool_now_ms();
+
+	pthread_mutex_lock(&pool->mutex);
+	if (reusable && !pool->stopped) {
+		conn->last_used_ms = now;
+		conn->next = ep->idle;
+		ep->idle = conn;
+		ep->idle_count++;
+		conn = NULL;
+	} else {
+		ep->total--;
+	}
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (conn) {
+		pool_close_conn(conn);
+	}
+}
+
+int32_t tcp_pool_stats(tcp_pool *pool, const char *ip, uint16_t port, uint32_t *idle, uint32_t *total) {
+	tcp_pool_endpoint *ep;
+
+	pthread_mutex_lock(&pool->mutex);
+	ep = pool_find(pool, ip, port, 0);
+	if (ep) {
+		if (idle) *idle = ep->idle_count;
+		if (total) *total = ep->total;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return ep ? 0 : -1;
+}
@@ -0,0 +1,64 @@
+#ifndef __TCP_POOL_H__
+#define __TCP_POOL_H__
+
+#include <stdint.h>
+#include "tcpclient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 线程安全的连接池，按(ip, port)分组：
+//   1. tcp_pool_get优先取空闲连接，取出前用MSG_PEEK|MSG_DONTWAIT检查连接是否还活着，不需要往返
+//   2. 后台线程为每个注册过的地址预先建立min_idle个空闲连接，并关闭空闲超过idle_timeout_ms的多余连接，
+//      请求路径上通常不需要三次握手
+//   3. 每个地址的连接总数（空闲+借出）不超过max_conns，达到上限时tcp_pool_get等待其他线程归还
+//
+// 借出的连接是tcp_connect建立的tcp_socket，设置了O_NONBLOCK，可以直接用tcp_read/tcp_write（它们内部等待可读/可写），
+// 也可以交给tcp_loop或者用tcp_nb_read/tcp_nb_write
+
+typedef struct tcp_pool tcp_pool;
+typedef struct tcp_pool_endpoint tcp_pool_endpoint;
+
+typedef struct tcp_pool_conn {
+	tcp_socket sock;
+
+	// 以下由tcp_pool维护
+	tcp_pool_endpoint *ep;
+	uint64_t last_used_ms;
+	struct tcp_pool_conn *next;
+} tcp_pool_conn;
+
+typedef struct {
+	uint32_t min_idle;				// 每个地址保持的最少空闲连接数
+	uint32_t max_conns;				// 每个地址的最多连接数
+	uint32_t idle_timeout_ms;		// 超过min_idle的空闲连接空闲这么久后关闭，0表示不关闭
+	uint32_t connect_timeout_ms;
+} tcp_pool_config;
+
+// 失败返回NULL
+tcp_pool* tcp_pool_create(const tcp_pool_config *cfg);
+
+// 停止后台线程，关闭所有空闲连接，借出的连接需要先归还
+void tcp_pool_destroy(tcp_pool *pool);
+
+// 注册地址并立即开始在后台预热，不等待；tcp_pool_get也会自动注册
+int32_t tcp_pool_warm(tcp_pool *pool, const char *ip, uint16_t port);
+
+/*
+ * 借出一个连接，没有空闲连接时新建；连接数达到上限时最多等待timeout_ms
+ * 返回NULL：表示连接失败或者等待超时
+ */
+tcp_pool_conn* tcp_pool_get(tcp_pool *pool, const char *ip, uint16_t port, uint32_t timeout_ms);
+
+// 归还连接，reusable为0时（例如读写出错、协议状态不确定）直接关闭
+void tcp_pool_put(tcp_pool *pool, tcp_pool_conn *conn, int reusable);
+
+// 查询某个地址当前的空闲连接数和连接总数，地址不存在返回-1
+int32_t tcp_pool_stats(tcp_pool *pool, const char *ip, uint16_t port, uint32_t *idle, uint32_t *total);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __TCP_POOL_H__ */
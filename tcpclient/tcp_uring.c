@@ -0,0 +1,863 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "tcp_uring.h"
+
+#define OP_CONNECT		1
+#define OP_RECV			2
+#define OP_SEND			3
+#define OP_CANCEL		4	// io_uring后端关闭连接时取消所有操作
+#define OP_CLOSE		5	// epoll后端关闭连接
+#define OP_RECV_START	6	// epoll后端开始接收时若已经可读，在下一轮循环中读取
+
+#define FALLBACK_WRITER_SIZE	(256 * 1024)
+
+// 一个未完成的操作，io_uring后端的user_data指向它
+typedef struct tcp_uring_op {
+	struct tcp_uring_op *next;
+	tcp_uring_conn *conn;
+	int type;
+	int32_t res;
+	const uint8_t *buf;
+	uint32_t len;
+	uint32_t done;
+} tcp_uring_op;
+
+struct tcp_uring {
+	int backend;
+	int stopped;
+	uint64_t syscalls;
+	uint32_t active_ops;		// 已分配还没有释放的操作数
+
+	tcp_uring_op *free_ops;
+
+	// 已经完成、等待在run_once中分发的操作
+	tcp_uring_op *done_head;
+	tcp_uring_op *done_tail;
+
+	uint32_t buf_count;
+	uint32_t buf_size;
+	uint8_t *bufs;				// 接收buffer
+
+	// io_uring后端
+	int fd;
+	unsigned sq_entries;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	unsigned sq_local_tail;		// 已经填写的位置，提交时写入*sq_tail
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr;
+	void *cq_ptr;
+	size_t sq_size;
+	size_t cq_size;
+	size_t sqes_size;
+	struct io_uring_buf_ring *br;
+	size_t br_size;
+	uint16_t br_tail;
+	int no_multishot;			// 内核不支持multishot recv
+
+	// epoll后端
+	tcp_loop *loop;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// ----------------------------------------------------------------
+// 操作的分配和完成
+
+static tcp_uring_op* op_alloc(tcp_uring *ring, tcp_uring_conn *conn, int type) {
+	tcp_uring_op *op = ring->free_ops;
+	if (op) {
+		ring->free_ops = op->next;
+	} else {
+		op = (tcp_uring_op*)malloc(sizeof(tcp_uring_op));
+		if (!op) return NULL;
+	}
+	memset(op, 0, sizeof(*op));
+	op->conn = conn;
+	op->type = type;
+	conn->inflight++;
+	ring->active_ops++;
+	return op;
+}
+
+static void op_free(tcp_uring *ring, tcp_uring_op *op) {
+	op->next = ring->free_ops;
+	ring->free_ops = op;
+	ring->active_ops--;
+}
+
+static void op_defer(tcp_uring *ring, tcp_uring_op *op, int32_t res) {
+	op->res = res;
+	op->next = NULL;
+	if (ring->done_tail) {
+		ring->done_tail->next = op;
+	} else {
+		ring->done_head = op;
+	}
+	ring->done_tail = op;
+}
+
+// 一个操作结束，conn已经在关闭并且没有其他操作时关闭socket并通知调用者，此后不能再访问conn
+static void conn_op_done(tcp_uring *ring, tcp_uring_conn *conn) {
+	if (--conn->inflight > 0 || !conn->closing) {
+		return;
+	}
+	if (conn->writer) {
+		tcp_writer_destroy(conn->writer);
+		conn->writer = NULL;
+	}
+	tcp_close(&conn->sock);
+	conn->sock.fd = -1;
+	conn->cb(ring, conn, TCP_URING_OP_CLOSE, 0, NULL);
+}
+
+// 关闭时把还没有发出的send都以-ECANCELED结束
+static void conn_cancel_queued_sends(tcp_uring *ring, tcp_uring_conn *conn, tcp_uring_op *keep) {
+	tcp_uring_op *op = conn->send_head;
+	conn->send_head = conn->send_tail = keep;
+	while (op) {
+		tcp_uring_op *next = op->next;
+		if (op != keep) {
+			op_defer(ring, op, -ECANCELED);
+		}
+		op = next;
+	}
+	if (keep) keep->next = NULL;
+}
+
+// ----------------------------------------------------------------
+// io_uring后端
+
+static struct io_uring_sqe* uring_get_sqe(tcp_uring *ring) {
+	struct io_uring_sqe *sqe;
+
+	if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+		// 提交队列满了，先提交一次
+		__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+		ring->syscalls++;
+		sys_io_uring_enter(ring->fd, ring->sq_entries, 0, 0, NULL, 0);
+		if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+			return NULL;
+		}
+	}
+	sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+	ring->sq_local_tail++;
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+static int uring_prep_recv(tcp_uring *ring, tcp_uring_op *op) {
+	struct io_uring_sqe *sqe = uring_get_sqe(ring);
+	if (!sqe) return -1;
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = op->conn->sock.fd;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->ioprio = ring->no_multishot ? 0 : IORING_RECV_MULTISHOT;
+	sqe->user_data = (uint64_t)(uintptr_t)op;
+	return 0;
+}
+
+static int uring_prep_send(tcp_uring *ring, tcp_uring_op *op) {
+	struct io_uring_sqe *sqe = uring_get_sqe(ring);
+	if (!sqe) return -1;
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = op->conn->sock.fd;
+	sqe->addr = (uint64_t)(uintptr_t)(op->buf + op->done);
+	sqe->len = op->len - op->done;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = (uint64_t)(uintptr_t)op;
+	return 0;
+}
+
+// 把接收buffer还给内核
+static void uring_recycle_buf(tcp_uring *ring, uint16_t bid) {
+	struct io_uring_buf *b = &ring->br->bufs[ring->br_tail & (ring->buf_count - 1)];
+	b->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)bid * ring->buf_size);
+	b->len = ring->buf_size;
+	b->bid = bid;
+	ring->br_tail++;
+	__atomic_store_n(&ring->br->tail, ring->br_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_complete(tcp_uring *ring, tcp_uring_op *op, int32_t res, uint32_t flags) {
+	tcp_uring_conn *conn = op->conn;
+	const uint8_t *buf;
+
+	switch (op->type) {
+	case OP_CONNECT:
+		conn->connect_op = NULL;
+		op_free(ring, op);
+		conn->cb(ring, conn, TCP_URING_OP_CONNECT, res, NULL);
+		conn_op_done(ring, conn);
+		break;
+
+	case OP_SEND:
+		if (res > 0 && op->done + res < op->len) {
+			// 只发出了一部分，继续发送剩余的数据
+			if (conn->closing) {
+				res = -ECANCELED;
+			} else {
+				op->done += res;
+				if (0 == uring_prep_send(ring, op)) {
+					break;
+				}
+				res = -EBUSY;
+			}
+		} else if (0 == res) {
+			res = -EPIPE;
+		}
+		conn->send_head = op->next;
+		if (!conn->send_head) conn->send_tail = NULL;
+		if (conn->send_head && !conn->closing && uring_prep_send(ring, conn->send_head) < 0) {
+			conn_cancel_queued_sends(ring, conn, NULL);
+		}
+		buf = op->buf;
+		if (res >= 0) res = (int32_t)op->len;
+		op_free(ring, op);
+		conn->cb(ring, conn, TCP_URING_OP_SEND, res, buf);
+		conn_op_done(ring, conn);
+		break;
+
+	case OP_RECV:
+		if (res > 0) {
+			uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+			conn->cb(ring, conn, TCP_URING_OP_RECV, res, ring->bufs + (size_t)bid * ring->buf_size);
+			uring_recycle_buf(ring, bid);
+		}
+		if (flags & IORING_CQE_F_MORE) {
+			break;
+		}
+		if (-EINVAL == res && !ring->no_multishot) {
+			// 内核不支持multishot recv，改用单次recv
+			ring->no_multishot = 1;
+		}
+		// 单次recv完成，或者multishot因为buffer用完等原因结束，需要重新提交
+		if (!conn->closing && (res > 0 || -ENOBUFS == res || (-EINVAL == res && ring->no_multishot && op->done++ == 0))) {
+			if (0 == uring_prep_recv(ring, op)) {
+				break;
+			}
+			res = -EBUSY;
+		}
+		conn->recv_op = NULL;
+		op_free(ring, op);
+		if (res <= 0) {
+			conn->cb(ring, conn, TCP_URING_OP_RECV, res, NULL);
+		}
+		conn_op_done(ring, conn);
+		break;
+
+	case OP_CANCEL:
+		op_free(ring, op);
+		conn_op_done(ring, conn);
+		break;
+	}
+}
+
+static int uring_reap(tcp_uring *ring) {
+	int count = 0;
+	unsigned head = *ring->cq_head;
+
+	while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		struct io_uring_cqe cqe = ring->cqes[head & ring->cq_mask];
+		head++;
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+		uring_complete(ring, (tcp_uring_op*)(uintptr_t)cqe.user_data, cqe.res, cqe.flags);
+		count++;
+	}
+	return count;
+}
+
+static int uring_wait(tcp_uring *ring, int timeout_ms) {
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned to_submit, flags = IORING_ENTER_GETEVENTS;
+	int ready;
+
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+	to_submit = ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	ready = *ring->cq_head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+	// 没有要提交的操作，并且已经有完成通知时不需要系统调用
+	if (0 == to_submit && ready) {
+		return 0;
+	}
+
+	memset(&arg, 0, sizeof(arg));
+	if (timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+	}
+	flags |= IORING_ENTER_EXT_ARG;
+
+	ring->syscalls++;
+	if (sys_io_uring_enter(ring->fd, to_submit, (timeout_ms == 0 || ready) ? 0 : 1, flags, &arg, sizeof(arg)) < 0) {
+		if (errno != EINTR && errno != ETIME && errno != EBUSY && errno != EAGAIN) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void uring_unmap(tcp_uring *ring) {
+	if (ring->br) {
+		munmap(ring->br, ring->br_size);
+	}
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) {
+		munmap(ring->cq_ptr, ring->cq_size);
+	}
+	if (ring->sq_ptr) {
+		munmap(ring->sq_ptr, ring->sq_size);
+	}
+	if (ring->fd >= 0) {
+		close(ring->fd);
+	}
+	ring->br = NULL;
+	ring->sqes = NULL;
+	ring->sq_ptr = ring->cq_ptr = NULL;
+	ring->fd = -1;
+}
+
+static int uring_init(tcp_uring *ring, uint32_t entries) {
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	unsigned *sq_array;
+	unsigned i;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+	p.cq_entries = entries * 4;
+	ring->fd = sys_io_uring_setup(entries, &p);
+	if (ring->fd < 0 && EINVAL == errno) {
+		// 较老的内核不认识后两个标志
+		memset(&p, 0, sizeof(p));
+		p.flags = IORING_SETUP_CQSIZE;
+		p.cq_entries = entries * 4;
+		ring->fd = sys_io_uring_setup(entries, &p);
+	}
+	if (ring->fd < 0) {
+		return -1;
+	}
+	if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+		uring_unmap(ring);
+		return -1;
+	}
+
+	ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+		ring->cq_size = ring->sq_size;
+	}
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (MAP_FAILED == ring->sq_ptr) {
+		ring->sq_ptr = NULL;
+		uring_unmap(ring);
+		return -1;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (MAP_FAILED == ring->cq_ptr) {
+			ring->cq_ptr = NULL;
+			uring_unmap(ring);
+			return -1;
+		}
+	}
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (MAP_FAILED == (void*)ring->sqes) {
+		ring->sqes = NULL;
+		uring_unmap(ring);
+		return -1;
+	}
+
+	sq = (char*)ring->sq_ptr;
+	cq = (char*)ring->cq_ptr;
+	ring->sq_entries = p.sq_entries;
+	ring->sq_head = (unsigned*)(sq + p.sq_off.head);
+	ring->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	ring->sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+	ring->sq_local_tail = *ring->sq_tail;
+	sq_array = (unsigned*)(sq + p.sq_off.array);
+	for (i = 0; i < p.sq_entries; ++i) {
+		sq_array[i] = i;
+	}
+	ring->cq_head = (unsigned*)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	ring->cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	// 注册接收buffer环，之后recv由内核从中挑选buffer
+	ring->br_size = ring->buf_count * sizeof(struct io_uring_buf);
+	ring->br = (struct io_uring_buf_ring*)mmap(NULL, ring->br_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == (void*)ring->br) {
+		ring->br = NULL;
+		uring_unmap(ring);
+		return -1;
+	}
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)ring->br;
+	reg.ring_entries = ring->buf_count;
+	reg.bgid = 0;
+	if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		uring_unmap(ring);
+		return -1;
+	}
+	ring->br_tail = 0;
+	for (i = 0; i < ring->buf_count; ++i) {
+		uring_recycle_buf(ring, (uint16_t)i);
+	}
+
+	return 0;
+}
+
+// ----------------------------------------------------------------
+// epoll后端：连接、接收的结果在tcp_loop的回调中直接通知，send的结果放入done链表
+
+static void fallback_fail_sends(tcp_uring *ring, tcp_uring_conn *conn, int32_t res) {
+	tcp_uring_op *op = conn->send_head;
+	conn->send_head = conn->send_tail = NULL;
+	while (op) {
+		tcp_uring_op *next = op->next;
+		op_defer(ring, op, res);
+		op = next;
+	}
+}
+
+// 把排队的send放入tcp_writer，完整放入的send视为完成，然后尽量发出
+static void fallback_pump_send(tcp_uring *ring, tcp_uring_conn *conn) {
+	uint64_t before = tcp_writer_syscalls(conn->writer);
+	tcp_uring_op *op;
+	int32_t n;
+	int want;
+
+	while ((op = conn->send_head) != NULL) {
+		n = tcp_writer_write(conn->writer, op->buf + op->done, op->len - op->done);
+		if (n < 0) {
+			fallback_fail_sends(ring, conn, -EPIPE);
+			break;
+		}
+		op->done += n;
+		if (op->done < op->len) {
+			break;
+		}
+		conn->send_head = op->next;
+		if (!conn->send_head) conn->send_tail = NULL;
+		op_defer(ring, op, (int32_t)op->len);
+	}
+
+	n = tcp_writer_flush(conn->writer);
+	if (n < 0) {
+		fallback_fail_sends(ring, conn, -EPIPE);
+	}
+	ring->syscalls += tcp_writer_syscalls(conn->writer) - before;
+
+	want = (0 == n || conn->send_head != NULL);
+	if (want) ring->syscalls++;		// epoll_ctl
+	tcp_loop_want_write(ring->loop, &conn->loop_conn, want);
+}
+
+// 结束接收，通知res
+static void fallback_end_recv(tcp_uring *ring, tcp_uring_conn *conn, int32_t res) {
+	op_free(ring, conn->recv_op);
+	conn->recv_op = NULL;
+	conn->cb(ring, conn, TCP_URING_OP_RECV, res, NULL);
+	conn_op_done(ring, conn);
+}
+
+// 边缘触发，一直读到EAGAIN
+static void fallback_read(tcp_uring *ring, tcp_uring_conn *conn) {
+	int32_t n;
+
+	conn->readable = 0;
+	while (conn->recv_op && !conn->closing) {
+		ring->syscalls++;
+		n = tcp_nb_read(&conn->sock, ring->bufs, ring->buf_size);
+		if (0 == n) {
+			break;
+		}
+		if (n < 0) {
+			fallback_end_recv(ring, conn, 0);
+			break;
+		}
+		conn->cb(ring, conn, TCP_URING_OP_RECV, n, ring->bufs);
+	}
+}
+
+// tcp_uring_close总是通过done链表中的OP_CLOSE完成，所以这里的回调不会释放conn
+static void fallback_event(tcp_loop *loop, tcp_conn *lconn, uint32_t events) {
+	tcp_uring_conn *conn = (tcp_uring_conn*)lconn->udata;
+	tcp_uring *ring = conn->ring;
+	tcp_uring_op *op;
+
+	(void)loop;
+	if (conn->connect_op) {
+		op = conn->connect_op;
+		if (events & (TCP_EV_ERROR | TCP_EV_TIMEOUT)) {
+			// tcp_loop已经取走了SO_ERROR，这里无法区分具体原因
+			conn->connect_op = NULL;
+			op_free(ring, op);
+			conn->cb(ring, conn, TCP_URING_OP_CONNECT, -ECONNREFUSED, NULL);
+			conn_op_done(ring, conn);
+			return;
+		}
+		if (!(events & TCP_EV_CONNECTED)) {
+			return;
+		}
+		conn->connected = 1;
+		conn->connect_op = NULL;
+		op_free(ring, op);
+		conn->cb(ring, conn, TCP_URING_OP_CONNECT, 0, NULL);
+		conn_op_done(ring, conn);
+		if (!conn->closing && conn->send_head) {
+			fallback_pump_send(ring, conn);
+		}
+	}
+	if (conn->closing) {
+		return;
+	}
+
+	if (events & TCP_EV_ERROR) {
+		fallback_fail_sends(ring, conn, -EIO);
+		if (conn->recv_op) {
+			fallback_end_recv(ring, conn, -EIO);
+		}
+		return;
+	}
+	if (events & TCP_EV_READ) {
+		if (conn->recv_op) {
+			fallback_read(ring, conn);
+		} else {
+			conn->readable = 1;
+		}
+	}
+	if (!conn->closing && (events & TCP_EV_WRITE)) {
+		fallback_pump_send(ring, conn);
+	}
+}
+
+// ----------------------------------------------------------------
+
+// 分发done链表中的操作
+static int dispatch_deferred(tcp_uring *ring) {
+	int count = 0;
+	tcp_uring_op *op;
+
+	while ((op = ring->done_head) != NULL) {
+		tcp_uring_conn *conn = op->conn;
+		const uint8_t *buf = op->buf;
+		int32_t res = op->res;
+		int type = op->type;
+
+		ring->done_head = op->next;
+		if (!ring->done_head) ring->done_tail = NULL;
+		op_free(ring, op);
+		count++;
+
+		switch (type) {
+		case OP_CONNECT:
+			conn->cb(ring, conn, TCP_URING_OP_CONNECT, res, NULL);
+			break;
+		case OP_SEND:
+			conn->cb(ring, conn, TCP_URING_OP_SEND, res, buf);
+			break;
+		case OP_RECV:
+			conn->cb(ring, conn, TCP_URING_OP_RECV, res, NULL);
+			break;
+		case OP_RECV_START:
+			if (conn->readable && conn->recv_op && !conn->closing) {
+				fallback_read(ring, conn);
+			}
+			break;
+		}
+		conn_op_done(ring, conn);
+	}
+	return count;
+}
+
+tcp_uring* tcp_uring_create(uint32_t entries, uint32_t buf_count, uint32_t buf_size, int flags) {
+	tcp_uring *ring = (tcp_uring*)calloc(1, sizeof(tcp_uring));
+	if (!ring) return NULL;
+
+	if (0 == entries) entries = 256;
+	if (0 == buf_size) buf_size = 16 * 1024;
+	ring->buf_count = 1;
+	while (ring->buf_count < buf_count) {
+		ring->buf_count <<= 1;
+	}
+	ring->buf_size = buf_size;
+	ring->fd = -1;
+	ring->bufs = (uint8_t*)malloc((size_t)ring->buf_count * buf_size);
+	if (!ring->bufs) {
+		free(ring);
+		return NULL;
+	}
+
+	if (!(flags & TCP_URING_FORCE_EPOLL) && 0 == uring_init(ring, entries)) {
+		ring->backend = TCP_URING_BACKEND_IO_URING;
+		return ring;
+	}
+
+	ring->loop = tcp_loop_create((int)entries);
+	if (!ring->loop) {
+		free(ring->bufs);
+		free(ring);
+		return NULL;
+	}
+	ring->backend = TCP_URING_BACKEND_EPOLL;
+	return ring;
+}
+
+void tcp_uring_destroy(tcp_uring *ring) {
+	tcp_uring_op *op;
+
+	if (TCP_URING_BACKEND_IO_URING == ring->backend) {
+		uring_unmap(ring);
+	} else {
+		tcp_loop_destroy(ring->loop);
+	}
+	while ((op = ring->free_ops) != NULL) {
+		ring->free_ops = op->next;
+		free(op);
+	}
+	free(ring->bufs);
+	free(ring);
+}
+
+int tcp_uring_backend(const tcp_uring *ring) {
+	return ring->backend;
+}
+
+// 操作还没有开始就失败了，不通知调用者
+static void op_cancel(tcp_uring *ring, tcp_uring_op *op) {
+	op->conn->inflight--;
+	op_free(ring, op);
+}
+
+int32_t tcp_uring_connect(tcp_uring *ring, tcp_uring_conn *conn, const char *ip, uint16_t port, tcp_uring_cb cb, void *udata) {
+	struct io_uring_sqe *sqe;
+	tcp_uring_op *op;
+
+	memset(conn, 0, sizeof(*conn));
+	conn->sock.fd = -1;
+	conn->cb = cb;
+	conn->udata = udata;
+	conn->ring = ring;
+	conn->addr.sin_family = AF_INET;
+	conn->addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, ip, &conn->addr.sin_addr) != 1) {
+		return -1;
+	}
+
+	if (TCP_URING_BACKEND_EPOLL == ring->backend) {
+		conn->writer = tcp_writer_create(&conn->sock, FALLBACK_WRITER_SIZE, 0);
+		if (!conn->writer) {
+			return -1;
+		}
+		if (tcp_loop_connect(ring->loop, &conn->loop_conn, ip, port, 0, fallback_event, conn) < 0) {
+			tcp_writer_destroy(conn->writer);
+			conn->writer = NULL;
+			return -1;
+		}
+		conn->sock = conn->loop_conn.sock;
+		conn->connect_op = op_alloc(ring, conn, OP_CONNECT);
+		return 0;
+	}
+
+	// io_uring对非阻塞socket不会等待就绪，所以这里使用阻塞socket
+	conn->sock.fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (conn->sock.fd < 0) {
+		return -1;
+	}
+	op = op_alloc(ring, conn, OP_CONNECT);
+	sqe = op ? uring_get_sqe(ring) : NULL;
+	if (!sqe) {
+		if (op) op_cancel(ring, op);
+		tcp_close(&conn->sock);
+		conn->sock.fd = -1;
+		return -1;
+	}
+	sqe->opcode = IORING_OP_CONNECT;
+	sqe->fd = conn->sock.fd;
+	sqe->addr = (uint64_t)(uintptr_t)&conn->addr;
+	sqe->off = sizeof(conn->addr);
+	sqe->user_data = (uint64_t)(uintptr_t)op;
+	conn->connect_op = op;
+	return 0;
+}
+
+int32_t tcp_uring_recv(tcp_uring *ring, tcp_uring_conn *conn) {
+	tcp_uring_op *op;
+
+	if (conn->recv_op || conn->closing) {
+		return -1;
+	}
+	op = op_alloc(ring, conn, OP_RECV);
+	if (!op) {
+		return -1;
+	}
+
+	if (TCP_URING_BACKEND_EPOLL == ring->backend) {
+		conn->recv_op = op;
+		// 已经可读的数据在下一轮循环中读取，不在这里直接回调
+		if (conn->readable) {
+			tcp_uring_op *kick = op_alloc(ring, conn, OP_RECV_START);
+			if (kick) op_defer(ring, kick, 0);
+		}
+		return 0;
+	}
+
+	if (uring_prep_recv(ring, op) < 0) {
+		op_cancel(ring, op);
+		return -1;
+	}
+	conn->recv_op = op;
+	return 0;
+}
+
+int32_t tcp_uring_send(tcp_uring *ring, tcp_uring_conn *conn, const uint8_t *buf, uint32_t n) {
+	tcp_uring_op *op;
+
+	if (conn->closing || 0 == n) {
+		return -1;
+	}
+	op = op_alloc(ring, conn, OP_SEND);
+	if (!op) {
+		return -1;
+	}
+	op->buf = buf;
+	op->len = n;
+
+	if (conn->send_tail) {
+		// 前面还有send没有完成，排队等待
+		conn->send_tail->next = op;
+		conn->send_tail = op;
+		return 0;
+	}
+	conn->send_head = conn->send_tail = op;
+
+	if (TCP_URING_BACKEND_EPOLL == ring->backend) {
+		if (conn->connected) {
+			fallback_pump_send(ring, conn);
+		}
+		return 0;
+	}
+
+	if (uring_prep_send(ring, op) < 0) {
+		conn->send_head = conn->send_tail = NULL;
+		op_cancel(ring, op);
+		return -1;
+	}
+	return 0;
+}
+
+void tcp_uring_close(tcp_uring *ring, tcp_uring_conn *conn) {
+	struct io_uring_sqe *sqe;
+	tcp_uring_op *op;
+
+	if (conn->closing) {
+		return;
+	}
+	conn->closing = 1;
+
+	if (TCP_URING_BACKEND_EPOLL == ring->backend) {
+		tcp_loop_remove(ring->loop, &conn->loop_conn);
+		if (conn->connect_op) {
+			op_defer(ring, conn->connect_op, -ECANCELED);
+			conn->connect_op = NULL;
+		}
+		fallback_fail_sends(ring, conn, -ECANCELED);
+		if (conn->recv_op) {
+			op_defer(ring, conn->recv_op, -ECANCELED);
+			conn->recv_op = NULL;
+		}
+		op = op_alloc(ring, conn, OP_CLOSE);
+		if (op) op_defer(ring, op, 0);
+		return;
+	}
+
+	// 正在内核中的send由取消操作结束，排队的直接结束
+	conn_cancel_queued_sends(ring, conn, conn->send_head);
+	op = op_alloc(ring, conn, OP_CANCEL);
+	if (!op) {
+		return;
+	}
+	sqe = uring_get_sqe(ring);
+	if (!sqe) {
+		// 提交队列一直是满的，通过shutdown让正在进行的操作结束
+		shutdown(conn->sock.fd, SHUT_RDWR);
+		op_defer(ring, op, 0);
+		return;
+	}
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = conn->sock.fd;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	sqe->user_data = (uint64_t)(uintptr_t)op;
+}
+
+int tcp_uring_run_once(tcp_uring *ring, int timeout_ms) {
+	int count = dispatch_deferred(ring);
+	if (count > 0) {
+		timeout_ms = 0;
+	}
+
+	if (TCP_URING_BACKEND_IO_URING == ring->backend) {
+		if (uring_wait(ring, timeout_ms) < 0) {
+			return -1;
+		}
+		count += uring_reap(ring);
+	} else {
+		ring->syscalls++;
+		count += tcp_loop_run_once(ring->loop, timeout_ms);
+	}
+
+	count += dispatch_deferred(ring);
+	return count;
+}
+
+void tcp_uring_run(tcp_uring *ring) {
+	ring->stopped = 0;
+	while (!ring->stopped && ring->active_ops > 0) {
+		if (tcp_uring_run_once(ring, -1) < 0) {
+			break;
+		}
+	}
+}
+
+void tcp_uring_stop(tcp_uring *ring) {
+	ring->stopped = 1;
+}
+
+uint64_t tcp_uring_syscalls(const tcp_uring *ring) {
+	return ring->syscalls;
+}
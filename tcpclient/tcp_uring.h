@@ -0,0 +1,117 @@
+#ifndef __TCP_URING_H__
+#define __TCP_URING_H__
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include "tcpclient.h"
+#include "tcp_loop.h"
+#include "tcp_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 基于完成通知的异步tcp接口，优先使用io_uring（直接调用系统调用，不依赖liburing）：
+//   1. connect/recv/send只是填写提交队列，tcp_uring_run_once时一次io_uring_enter批量提交并等待完成，
+//      大量连接的读写合计只需要很少的系统调用
+//   2. 接收使用multishot recv + 内核注册的buffer环（provided buffer ring），
+//      一次提交持续接收，不需要每次recv都准备buffer，内核不支持multishot时自动退化为单次recv
+//   3. 内核不支持io_uring（或者被禁用）时，退化为tcp_loop(epoll) + tcp_writer实现，接口和回调语义不变
+//
+// 回调的op和res：
+//   TCP_URING_OP_CONNECT  res为0表示连接成功，负数表示失败
+//   TCP_URING_OP_RECV     res>0为收到的字节数，data在回调返回后失效；res为0表示对端关闭，负数表示出错，之后不再接收
+//   TCP_URING_OP_SEND     res为发送的字节数（总是等于n），负数表示出错；data为tcp_uring_send传入的buf，此后可以复用
+//   TCP_URING_OP_CLOSE    tcp_uring_close的所有操作都已完成，socket已关闭，此后可以释放conn
+//
+// 注意：
+//   1. 同一个连接的多个send按调用顺序依次发出，buf在收到TCP_URING_OP_SEND之前必须保持有效
+//   2. 不是线程安全的，所有接口都需要在同一个线程调用
+//   3. io_uring后端需要Linux 5.19及以上（provided buffer ring），低版本使用epoll后端
+
+#define TCP_URING_OP_CONNECT	1
+#define TCP_URING_OP_RECV		2
+#define TCP_URING_OP_SEND		3
+#define TCP_URING_OP_CLOSE		4
+
+#define TCP_URING_BACKEND_IO_URING	1
+#define TCP_URING_BACKEND_EPOLL		2
+
+// tcp_uring_create的flags
+#define TCP_URING_FORCE_EPOLL	0x01	// 不尝试io_uring，直接使用epoll后端
+
+typedef struct tcp_uring tcp_uring;
+typedef struct tcp_uring_conn tcp_uring_conn;
+struct tcp_uring_op;
+
+typedef void (*tcp_uring_cb)(tcp_uring *ring, tcp_uring_conn *conn, int op, int32_t res, const uint8_t *data);
+
+struct tcp_uring_conn {
+	tcp_socket sock;
+	tcp_uring_cb cb;
+	void *udata;
+
+	// 以下由tcp_uring维护
+	tcp_uring *ring;
+	struct sockaddr_in addr;
+	struct tcp_uring_op *send_head;		// 等待发送的队列，队首正在发送
+	struct tcp_uring_op *send_tail;
+	struct tcp_uring_op *recv_op;		// 正在进行的接收
+	struct tcp_uring_op *connect_op;	// 正在进行的连接
+	uint32_t inflight;					// 还没有完成的操作数
+	int closing;
+
+	// epoll后端
+	tcp_conn loop_conn;
+	tcp_writer *writer;
+	int connected;
+	int readable;						// 收到了可读事件但是还没有开始接收
+};
+
+/*
+ * entries为提交队列大小，buf_count/buf_size为接收buffer的个数（2的幂）和大小
+ * 失败返回NULL
+ */
+tcp_uring* tcp_uring_create(uint32_t entries, uint32_t buf_count, uint32_t buf_size, int flags);
+
+// 需要先关闭所有连接
+void tcp_uring_destroy(tcp_uring *ring);
+
+// 返回实际使用的后端，TCP_URING_BACKEND_IO_URING或者TCP_URING_BACKEND_EPOLL
+int tcp_uring_backend(const tcp_uring *ring);
+
+/*
+ * 初始化conn并发起连接，结果通过TCP_URING_OP_CONNECT通知
+ * 返回值为0：表示已经发起连接（无论结果如何，最终都需要tcp_uring_close）
+ * 返回值为-1：表示发起连接失败，conn没有被使用
+ */
+int32_t tcp_uring_connect(tcp_uring *ring, tcp_uring_conn *conn, const char *ip, uint16_t port, tcp_uring_cb cb, void *udata);
+
+// 开始持续接收，每收到一段数据通知一次TCP_URING_OP_RECV，直到对端关闭或者出错
+int32_t tcp_uring_recv(tcp_uring *ring, tcp_uring_conn *conn);
+
+// 发送[buf, buf+n)，全部发送完成后通知TCP_URING_OP_SEND
+int32_t tcp_uring_send(tcp_uring *ring, tcp_uring_conn *conn, const uint8_t *buf, uint32_t n);
+
+// 取消conn上所有未完成的操作（通知res为负数），然后关闭socket并通知TCP_URING_OP_CLOSE
+void tcp_uring_close(tcp_uring *ring, tcp_uring_conn *conn);
+
+/*
+ * 提交所有排队的操作，最多等待timeout_ms（-1表示一直等到有完成通知），然后分发完成通知
+ * 返回分发的通知数，出错返回-1
+ */
+int tcp_uring_run_once(tcp_uring *ring, int timeout_ms);
+
+// 一直运行，直到调用tcp_uring_stop或者没有未完成的操作
+void tcp_uring_run(tcp_uring *ring);
+
+void tcp_uring_stop(tcp_uring *ring);
+
+// 累计的系统调用次数：io_uring后端为io_uring_enter，epoll后端为epoll_wait、read和sendmsg
+uint64_t tcp_uring_syscalls(const tcp_uring *ring);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __TCP_URING_H__ */
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include "tcp_writer.h"
+#include "../ringbuffer/ringbuffer.h"
+
+struct tcp_writer {
+	tcp_socket *sock;
+	ringbuffer_t *rb;
+	size_t high_water;
+	uint64_t syscalls;
+};
+
+tcp_writer* tcp_writer_create(tcp_socket *sock, size_t capacity, size_t high_water) {
+	tcp_writer *w = (tcp_writer*)malloc(sizeof(tcp_writer));
+	if (!w) return NULL;
+
+	w->sock = sock;
+	w->rb = rb_malloc(capacity);
+	w->high_water = high_water ? high_water : capacity / 4 * 3;
+	w->syscalls = 0;
+	if (!w->rb) {
+		free(w);
+		return NULL;
+	}
+	return w;
+}
+
+void tcp_writer_destroy(tcp_writer *w) {
+	rb_free(w->rb);
+	free(w);
+}
+
+// 缓冲区中的数据，回绕时分为两段，返回段数
+static int writer_segments(const tcp_writer *w, struct iovec *iov) {
+	const ringbuffer_t *rb = w->rb;
+	int cnt = 0;
+
+	if (rb->rb_pr <= rb->rb_pw) {
+		if (rb->rb_pw > rb->rb_pr) {
+			iov[cnt].iov_base = rb->rb_buf + rb->rb_pr;
+			iov[cnt].iov_len = rb->rb_pw - rb->rb_pr;
+			cnt++;
+		}
+	} else {
+		if (rb->rb_capacity + 1 > rb->rb_pr) {
+			iov[cnt].iov_base = rb->rb_buf + rb->rb_pr;
+			iov[cnt].iov_len = rb->rb_capacity + 1 - rb->rb_pr;
+			cnt++;
+		}
+		if (rb->rb_pw > 0) {
+			iov[cnt].iov_base = rb->rb_buf;
+			iov[cnt].iov_len = rb->rb_pw;
+			cnt++;
+		}
+	}
+	return cnt;
+}
+
+// 返回值同tcp_nb_write，用sendmsg代替writev以便带上MSG_NOSIGNAL
+static ssize_t writer_sendv(tcp_writer *w, struct iovec *iov, int cnt) {
+	struct msghdr msg;
+	ssize_t retval;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = cnt;
+	do {
+		retval = sendmsg(w->sock->fd, &msg, MSG_NOSIGNAL);
+		w->syscalls++;
+	} while (retval < 0 && errno == EINTR);
+
+	if (retval >= 0) {
+		return retval;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		return 0;
+	}
+	return -1;
+}
+
+int32_t tcp_writer_write(tcp_writer *w, const uint8_t *buf, uint32_t n) {
+	struct iovec iov[3];
+	size_t pending, accepted, put;
+	ssize_t sent;
+	int cnt;
+
+	if (n <= rb_get_free_size(w->rb)) {
+		rb_write(w->rb, (void*)buf, n);
+		return n;
+	}
+
+	// 放不下，把缓冲区中的数据和buf一起发出去，保证顺序
+	cnt = writer_segments(w, iov);
+	iov[cnt].iov_base = (void*)buf;
+	iov[cnt].iov_len = n;
+	sent = writer_sendv(w, iov, cnt + 1);
+	if (sent < 0) {
+		return -1;
+	}
+
+	pending = rb_get_size(w->rb);
+	if ((size_t)sent >= pending) {
+		rb_reset(w->rb);
+		accepted = sent - pending;
+	} else {
+		rb_remove_oldest(w->rb, sent);
+		accepted = 0;
+	}
+
+	put = n - accepted;
+	if (put > rb_get_free_size(w->rb)) {
+		put = rb_get_free_size(w->rb);
+	}
+	rb_write(w->rb, (void*)(buf + accepted), put);
+
+	return (int32_t)(accepted + put);
+}
+
+int32_t tcp_writer_flush(tcp_writer *w) {
+	struct iovec iov[2];
+	size_t pending;
+	ssize_t sent;
+	int cnt;
+
+	while ((cnt = writer_segments(w, iov)) > 0) {
+		pending = rb_get_size(w->rb);
+		sent = writer_sendv(w, iov, cnt);
+		if (sent < 0) {
+			return -1;
+		}
+		rb_remove_oldest(w->rb, sent);
+		// 只发出了一部分，说明发送缓冲区已满，不必再试一次
+		if ((size_t)sent < pending) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static uint64_t writer_now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int32_t tcp_writer_flush_wait(tcp_writer *w, uint32_t timeout_ms) {
+	uint64_t deadline = writer_now_ms() + timeout_ms;
+	struct pollfd pfd;
+	int32_t retval;
+
+	for (;;) {
+		retval = tcp_writer_flush(w);
+		if (retval != 0) {
+			return retval;
+		}
+
+		uint64_t now = writer_now_ms();
+		if (now >= deadline) {
+			return 0;
+		}
+		pfd.fd = w->sock->fd;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, (int)(deadline - now)) < 0 && errno != EINTR) {
+			return -1;
+		}
+	}
+}
+
+size_t tcp_writer_pending(const tcp_writer *w) {
+	return rb_get_size(w->rb);
+}
+
+int tcp_writer_over_high_water(const tcp_writer *w) {
+	return rb_get_size(w->rb) >= w->high_water;
+}
+
+uint64_t tcp_writer_syscalls(const tcp_writer *w) {
+	return w->syscalls;
+}
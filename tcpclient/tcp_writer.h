@@ -0,0 +1,69 @@
+#ifndef __TCP_WRITER_H__
+#define __TCP_WRITER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "tcpclient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 带缓冲的非阻塞写：应用层的写入先追加到每个socket自己的ringbuffer中，
+// 在socket可写时（TCP_EV_WRITE或者poll）一次writev发出，多个小的写入合并为一次系统调用；
+// ringbuffer回绕时数据分为两段，writev可以一次发出，不需要额外拷贝
+//
+// 待发送的字节数超过高水位后tcp_writer_over_high_water返回1，调用者应暂停生产（背压），
+// 直到flush把数据发出去
+//
+// 与tcp_loop配合：
+//   tcp_writer_write(w, msg, n);					// 可以连续写入多次
+//   r = tcp_writer_flush(w);						// 每轮回调结束前，或者收到TCP_EV_WRITE时
+//   tcp_loop_want_write(loop, conn, r == 0);		// 还有数据没发完则等待可写事件
+//
+// 不是线程安全的
+
+typedef struct tcp_writer tcp_writer;
+
+// capacity为缓冲区大小，high_water为高水位（0表示capacity的3/4），失败返回NULL
+tcp_writer* tcp_writer_create(tcp_socket *sock, size_t capacity, size_t high_water);
+
+// 不会关闭socket，未发送的数据被丢弃
+void tcp_writer_destroy(tcp_writer *w);
+
+/*
+ * 写入n个字节，放入缓冲区，等待flush时发送
+ * 缓冲区放不下时先尝试发送缓冲区中的数据和buf，剩余部分再放入缓冲区
+ * 返回值为-1：表示连接断开或者出错
+ * 返回值为非负数：表示接受的字节数（已发送或者已放入缓冲区），缓冲区满时可能小于n
+ */
+int32_t tcp_writer_write(tcp_writer *w, const uint8_t *buf, uint32_t n);
+
+/*
+ * 尽量发送缓冲区中的数据，不等待
+ * 返回值为-1：表示连接断开或者出错
+ * 返回值为0：表示发送缓冲区已满，还有数据没有发送，需要等待可写
+ * 返回值为1：表示全部发送完
+ */
+int32_t tcp_writer_flush(tcp_writer *w);
+
+/*
+ * 在timeout_ms内等待缓冲区中的数据全部发送，用于阻塞式的调用者
+ * 返回值同tcp_writer_flush，超时返回0
+ */
+int32_t tcp_writer_flush_wait(tcp_writer *w, uint32_t timeout_ms);
+
+// 缓冲区中待发送的字节数
+size_t tcp_writer_pending(const tcp_writer *w);
+
+// 待发送的字节数是否达到高水位
+int tcp_writer_over_high_water(const tcp_writer *w);
+
+// 累计发出的writev调用次数，用于观察合并效果
+uint64_t tcp_writer_syscalls(const tcp_writer *w);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __TCP_WRITER_H__ */
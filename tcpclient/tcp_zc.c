@@ -0,0 +1,329 @@
+// splice需要
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+
+#include "tcp_zc.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY		60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
+
+// TCP的完成通知基本是按序的，乱序到达的区间先存起来，等前面的完成后再合并；数组不够时翻倍
+#define ZC_INIT_RANGES		16
+
+// 连续这么多次发送都被内核拷贝时，退回普通send
+#define ZC_COPIED_LIMIT		64
+
+struct tcp_zc {
+	tcp_socket *sock;
+	uint32_t threshold;
+	int enabled;
+	uint32_t next;			// 下一次零拷贝发送的序号，和内核的计数一致，从0开始
+	uint32_t completed;		// 小于它的序号都已完成
+	uint32_t copied_run;	// 连续被拷贝的发送次数
+	struct zc_range {
+		uint32_t lo, hi;
+	} *ranges;
+	int nranges;
+	int cap_ranges;
+	tcp_zc_stat st;
+};
+
+// 序号会回绕，按差值比较
+static int seq_before(uint32_t a, uint32_t b) {
+	return (int32_t)(a - b) < 0;
+}
+
+tcp_zc* tcp_zc_create(tcp_socket *sock, uint32_t threshold) {
+	tcp_zc *zc = (tcp_zc*)calloc(1, sizeof(tcp_zc));
+	int on = 1;
+
+	if (!zc) return NULL;
+	zc->sock = sock;
+	zc->threshold = threshold ? threshold : TCP_ZC_DEFAULT_THRESHOLD;
+	zc->enabled = setsockopt(sock->fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0;
+	return zc;
+}
+
+void tcp_zc_destroy(tcp_zc *zc) {
+	free(zc->ranges);
+	free(zc);
+}
+
+int32_t tcp_zc_send(tcp_zc *zc, const uint8_t *buf, uint32_t n, int64_t *seq) {
+	int zerocopy = zc->enabled && n >= zc->threshold;
+	ssize_t retval;
+
+	*seq = -1;
+	for (;;) {
+		retval = send(zc->sock->fd, buf, n, MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0));
+		if (retval >= 0) {
+			break;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 0;
+		}
+		if (errno == ENOBUFS && zerocopy) {
+			// 未读取的完成通知太多，超过了optmem的限制，先读取通知，这一次用拷贝发送
+			if (tcp_zc_reap(zc) < 0) {
+				return -1;
+			}
+			zerocopy = 0;
+			continue;
+		}
+		return -1;
+	}
+
+	if (zerocopy) {
+		// 内核只为成功的调用分配序号，一次调用无论发出多少字节都只有一个序号
+		if (retval > 0) {
+			*seq = zc->next++;
+		}
+		zc->st.zerocopy_sends++;
+	} else {
+		zc->st.copy_sends++;
+	}
+	return (int32_t)retval;
+}
+
+ssize_t tcp_zc_sendfile(tcp_zc *zc, int fd, off_t *offset, size_t count) {
+	ssize_t retval;
+
+	do {
+		retval = sendfile(zc->sock->fd, fd, offset, count);
+	} while (retval < 0 && errno == EINTR);
+
+	if (retval > 0 || (0 == retval && 0 == count)) {
+		return retval;
+	}
+	if (0 == retval) {
+		return TCP_ZC_EOF;
+	}
+	return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+}
+
+ssize_t tcp_zc_splice(tcp_zc *zc, int pipe_fd, size_t count) {
+	struct pollfd pfd;
+	ssize_t retval;
+
+	do {
+		retval = splice(pipe_fd, NULL, zc->sock->fd, NULL, count, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	} while (retval < 0 && errno == EINTR);
+
+	if (retval > 0 || (0 == retval && 0 == count)) {
+		return retval;
+	}
+	if (0 == retval) {
+		return TCP_ZC_EOF;
+	}
+	if (errno != EAGAIN && errno != EWOULDBLOCK) {
+		return -1;
+	}
+	// 管道为空和socket发送缓冲区已满都是EAGAIN，看管道中有没有数据来区分；
+	// 只有调用者从管道中读取，这里看到有数据时一定是socket满了
+	pfd.fd = pipe_fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	while (poll(&pfd, 1, 0) < 0) {
+		if (errno != EINTR) {
+			return -1;
+		}
+	}
+	return (pfd.revents & POLLIN) ? 0 : TCP_ZC_EMPTY;
+}
+
+// 保存一个乱序到达的区间，和已有的区间相邻时直接合并；内存不足返回-1
+static int zc_save_range(tcp_zc *zc, uint32_t lo, uint32_t hi) {
+	struct zc_range *ranges;
+	int i, cap;
+
+	for (i = 0; i < zc->nranges; ++i) {
+		if (zc->ranges[i].hi + 1 == lo) {
+			zc->ranges[i].hi = hi;
+			return 0;
+		}
+		if (hi + 1 == zc->ranges[i].lo) {
+			zc->ranges[i].lo = lo;
+			return 0;
+		}
+	}
+	if (zc->nranges == zc->cap_ranges) {
+		cap = zc->cap_ranges ? zc->cap_ranges * 2 : ZC_INIT_RANGES;
+		ranges = (struct zc_range*)realloc(zc->ranges, cap * sizeof(struct zc_range));
+		if (!ranges) {
+			return -1;
+		}
+		zc->ranges = ranges;
+		zc->cap_ranges = cap;
+	}
+	zc->ranges[zc->nranges].lo = lo;
+	zc->ranges[zc->nranges].hi = hi;
+	zc->nranges++;
+	return 0;
+}
+
+// 序号[lo, hi]的发送已完成；内存不足返回-1
+static int zc_complete(tcp_zc *zc, uint32_t lo, uint32_t hi, int copied) {
+	uint32_t count = hi - lo + 1;
+	int i;
+
+	zc->st.completions += count;
+	if (copied) {
+		zc->st.copied += count;
+		zc->copied_run += count;
+		if (zc->copied_run >= ZC_COPIED_LIMIT) {
+			zc->enabled = 0;
+		}
+	} else {
+		zc->copied_run = 0;
+	}
+
+	if (seq_before(zc->completed, lo)) {
+		return zc_save_range(zc, lo, hi);
+	}
+	if (seq_before(hi, zc->completed)) {
+		return 0;
+	}
+	zc->completed = hi + 1;
+
+	// 合并之前乱序到达、现在已经连续的区间
+	for (i = 0; i < zc->nranges; ) {
+		if (seq_before(zc->completed, zc->ranges[i].lo)) {
+			++i;
+			continue;
+		}
+		if (!seq_before(zc->ranges[i].hi, zc->completed)) {
+			zc->completed = zc->ranges[i].hi + 1;
+		}
+		zc->ranges[i] = zc->ranges[--zc->nranges];
+		i = 0;
+	}
+	return 0;
+}
+
+int32_t tcp_zc_reap(tcp_zc *zc) {
+	char control[256];
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	struct sock_extended_err *serr;
+	int32_t count = 0;
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(zc->sock->fd, &msg, MSG_ERRQUEUE) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? count : -1;
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+				|| (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+				continue;
+			}
+			serr = (struct sock_extended_err*)CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+				// 错误队列中的其他错误
+				if (serr->ee_errno != 0) {
+					return -1;
+				}
+				continue;
+			}
+			if (zc_complete(zc, serr->ee_info, serr->ee_data, serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) < 0) {
+				return -1;
+			}
+			count++;
+		}
+	}
+}
+
+int tcp_zc_done(const tcp_zc *zc, int64_t seq) {
+	if (seq < 0) {
+		return 1;
+	}
+	return seq_before((uint32_t)seq, zc->completed);
+}
+
+static uint64_t zc_now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int32_t tcp_zc_wait(tcp_zc *zc, int64_t seq, uint32_t timeout_ms) {
+	uint64_t deadline = zc_now_ms() + timeout_ms;
+	struct pollfd pfd;
+	int32_t reaped = 0;
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	for (;;) {
+		reaped = tcp_zc_reap(zc);
+		if (reaped < 0) {
+			return -1;
+		}
+		if (tcp_zc_done(zc, seq)) {
+			return 1;
+		}
+
+		uint64_t now = zc_now_ms();
+		if (now >= deadline) {
+			return 0;
+		}
+		// events为0时poll只在POLLERR、POLLHUP时返回，错误队列中有通知时会返回POLLERR
+		pfd.fd = zc->sock->fd;
+		pfd.events = 0;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, (int)(deadline - now)) < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if ((pfd.revents & POLLERR) && (getsockopt(zc->sock->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)) {
+			return -1;
+		}
+		// 连接已经关闭，如果没有通知可读会一直返回POLLHUP
+		if ((pfd.revents & POLLHUP) && 0 == reaped && 0 == tcp_zc_reap(zc) && !tcp_zc_done(zc, seq)) {
+			return -1;
+		}
+	}
+}
+
+uint32_t tcp_zc_outstanding(const tcp_zc *zc) {
+	uint32_t n = zc->next - zc->completed;
+	int i;
+
+	for (i = 0; i < zc->nranges; ++i) {
+		n -= zc->ranges[i].hi - zc->ranges[i].lo + 1;
+	}
+	return n;
+}
+
+void tcp_zc_get_stat(const tcp_zc *zc, tcp_zc_stat *st) {
+	*st = zc->st;
+	st->enabled = zc->enabled;
+}
@@ -0,0 +1,107 @@
+#ifndef __TCP_ZC_H__
+#define __TCP_ZC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "tcpclient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 大块数据的零拷贝发送：
+//   1. tcp_zc_send：不小于threshold的数据用MSG_ZEROCOPY发送，内核直接引用用户的内存页，
+//      发送完成（对端确认）后在socket的错误队列中放一个完成通知，收到通知之前buf不能修改或者释放；
+//      小于threshold的数据用普通的send拷贝，小数据锁页和处理通知的开销比拷贝大
+//   2. tcp_zc_sendfile：文件中的数据用sendfile直接从页缓存发出，不经过用户空间
+//   3. tcp_zc_splice：管道中的数据用splice移动到socket
+//
+// 每次零拷贝发送返回一个序号，tcp_zc_reap读取错误队列中的完成通知，tcp_zc_done判断某个序号是否已完成。
+// 与tcp_loop配合时，完成通知以TCP_EV_ERRQUEUE通知，收到后调用tcp_zc_reap；阻塞式的调用者用tcp_zc_wait
+//
+// 内核无法零拷贝时（例如本机回环、网卡不支持）会在发送时拷贝一次，并在完成通知中标记，
+// 连续多次都是这样时自动退回普通的send，避免白白付出零拷贝的额外开销
+//
+// 不是线程安全的
+
+#define TCP_ZC_DEFAULT_THRESHOLD	(16 * 1024)
+
+// tcp_zc_sendfile、tcp_zc_splice没有数据可发时的返回值，和发送缓冲区已满（返回0）区分开
+#define TCP_ZC_EMPTY	-2		// 管道暂时为空，等管道可读再继续
+#define TCP_ZC_EOF		-3		// 文件已经读完，或者管道的写端已经关闭
+
+typedef struct tcp_zc tcp_zc;
+
+typedef struct {
+	uint64_t zerocopy_sends;	// MSG_ZEROCOPY的send调用次数
+	uint64_t copy_sends;		// 普通send的调用次数
+	uint64_t completions;		// 已完成的零拷贝发送
+	uint64_t copied;			// 其中内核退化为拷贝的次数
+	int enabled;				// 当前是否使用零拷贝
+} tcp_zc_stat;
+
+/*
+ * 在socket上打开SO_ZEROCOPY，threshold为使用零拷贝的最小长度（0表示TCP_ZC_DEFAULT_THRESHOLD）
+ * 内核不支持时仍然返回对象，所有数据都用普通send发送
+ * 失败返回NULL
+ */
+tcp_zc* tcp_zc_create(tcp_socket *sock, uint32_t threshold);
+
+// 不会关闭socket；未完成的零拷贝发送仍然引用着用户的buf
+void tcp_zc_destroy(tcp_zc *zc);
+
+/*
+ * 非阻塞发送
+ * 返回值为-1：表示连接断开或者出错
+ * 返回值为0：表示发送缓冲区已满
+ * 返回值为正数：表示发出的字节数，*seq为这次发送的序号，buf的这一部分在tcp_zc_done(zc, *seq)之前不能修改；
+ *             用普通send发送时*seq为-1，buf可以立即复用
+ */
+int32_t tcp_zc_send(tcp_zc *zc, const uint8_t *buf, uint32_t n, int64_t *seq);
+
+/*
+ * 把文件fd从*offset开始的count个字节发送出去，非阻塞，*offset前移发出的字节数
+ * 返回值为-1：表示连接断开或者出错
+ * 返回值为0：表示发送缓冲区已满（count为0时也返回0）
+ * 返回值为TCP_ZC_EOF：表示*offset已经到了文件末尾
+ * 返回值为正数：表示发出的字节数
+ */
+ssize_t tcp_zc_sendfile(tcp_zc *zc, int fd, off_t *offset, size_t count);
+
+/*
+ * 把管道pipe_fd中最多count个字节移动到socket，非阻塞
+ * 返回值为-1：表示连接断开或者出错
+ * 返回值为0：表示发送缓冲区已满（count为0时也返回0）
+ * 返回值为TCP_ZC_EMPTY：表示管道为空
+ * 返回值为TCP_ZC_EOF：表示管道为空并且写端已经关闭
+ * 返回值为正数：表示移动的字节数
+ */
+ssize_t tcp_zc_splice(tcp_zc *zc, int pipe_fd, size_t count);
+
+/*
+ * 读取错误队列中所有的完成通知，不等待
+ * 返回值为-1：表示socket出错，或者保存乱序到达的通知时内存不足
+ * 返回值为非负数：表示这次读到的完成通知个数（一个通知可以覆盖多次发送）
+ */
+int32_t tcp_zc_reap(tcp_zc *zc);
+
+// 序号为seq的发送是否已经完成，seq为-1时总是返回1
+int tcp_zc_done(const tcp_zc *zc, int64_t seq);
+
+/*
+ * 在timeout_ms内等待序号为seq的发送完成
+ * 返回值为1：表示已完成；0：超时；-1：socket出错
+ */
+int32_t tcp_zc_wait(tcp_zc *zc, int64_t seq, uint32_t timeout_ms);
+
+// 还没有完成的零拷贝发送次数
+uint32_t tcp_zc_outstanding(const tcp_zc *zc);
+
+void tcp_zc_get_stat(const tcp_zc *zc, tcp_zc_stat *st);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __TCP_ZC_H__ */
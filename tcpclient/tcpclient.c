@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+
+#include "tcpclient.h"
+#include "../trace/trace.h"
+
+/*
+ * 在timeout_ms内等待socket就绪，用poll代替select，不受FD_SETSIZE限制
+ * 返回值同poll：-1出错，0超时，1就绪
+ */
+static int tcp_poll(tcp_socket *sock, short events, uint32_t timeout_ms) {
+	struct pollfd pfd;
+	int retval;
+
+	pfd.fd = sock->fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	do {
+		retval = poll(&pfd, 1, (int)timeout_ms);
+	} while (retval < 0 && errno == EINTR);
+
+	return retval;
+}
+
+static uint64_t tcp_now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * 返回值为0：表示连接成功
+ * 返回值为-1：表示连接失败
+ */
+int32_t tcp_connect(tcp_socket *sock, uint8_t *ip, uint16_t port, uint32_t timeout_ms) {
+	struct sockaddr_in addr;
+	int retval;
+	socklen_t optlen;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, (const char*)ip, &addr.sin_addr);
+
+	// 创建socket，并设置为非阻塞
+	sock->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock->fd < 0) {
+        return -1;
+    }
+	fcntl(sock->fd, F_SETFL, fcntl(sock->fd, F_GETFL) | O_NONBLOCK);
+	
+	// 尝试连接，返回0表示连接成功，否则判断errno，
+	// 如果errno被设为EINPROGRESS，表示connect仍旧在进行
+	if (connect(sock->fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+		return 0;
+	}
+	if (errno != EINPROGRESS) {
+		return -1;
+	}
+
+	// 设置timeout，判断socket是否可写，如果可写，
+	// 则用getsockopt得到error的值，若error值为0，表示connect成功
+	retval = tcp_poll(sock, POLLOUT, timeout_ms);
+	if (retval <= 0) {
+		return -1;
+	}
+	optlen = sizeof(int);
+	if (getsockopt(sock->fd, SOL_SOCKET, SO_ERROR, &retval, &optlen) < 0) {
+		return -1;
+	}
+	if (0 == retval) {
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * 关闭连接
+ */
+int32_t tcp_close(tcp_socket *sock) {
+    if (sock->fd < 0) {
+        return -1;
+    }
+	close(sock->fd);
+	return 0;
+}
+
+/*
+ * 返回值为-1：表示连接断开
+ * 返回值为0：表示在timeout_ms时间内没有读到数据
+ * 返回值为正数：表示读取到的字节数
+ */
+int32_t tcp_read(tcp_socket *sock, uint8_t *buf, uint32_t n, uint32_t timeout_ms) {
+	TRACE_SCOPE("tcp_read");
+	int retval;
+
+	retval = tcp_poll(sock, POLLIN, timeout_ms);
+	if (retval < 0) {
+		return -1;
+	}
+	else if (0 == retval) {
+		return 0;
+	}
+
+	// 不能保证全部读完，需要在上一层根据自己的协议做缓存
+	retval = read(sock->fd, buf, n);
+	if (retval <= 0) {
+		return -1;
+	}
+	return retval;
+}
+
+/*
+ * 返回值为-1：表示连接断开
+ * 返回值为0：表示在timeout_ms时间内没有写入数据
+ * 返回值为正数：表示写入的字节数
+ */
+int32_t tcp_write(tcp_socket *sock, uint8_t *buf, uint32_t n, uint32_t timeout_ms) {
+	TRACE_SCOPE("tcp_write");
+	int retval;
+
+	retval = tcp_poll(sock, POLLOUT, timeout_ms);
+	if (retval < 0) {
+		return -1;
+	}
+	else if (0 == retval) {
+		return 0;
+	}
+
+	// 尽量将数据全部写到发送缓冲区，发送缓冲区满时在剩余的时间内等待可写，超时返回已写入的字节数
+	uint64_t deadline = tcp_now_ms() + timeout_ms;
+	uint32_t totlen = 0;
+	while (totlen < n) {
+		retval = write(sock->fd, buf + totlen, n - totlen);
+		if (retval < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				uint64_t now = tcp_now_ms();
+				if (now >= deadline) {
+					break;
+				}
+				retval = tcp_poll(sock, POLLOUT, (uint32_t)(deadline - now));
+				if (retval < 0) {
+					return -1;
+				}
+				continue;
+			}
+			else if (errno == EINTR) {  // 中断错误，继续写
+				continue;
+			}
+			return -1;
+		}
+		totlen += retval;
+	}
+
+	return totlen;
+}
+
+/*
+ * 非阻塞读，不等待
+ * 返回值为-1：表示连接断开或者出错
+ * 返回值为0：表示当前没有数据可读(EAGAIN)
+ * 返回值为正数：表示读取到的字节数
+ */
+int32_t tcp_nb_read(tcp_socket *sock, uint8_t *buf, uint32_t n) {
+	ssize_t retval;
+	do {
+		retval = read(sock->fd, buf, n);
+	} while (retval < 0 && errno == EINTR);
+
+	if (retval > 0) {
+		return (int32_t)retval;
+	}
+	if (retval < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return 0;
+	}
+	return -1;
+}
+
+/*
+ * 非阻塞写，不等待
+ * 返回值为-1：表示连接断开或者出错
+ * 返回值为0：表示发送缓冲区已满(EAGAIN)
+ * 返回值为正数：表示写入的字节数
+ */
+int32_t tcp_nb_write(tcp_socket *sock, const uint8_t *buf, uint32_t n) {
+	ssize_t retval;
+	do {
+		retval = send(sock->fd, buf, n, MSG_NOSIGNAL);
+	} while (retval < 0 && errno == EINTR);
+
+	if (retval >= 0) {
+		return (int32_t)retval;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		return 0;
+	}
+	return -1;
+}
@@ -0,0 +1,60 @@
+#ifndef __TCPCLIENT_H__
+#define __TCPCLIENT_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	int fd;
+} tcp_socket;
+
+/*
+ * 非阻塞connect，在timeout_ms内等待连接完成
+ * 返回值为0：表示连接成功
+ * 返回值为-1：表示连接失败
+ */
+int32_t tcp_connect(tcp_socket *sock, uint8_t *ip, uint16_t port, uint32_t timeout_ms);
+
+/*
+ * 关闭连接
+ */
+int32_t tcp_close(tcp_socket *sock);
+
+/*
+ * 返回值为-1：表示连接断开
+ * 返回值为0：表示在timeout_ms时间内没有读到数据
+ * 返回值为正数：表示读取到的字节数
+ */
+int32_t tcp_read(tcp_socket *sock, uint8_t *buf, uint32_t n, uint32_t timeout_ms);
+
+/*
+ * 返回值为-1：表示连接断开
+ * 返回值为0：表示在timeout_ms时间内没有写入数据
+ * 返回值为正数：表示写入的字节数
+ */
+int32_t tcp_write(tcp_socket *sock, uint8_t *buf, uint32_t n, uint32_t timeout_ms);
+
+/*
+ * 非阻塞读，不等待，用于事件循环
+ * 返回值为-1：表示连接断开或者出错
+ * 返回值为0：表示当前没有数据可读(EAGAIN)
+ * 返回值为正数：表示读取到的字节数
+ */
+int32_t tcp_nb_read(tcp_socket *sock, uint8_t *buf, uint32_t n);
+
+/*
+ * 非阻塞写，不等待，用于事件循环
+ * 返回值为-1：表示连接断开或者出错
+ * 返回值为0：表示发送缓冲区已满(EAGAIN)
+ * 返回值为正数：表示写入的字节数
+ */
+int32_t tcp_nb_write(tcp_socket *sock, const uint8_t *buf, uint32_t n);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __TCPCLIENT_H__ */
@@ -0,0 +1,1333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <time.h>
+#include "tcpclient.h"
+#include "tcp_loop.h"
+#include "tcp_writer.h"
+#include "tcp_uring.h"
+#include "tcp_framer.h"
+#include "tcp_mux.h"
+#include "tcp_pool.h"
+#include "tcp_zc.h"
+
+// gcc -O2 -o test test.c tcp_loop.c tcp_writer.c tcp_uring.c tcp_framer.c tcp_mux.c tcp_pool.c tcp_zc.c tcpclient.c -pthread
+
+// ----------------------------------------------------------------
+// 进程内的echo server，同样用tcp_loop驱动
+
+typedef struct {
+	tcp_loop *loop;
+	tcp_conn listener;
+	uint16_t port;
+	volatile int stop;
+} echo_server;
+
+typedef struct {
+	tcp_conn conn;
+	tcp_writer *w;
+} echo_conn;
+
+static void echo_server_conn_cb(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	echo_conn *c = (echo_conn*)conn->udata;
+	uint8_t buf[16 * 1024];
+	int32_t n, w, r = 1;
+
+	while ((n = tcp_nb_read(&conn->sock, buf, sizeof(buf))) > 0) {
+		// 缓冲区足够大，测试中不会写满
+		w = tcp_writer_write(c->w, buf, n);
+		if (w != n) {
+			exit(-1);
+		}
+	}
+	if (n == 0) {
+		r = tcp_writer_flush(c->w);
+		tcp_loop_want_write(loop, conn, r == 0);
+	}
+	if (n < 0 || r < 0 || (events & TCP_EV_ERROR)) {
+		tcp_loop_remove(loop, conn);
+		tcp_close(&conn->sock);
+		tcp_writer_destroy(c->w);
+		free(c);
+	}
+}
+
+static void echo_server_accept_cb(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	int fd;
+	while ((fd = accept(conn->sock.fd, NULL, NULL)) >= 0) {
+		tcp_socket sock = {fd};
+		echo_conn *c = (echo_conn*)malloc(sizeof(echo_conn));
+		tcp_loop_add(loop, &c->conn, sock, echo_server_conn_cb, c);
+		c->w = tcp_writer_create(&c->conn.sock, 4 * 1024 * 1024, 0);
+	}
+}
+
+static void *echo_server_run(void *arg) {
+	echo_server *s = (echo_server*)arg;
+	while (!s->stop) {
+		tcp_loop_run_once(s->loop, 50);
+	}
+	return NULL;
+}
+
+static void echo_server_start(echo_server *s, pthread_t *tid) {
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	tcp_socket sock;
+
+	sock.fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(sock.fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(sock.fd, 4096) != 0) {
+		exit(-1);
+	}
+	getsockname(sock.fd, (struct sockaddr*)&addr, &len);
+
+	s->port = ntohs(addr.sin_port);
+	s->stop = 0;
+	s->loop = tcp_loop_create(1024);
+	if (tcp_loop_add(s->loop, &s->listener, sock, echo_server_accept_cb, s) != 0) {
+		exit(-1);
+	}
+	pthread_create(tid, NULL, echo_server_run, s);
+}
+
+static void echo_server_stop(echo_server *s, pthread_t tid) {
+	s->stop = 1;
+	pthread_join(tid, NULL);
+	tcp_close(&s->listener.sock);
+	// 剩余的连接在客户端关闭时已经释放
+	tcp_loop_destroy(s->loop);
+}
+
+// ----------------------------------------------------------------
+// 测试1：一个循环驱动大量连接，每个连接做多轮ping/echo
+
+#define TEST1_CONNS		1000
+#define TEST1_ROUNDS	10
+
+typedef struct {
+	tcp_conn conn;
+	int id;
+	int round;
+	int done;
+	int *finished;
+} ping_client;
+
+static void ping_send(ping_client *c) {
+	char msg[32];
+	int n = snprintf(msg, sizeof(msg), "ping-%d-%d", c->id, c->round);
+	int32_t w = tcp_nb_write(&c->conn.sock, (uint8_t*)msg, n);
+	if (w != n) {
+		exit(-1);
+	}
+}
+
+static void ping_cb(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	ping_client *c = (ping_client*)conn->udata;
+	char buf[64], expect[32];
+	int32_t n;
+
+	if (events & (TCP_EV_ERROR | TCP_EV_TIMEOUT)) {
+		exit(-1);
+	}
+	if (events & TCP_EV_CONNECTED) {
+		ping_send(c);
+	}
+	if (!(events & TCP_EV_READ)) {
+		return;
+	}
+
+	while ((n = tcp_nb_read(&conn->sock, (uint8_t*)buf, sizeof(buf) - 1)) > 0) {
+		buf[n] = '\0';
+		snprintf(expect, sizeof(expect), "ping-%d-%d", c->id, c->round);
+		if (0 != strcmp(buf, expect)) {
+			exit(-1);
+		}
+		if (++c->round == TEST1_ROUNDS) {
+			c->done = 1;
+			(*c->finished)++;
+			tcp_loop_remove(loop, conn);
+			tcp_close(&conn->sock);
+			return;
+		}
+		ping_send(c);
+	}
+	if (n != 0) {
+		exit(-1);
+	}
+}
+
+void test1(uint16_t port) {
+	tcp_loop *loop = tcp_loop_create(256);
+	ping_client *clients = (ping_client*)calloc(TEST1_CONNS, sizeof(ping_client));
+	int finished = 0;
+	int32_t r;
+	int i;
+
+	for (i = 0; i < TEST1_CONNS; ++i) {
+		clients[i].id = i;
+		clients[i].finished = &finished;
+		r = tcp_loop_connect(loop, &clients[i].conn, "127.0.0.1", port, 3000, ping_cb, &clients[i]);
+		if (r != 0) {
+			exit(-1);
+		}
+	}
+	if (tcp_loop_conn_count(loop) != TEST1_CONNS) {
+		exit(-1);
+	}
+
+	tcp_loop_run(loop);
+
+	if (finished != TEST1_CONNS || tcp_loop_conn_count(loop) != 0) {
+		exit(-1);
+	}
+	for (i = 0; i < TEST1_CONNS; ++i) {
+		if (!clients[i].done || clients[i].round != TEST1_ROUNDS) {
+			exit(-1);
+		}
+	}
+
+	free(clients);
+	tcp_loop_destroy(loop);
+	printf("test1 ok\n");
+}
+
+// ----------------------------------------------------------------
+// 测试2：定时器和连接失败
+
+typedef struct {
+	tcp_conn conn;
+	uint32_t events;
+	uint64_t fired_ms;
+} event_recorder;
+
+static void record_cb(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	event_recorder *r = (event_recorder*)conn->udata;
+	r->events |= events;
+	r->fired_ms = tcp_loop_now_ms(loop);
+	if (events & (TCP_EV_ERROR | TCP_EV_TIMEOUT)) {
+		tcp_loop_remove(loop, conn);
+		tcp_close(&conn->sock);
+	}
+}
+
+void test2(uint16_t port) {
+	tcp_loop *loop = tcp_loop_create(16);
+	event_recorder timer, refused, writer;
+	tcp_socket sock;
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	uint16_t closed_port;
+	uint64_t start;
+	int32_t r;
+	int i;
+
+	// 找一个没有监听的端口：绑定后不listen，再关闭
+	sock.fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(sock.fd, (struct sockaddr*)&addr, sizeof(addr));
+	getsockname(sock.fd, (struct sockaddr*)&addr, &len);
+	closed_port = ntohs(addr.sin_port);
+	tcp_close(&sock);
+
+	memset(&refused, 0, sizeof(refused));
+	r = tcp_loop_connect(loop, &refused.conn, "127.0.0.1", closed_port, 1000, record_cb, &refused);
+	if (r != 0) {
+		exit(-1);
+	}
+
+	// 连接成功后设置100ms的定时器，期间没有数据
+	memset(&timer, 0, sizeof(timer));
+	r = tcp_loop_connect(loop, &timer.conn, "127.0.0.1", port, 1000, record_cb, &timer);
+	if (r != 0) {
+		exit(-1);
+	}
+	while (!(timer.events & TCP_EV_CONNECTED)) {
+		tcp_loop_run_once(loop, 100);
+	}
+	start = tcp_loop_now_ms(loop);
+	tcp_loop_set_timer(loop, &timer.conn, 100);
+
+	tcp_loop_run(loop);
+
+	if (refused.events != TCP_EV_ERROR) {
+		exit(-1);
+	}
+	if (timer.events != (TCP_EV_CONNECTED | TCP_EV_TIMEOUT)) {
+		exit(-1);
+	}
+	if (timer.fired_ms - start < 100 || timer.fired_ms - start >= 500) {
+		exit(-1);
+	}
+
+	// 取消定时器后不会再触发
+	memset(&timer, 0, sizeof(timer));
+	r = tcp_loop_connect(loop, &timer.conn, "127.0.0.1", port, 50, record_cb, &timer);
+	if (r != 0) {
+		exit(-1);
+	}
+	tcp_loop_set_timer(loop, &timer.conn, 0);
+	while (!(timer.events & TCP_EV_CONNECTED)) {
+		tcp_loop_run_once(loop, 100);
+	}
+	tcp_loop_run_once(loop, 150);
+	if (timer.events != TCP_EV_CONNECTED) {
+		exit(-1);
+	}
+	tcp_loop_remove(loop, &timer.conn);
+	tcp_close(&timer.conn.sock);
+
+	// 连接建立之前打开的可写通知，在连接成功后生效
+	memset(&writer, 0, sizeof(writer));
+	r = tcp_loop_connect(loop, &writer.conn, "127.0.0.1", port, 1000, record_cb, &writer);
+	if (r != 0) {
+		exit(-1);
+	}
+	tcp_loop_want_write(loop, &writer.conn, 1);
+	for (i = 0; i < 20 && !(writer.events & TCP_EV_WRITE); ++i) {
+		tcp_loop_run_once(loop, 50);
+	}
+	if (writer.events != (TCP_EV_CONNECTED | TCP_EV_WRITE)) {
+		exit(-1);
+	}
+	tcp_loop_remove(loop, &writer.conn);
+	tcp_close(&writer.conn.sock);
+
+	tcp_loop_destroy(loop);
+	printf("test2 ok\n");
+}
+
+// ----------------------------------------------------------------
+// 测试3：带缓冲的写，合并小的写入、高水位、对端不读时不空转
+
+// 非阻塞的socket对，发送缓冲区调小以便很快写满
+static void make_pair(tcp_socket *a, tcp_socket *b) {
+	int fds[2];
+	int sndbuf = 16 * 1024;
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+		exit(-1);
+	}
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	a->fd = fds[0];
+	b->fd = fds[1];
+}
+
+// 读出所有数据并检查是否为连续的计数序列
+static void drain_check(tcp_socket *sock, uint32_t *next, uint64_t *total) {
+	uint8_t buf[4096];
+	int32_t n, i;
+	while ((n = tcp_nb_read(sock, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; ++i) {
+			if (buf[i] != (uint8_t)*next) {
+				exit(-1);
+			}
+			(*next)++;
+		}
+		*total += n;
+	}
+}
+
+void test3() {
+	tcp_socket a, b;
+	tcp_writer *w;
+	uint8_t msg[1024];
+	uint32_t seq = 0, next = 0;
+	uint64_t total = 0;
+	int32_t n;
+	int i, j;
+
+	make_pair(&a, &b);
+	w = tcp_writer_create(&a, 64 * 1024, 32 * 1024);
+
+	// 1000次小的写入只需要一次系统调用
+	for (i = 0; i < 1000; ++i) {
+		for (j = 0; j < 10; ++j) msg[j] = (uint8_t)seq++;
+		n = tcp_writer_write(w, msg, 10);
+		if (n != 10) {
+			exit(-1);
+		}
+	}
+	if (tcp_writer_pending(w) != 10000 || tcp_writer_syscalls(w) != 0) {
+		exit(-1);
+	}
+	n = tcp_writer_flush(w);
+	if (n != 1 || tcp_writer_syscalls(w) != 1 || tcp_writer_pending(w) != 0) {
+		exit(-1);
+	}
+	drain_check(&b, &next, &total);
+	if (total != 10000) {
+		exit(-1);
+	}
+
+	// 对端不读，写到高水位后flush无法发完，继续写直到缓冲区满
+	while (!tcp_writer_over_high_water(w)) {
+		for (j = 0; j < (int)sizeof(msg); ++j) msg[j] = (uint8_t)seq++;
+		n = tcp_writer_write(w, msg, sizeof(msg));
+		if (n != (int32_t)sizeof(msg)) {
+			exit(-1);
+		}
+		tcp_writer_flush(w);
+	}
+	n = tcp_writer_flush(w);
+	if (n != 0) {
+		exit(-1);
+	}
+	for (;;) {
+		for (j = 0; j < (int)sizeof(msg); ++j) msg[j] = (uint8_t)(seq + j);
+		n = tcp_writer_write(w, msg, sizeof(msg));
+		if (n < 0) {
+			exit(-1);
+		}
+		seq += n;
+		if (n < (int32_t)sizeof(msg)) break;
+	}
+	if (tcp_writer_pending(w) != 64 * 1024) {
+		exit(-1);
+	}
+
+	// 对端开始读，数据完整且有序（缓冲区已经回绕过）
+	while (tcp_writer_pending(w) > 0) {
+		drain_check(&b, &next, &total);
+		n = tcp_writer_flush_wait(w, 10);
+		if (n < 0) {
+			exit(-1);
+		}
+	}
+	drain_check(&b, &next, &total);
+	if (next != seq) {
+		exit(-1);
+	}
+	tcp_writer_destroy(w);
+
+	// tcp_write在发送缓冲区满时等待可写而不是空转，超时返回已写入的字节数
+	{
+		static uint8_t big[1024 * 1024];
+		struct timespec t0, t1;
+		clock_t c0 = clock();
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		n = tcp_write(&a, big, sizeof(big), 200);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (n <= 0 || n >= (int32_t)sizeof(big)) {
+			exit(-1);
+		}
+		if ((t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000 < 190) {
+			exit(-1);
+		}
+		if ((clock() - c0) * 1000 / CLOCKS_PER_SEC >= 100) {
+			exit(-1);
+		}
+	}
+
+	tcp_close(&a);
+	tcp_close(&b);
+	printf("test3 ok\n");
+}
+
+// ----------------------------------------------------------------
+// 测试4：tcp_uring，两种后端各跑一遍：多个连接的ping/echo、大消息、连接失败、关闭
+
+#define TEST4_CONNS		100
+#define TEST4_ROUNDS	20
+#define TEST4_BIG		(1024 * 1024)
+
+typedef struct {
+	tcp_uring_conn conn;
+	int id;
+	int round;
+	uint32_t msg_len;
+	uint32_t received;
+	int sent;
+	int closed;
+	int32_t connect_res;
+	uint8_t *msg;
+} uring_client;
+
+static int test4_closed;
+
+static uint32_t test4_msg_len(int id, int round) {
+	// 第一个连接的最后一轮发送大消息，覆盖部分发送和多个接收buffer
+	if (0 == id && round == TEST4_ROUNDS - 1) {
+		return TEST4_BIG;
+	}
+	return (uint32_t)((id * 131 + round * 7919) % 3000) + 1;
+}
+
+static void test4_send(tcp_uring *ring, uring_client *c) {
+	uint32_t i;
+	c->msg_len = test4_msg_len(c->id, c->round);
+	c->received = 0;
+	for (i = 0; i < c->msg_len; ++i) {
+		c->msg[i] = (uint8_t)(c->id + c->round + i);
+	}
+	if (tcp_uring_send(ring, &c->conn, c->msg, c->msg_len) != 0) {
+		exit(-1);
+	}
+}
+
+static void test4_cb(tcp_uring *ring, tcp_uring_conn *conn, int op, int32_t res, const uint8_t *data) {
+	uring_client *c = (uring_client*)conn->udata;
+	int32_t i;
+
+	switch (op) {
+	case TCP_URING_OP_CONNECT:
+		c->connect_res = res;
+		if (res < 0) {
+			tcp_uring_close(ring, conn);
+			break;
+		}
+		if (tcp_uring_recv(ring, conn) != 0) {
+			exit(-1);
+		}
+		test4_send(ring, c);
+		break;
+	case TCP_URING_OP_SEND:
+		// send的完成通知可能晚于对端的回应（epoll后端的send在放入缓冲区后就算完成，通知在本轮循环末尾）
+		if (res != (int32_t)test4_msg_len(c->id, c->sent) || data != c->msg) {
+			exit(-1);
+		}
+		c->sent++;
+		break;
+	case TCP_URING_OP_RECV:
+		if (res <= 0) {
+			// 关闭时正在进行的接收被取消
+			if (c->round != TEST4_ROUNDS) {
+				exit(-1);
+			}
+			break;
+		}
+		for (i = 0; i < res; ++i) {
+			if (data[i] != c->msg[c->received + i]) {
+				exit(-1);
+			}
+		}
+		c->received += res;
+		if (c->received > c->msg_len) {
+			exit(-1);
+		}
+		if (c->received == c->msg_len && ++c->round < TEST4_ROUNDS) {
+			test4_send(ring, c);
+		} else if (c->received == c->msg_len) {
+			tcp_uring_close(ring, conn);
+		}
+		break;
+	case TCP_URING_OP_CLOSE:
+		c->closed = 1;
+		test4_closed++;
+		break;
+	}
+}
+
+static void test4_backend(uint16_t port, int flags) {
+	tcp_uring *ring = tcp_uring_create(256, 64, 16 * 1024, flags);
+	uring_client *clients = (uring_client*)calloc(TEST4_CONNS + 1, sizeof(uring_client));
+	uring_client *refused = &clients[TEST4_CONNS];
+	int32_t r;
+	int i;
+
+	if (ring == NULL) {
+		exit(-1);
+	}
+	if (flags & TCP_URING_FORCE_EPOLL) {
+		if (tcp_uring_backend(ring) != TCP_URING_BACKEND_EPOLL) {
+			exit(-1);
+		}
+	}
+	test4_closed = 0;
+
+	for (i = 0; i < TEST4_CONNS; ++i) {
+		clients[i].id = i;
+		clients[i].msg = (uint8_t*)malloc(0 == i ? TEST4_BIG : 4096);
+		r = tcp_uring_connect(ring, &clients[i].conn, "127.0.0.1", port, test4_cb, &clients[i]);
+		if (r != 0) {
+			exit(-1);
+		}
+	}
+	// 端口1上没有监听
+	refused->id = -1;
+	r = tcp_uring_connect(ring, &refused->conn, "127.0.0.1", 1, test4_cb, refused);
+	if (r != 0) {
+		exit(-1);
+	}
+
+	tcp_uring_run(ring);
+
+	if (test4_closed != TEST4_CONNS + 1 || !refused->closed || refused->connect_res >= 0) {
+		exit(-1);
+	}
+	for (i = 0; i < TEST4_CONNS; ++i) {
+		if (!clients[i].closed || clients[i].connect_res != 0
+			|| clients[i].round != TEST4_ROUNDS || clients[i].sent != TEST4_ROUNDS) {
+			exit(-1);
+		}
+		free(clients[i].msg);
+	}
+	printf("  backend %s: %llu syscalls\n", tcp_uring_backend(ring) == TCP_URING_BACKEND_IO_URING ? "io_uring" : "epoll",
+		(unsigned long long)tcp_uring_syscalls(ring));
+
+	free(clients);
+	tcp_uring_destroy(ring);
+}
+
+void test4(uint16_t port) {
+	test4_backend(port, 0);
+	test4_backend(port, TCP_URING_FORCE_EPOLL);
+	printf("test4 ok\n");
+}
+
+// ----------------------------------------------------------------
+// 测试5：分帧读取
+
+static uint32_t test5_frame_len(uint32_t i) {
+	// 大部分是小帧，偶尔一个接近max_frame的大帧
+	return i % 97 == 0 ? 3000 + i % 1000 : (i * 2654435761u >> 7) % 200;
+}
+
+static void test5_fill(uint8_t *p, uint32_t i, uint32_t len) {
+	uint32_t j;
+	for (j = 0; j < len; ++j) p[j] = (uint8_t)(i * 31 + j);
+}
+
+static void test5_check(const tcp_frame *fr, uint32_t i) {
+	uint32_t j;
+	if (fr->len != test5_frame_len(i)) {
+		exit(-1);
+	}
+	for (j = 0; j < fr->len; ++j) {
+		if (fr->data[j] != (uint8_t)(i * 31 + j)) {
+			exit(-1);
+		}
+	}
+}
+
+void test5() {
+	const uint32_t frames = 20000;
+	tcp_socket a, b;
+	tcp_framer *f;
+	tcp_frame fr;
+	uint8_t *stream = (uint8_t*)malloc(frames * 4100);
+	size_t stream_len = 0, off = 0;
+	uint32_t i, got = 0, reads = 0;
+	int32_t n;
+	int r;
+
+	// 长度前缀模式：随机切分写入，每次读取尽量多的数据
+	for (i = 0; i < frames; ++i) {
+		uint32_t len = test5_frame_len(i);
+		stream[stream_len++] = (uint8_t)(len >> 24);
+		stream[stream_len++] = (uint8_t)(len >> 16);
+		stream[stream_len++] = (uint8_t)(len >> 8);
+		stream[stream_len++] = (uint8_t)len;
+		test5_fill(stream + stream_len, i, len);
+		stream_len += len;
+	}
+
+	make_pair(&a, &b);
+	f = tcp_framer_create(16 * 1024, 4096);
+	srand(5);
+	while (got < frames) {
+		if (off < stream_len) {
+			size_t chunk = rand() % 8192 + 1;
+			if (chunk > stream_len - off) chunk = stream_len - off;
+			n = tcp_nb_write(&a, stream + off, (uint32_t)chunk);
+			if (n < 0) {
+				exit(-1);
+			}
+			off += n;
+		}
+		while ((n = tcp_framer_read(f, &b)) > 0) {
+			reads++;
+			while (1 == (r = tcp_framer_next(f, &fr))) {
+				test5_check(&fr, got++);
+			}
+			if (r != 0) {
+				exit(-1);
+			}
+		}
+		if (n != 0) {
+			exit(-1);
+		}
+	}
+	if (tcp_framer_buffered(f) != 0) {
+		exit(-1);
+	}
+	// 一次read得到多个帧，回绕时才拷贝
+	if (reads >= frames / 4 || tcp_framer_copies(f) >= frames / 4) {
+		exit(-1);
+	}
+	tcp_framer_destroy(f);
+
+	// 超过max_frame是协议错误
+	f = tcp_framer_create(0, 100);
+	{
+		uint8_t hdr[4] = {0, 0, 0, 101};
+		n = tcp_framer_feed(f, hdr, 4);
+		r = tcp_framer_next(f, &fr);
+		if (n != 4 || r != -1) {
+			exit(-1);
+		}
+	}
+	tcp_framer_destroy(f);
+
+	// 分隔符模式，分隔符可能被切开、可能跨越回绕
+	f = tcp_framer_create_delim(64, 32, (const uint8_t*)"\r\n", 2);
+	{
+		const char *text = "hello\r\n\r\nworld\r\nab\rc\r\n";
+		const char *expect[] = {"hello", "", "world", "ab\rc"};
+		size_t text_len = strlen(text);
+		int k, count = 0;
+		for (k = 0; k < 200; ++k) {
+			size_t p;
+			for (p = 0; p < text_len; ++p) {
+				// 每次只放入一个字节
+				n = tcp_framer_feed(f, (const uint8_t*)text + p, 1);
+				if (n != 1) {
+					exit(-1);
+				}
+				while (1 == (r = tcp_framer_next(f, &fr))) {
+					const char *e = expect[count++ % 4];
+					if (fr.len != strlen(e) || 0 != memcmp(fr.data, e, fr.len)) {
+						exit(-1);
+					}
+				}
+				if (r != 0) {
+					exit(-1);
+				}
+			}
+		}
+		if (count != 800) {
+			exit(-1);
+		}
+		// 超过max_frame还没有分隔符
+		memset(stream, 'x', 40);
+		n = tcp_framer_feed(f, stream, 40);
+		r = tcp_framer_next(f, &fr);
+		if (n != 40 || r != -1) {
+			exit(-1);
+		}
+	}
+	tcp_framer_destroy(f);
+
+	tcp_close(&a);
+	tcp_close(&b);
+	free(stream);
+	printf("test5 ok\n");
+}
+
+// ----------------------------------------------------------------
+// 测试6：单连接流水线请求，超时和连接失败
+
+#define TEST6_REQUESTS	20000
+#define TEST6_INFLIGHT	256
+
+typedef struct {
+	tcp_mux *mux;
+	uint32_t sent;
+	uint32_t ok;
+	uint32_t timeout;
+	uint32_t closed;
+	uint32_t max_inflight;
+} mux_state;
+
+static mux_state test6_state;
+
+static void test6_issue(mux_state *st);
+
+static void test6_cb(tcp_mux *mux, void *arg, int status, const uint8_t *data, uint32_t len) {
+	uint32_t i = (uint32_t)(uintptr_t)arg;
+	char expect[32];
+
+	(void)mux;
+	if (TCP_MUX_OK == status) {
+		// echo server原样返回请求
+		snprintf(expect, sizeof(expect), "req-%u", i);
+		if (len != strlen(expect) || 0 != memcmp(data, expect, len)) {
+			exit(-1);
+		}
+		test6_state.ok++;
+		test6_issue(&test6_state);
+	} else if (TCP_MUX_TIMEOUT == status) {
+		test6_state.timeout++;
+	} else {
+		test6_state.closed++;
+	}
+}
+
+static void test6_issue(mux_state *st) {
+	char buf[32];
+	int64_t id;
+	while (st->sent < TEST6_REQUESTS && tcp_mux_inflight(st->mux) < TEST6_INFLIGHT) {
+		int n = snprintf(buf, sizeof(buf), "req-%u", st->sent);
+		id = tcp_mux_request(st->mux, (uint8_t*)buf, n, 5000, test6_cb, (void*)(uintptr_t)st->sent);
+		if (id <= 0) {
+			exit(-1);
+		}
+		st->sent++;
+		if (tcp_mux_inflight(st->mux) > st->max_inflight) st->max_inflight = tcp_mux_inflight(st->mux);
+	}
+}
+
+void test6(uint16_t port) {
+	tcp_loop *loop = tcp_loop_create(64);
+	mux_state *st = &test6_state;
+	tcp_socket silent;
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	uint64_t start;
+	int64_t id;
+	int fillers[4];
+	int i;
+
+	// 流水线：同一个连接上保持TEST6_INFLIGHT个请求
+	memset(st, 0, sizeof(*st));
+	st->mux = tcp_mux_create(loop, "127.0.0.1", port, 1000, TEST6_INFLIGHT, 1024);
+	if (st->mux == NULL) {
+		exit(-1);
+	}
+	test6_issue(st);	// 连接建立之前的请求排队
+	while (st->ok < TEST6_REQUESTS) {
+		tcp_loop_run_once(loop, 1000);
+		if (tcp_mux_closed(st->mux)) {
+			exit(-1);
+		}
+	}
+	if (st->max_inflight != TEST6_INFLIGHT || st->timeout != 0 || st->closed != 0 || tcp_mux_inflight(st->mux) != 0) {
+		exit(-1);
+	}
+	tcp_mux_destroy(st->mux);
+
+	// 超时：对端只listen不accept，也不回应
+	silent.fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(silent.fd, (struct sockaddr*)&addr, sizeof(addr));
+	listen(silent.fd, 16);
+	getsockname(silent.fd, (struct sockaddr*)&addr, &len);
+
+	memset(st, 0, sizeof(*st));
+	st->mux = tcp_mux_create(loop, "127.0.0.1", ntohs(addr.sin_port), 1000, 16, 1024);
+	for (i = 0; i < 10; ++i) {
+		// 超时时间不同，按到期顺序逐个通知
+		id = tcp_mux_request(st->mux, (uint8_t*)"x", 1, 100 + i * 10, test6_cb, NULL);
+		if (id <= 0) {
+			exit(-1);
+		}
+	}
+	start = tcp_loop_now_ms(loop);
+	while (st->timeout < 10) {
+		tcp_loop_run_once(loop, 1000);
+	}
+	if (tcp_loop_now_ms(loop) - start < 190 || st->ok != 0) {
+		exit(-1);
+	}
+	// 请求数达到上限
+	for (i = 0; i < 16; ++i) {
+		id = tcp_mux_request(st->mux, (uint8_t*)"x", 1, 0, test6_cb, NULL);
+		if (id <= 0) {
+			exit(-1);
+		}
+	}
+	id = tcp_mux_request(st->mux, (uint8_t*)"x", 1, 0, test6_cb, NULL);
+	if (id != -1) {
+		exit(-1);
+	}
+	// 关闭时未完成的请求以TCP_MUX_CLOSED通知
+	tcp_mux_destroy(st->mux);
+	if (st->closed != 16) {
+		exit(-1);
+	}
+
+	// 一个一直没有回应的请求不影响槽位的复用：其他请求超时后槽位可以再分配，id不重复
+	memset(st, 0, sizeof(*st));
+	st->mux = tcp_mux_create(loop, "127.0.0.1", ntohs(addr.sin_port), 1000, 4, 1024);
+	id = tcp_mux_request(st->mux, (uint8_t*)"x", 1, 0, test6_cb, NULL);
+	if (id <= 0) {
+		exit(-1);
+	}
+	for (i = 0; i < 20; ++i) {
+		int64_t next = tcp_mux_request(st->mux, (uint8_t*)"x", 1, 10, test6_cb, NULL);
+		if (next <= 0 || next == id) {
+			exit(-1);
+		}
+		id = next;
+		while (st->timeout < (uint32_t)i + 1) {
+			tcp_loop_run_once(loop, 1000);
+		}
+	}
+	if (tcp_mux_inflight(st->mux) != 1) {
+		exit(-1);
+	}
+	tcp_mux_destroy(st->mux);
+	if (st->closed != 1) {
+		exit(-1);
+	}
+
+	// 连接建立之前的请求也会超时：accept队列已满，新连接的SYN被丢弃，连接一直进行中
+	listen(silent.fd, 0);
+	for (i = 0; i < 4; ++i) {
+		fillers[i] = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		connect(fillers[i], (struct sockaddr*)&addr, sizeof(addr));
+	}
+	usleep(50 * 1000);
+	memset(st, 0, sizeof(*st));
+	st->mux = tcp_mux_create(loop, "127.0.0.1", ntohs(addr.sin_port), 5000, 4, 1024);
+	id = tcp_mux_request(st->mux, (uint8_t*)"x", 1, 100, test6_cb, NULL);
+	if (id <= 0) {
+		exit(-1);
+	}
+	start = tcp_loop_now_ms(loop);
+	while (st->timeout == 0 && tcp_loop_now_ms(loop) - start < 2000) {
+		tcp_loop_run_once(loop, 100);
+	}
+	if (st->timeout != 1 || tcp_loop_now_ms(loop) - start >= 1000 || tcp_mux_closed(st->mux)) {
+		exit(-1);
+	}
+	tcp_mux_destroy(st->mux);
+	for (i = 0; i < 4; ++i) {
+		close(fillers[i]);
+	}
+	tcp_close(&silent);
+
+	// 连接失败
+	memset(st, 0, sizeof(*st));
+	st->mux = tcp_mux_create(loop, "127.0.0.1", 1, 1000, 16, 1024);
+	id = tcp_mux_request(st->mux, (uint8_t*)"x", 1, 0, test6_cb, NULL);
+	if (id <= 0) {
+		exit(-1);
+	}
+	while (!tcp_mux_closed(st->mux)) {
+		tcp_loop_run_once(loop, 1000);
+	}
+	id = tcp_mux_request(st->mux, (uint8_t*)"x", 1, 0, test6_cb, NULL);
+	if (st->closed != 1 || id != -1) {
+		exit(-1);
+	}
+	tcp_mux_destroy(st->mux);
+
+	tcp_loop_destroy(loop);
+	printf("test6 ok\n");
+}
+
+// ----------------------------------------------------------------
+// tcp_pool：预热、复用、健康检查、连接数上限和空闲回收
+
+static uint32_t test7_wait_idle(tcp_pool *pool, uint16_t port, uint32_t want) {
+	uint32_t idle = 0;
+	int i;
+
+	for (i = 0; i < 200; ++i) {
+		tcp_pool_stats(pool, "127.0.0.1", port, &idle, NULL);
+		if (idle == want) {
+			break;
+		}
+		usleep(10 * 1000);
+	}
+	return idle;
+}
+
+static void test7_echo(tcp_pool_conn *conn) {
+	uint8_t buf[16];
+	int32_t n = 0, r;
+
+	r = tcp_write(&conn->sock, (uint8_t*)"pool", 4, 1000);
+	if (r != 4) {
+		exit(-1);
+	}
+	while (n < 4) {
+		r = tcp_read(&conn->sock, buf + n, sizeof(buf) - n, 1000);
+		if (r <= 0) {
+			exit(-1);
+		}
+		n += r;
+	}
+	if (n != 4 || 0 != memcmp(buf, "pool", 4)) {
+		exit(-1);
+	}
+}
+
+static void test7(uint16_t port) {
+	tcp_pool_config cfg;
+	tcp_pool *pool;
+	tcp_pool_conn *conns[8], *c;
+	uint32_t idle, total;
+	int32_t r;
+	int fd, i;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.min_idle = 4;
+	cfg.max_conns = 8;
+	cfg.idle_timeout_ms = 200;
+	pool = tcp_pool_create(&cfg);
+	if (!pool) {
+		exit(-1);
+	}
+
+	// 后台预热
+	r = tcp_pool_stats(pool, "127.0.0.1", port, NULL, NULL);
+	if (r != -1) {
+		exit(-1);
+	}
+	r = tcp_pool_warm(pool, "127.0.0.1", port);
+	if (r != 0 || test7_wait_idle(pool, port, 4) != 4) {
+		exit(-1);
+	}
+
+	// 借出的是预热好的连接，归还后再借出的是同一个
+	c = tcp_pool_get(pool, "127.0.0.1", port, 1000);
+	if (!c) {
+		exit(-1);
+	}
+	fd = c->sock.fd;
+	test7_echo(c);
+	tcp_pool_put(pool, c, 1);
+	c = tcp_pool_get(pool, "127.0.0.1", port, 1000);
+	if (!c || c->sock.fd != fd) {
+		exit(-1);
+	}
+	tcp_pool_put(pool, c, 1);
+
+	// 达到上限后等待超时，有连接归还后可以借出
+	for (i = 0; i < 8; ++i) {
+		conns[i] = tcp_pool_get(pool, "127.0.0.1", port, 1000);
+		if (!conns[i]) {
+			exit(-1);
+		}
+	}
+	tcp_pool_stats(pool, "127.0.0.1", port, &idle, &total);
+	if (idle != 0 || total != 8) {
+		exit(-1);
+	}
+	c = tcp_pool_get(pool, "127.0.0.1", port, 50);
+	if (c) {
+		exit(-1);
+	}
+	tcp_pool_put(pool, conns[7], 1);
+	conns[7] = tcp_pool_get(pool, "127.0.0.1", port, 50);
+	if (!conns[7]) {
+		exit(-1);
+	}
+
+	// 已断开的连接不会被借出：关闭读方向后MSG_PEEK读到0
+	shutdown(conns[0]->sock.fd, SHUT_RD);
+	for (i = 7; i >= 0; --i) {
+		tcp_pool_put(pool, conns[i], 1);
+	}
+	c = tcp_pool_get(pool, "127.0.0.1", port, 1000);
+	if (!c) {
+		exit(-1);
+	}
+	test7_echo(c);
+	tcp_pool_stats(pool, "127.0.0.1", port, NULL, &total);
+	if (total != 7) {
+		exit(-1);
+	}
+	tcp_pool_put(pool, c, 0);
+
+	// 多余的空闲连接被回收，保留min_idle个
+	idle = test7_wait_idle(pool, port, 4);
+	tcp_pool_stats(pool, "127.0.0.1", port, NULL, &total);
+	if (idle != 4 || total != 4) {
+		exit(-1);
+	}
+
+	// 连接失败
+	c = tcp_pool_get(pool, "127.0.0.1", 1, 1000);
+	tcp_pool_stats(pool, "127.0.0.1", 1, &idle, &total);
+	if (c || idle != 0 || total != 0) {
+		exit(-1);
+	}
+
+	tcp_pool_destroy(pool);
+	printf("test7 ok\n");
+}
+
+// ----------------------------------------------------------------
+// tcp_zc：零拷贝发送、完成通知、sendfile、splice
+// 所有数据都是连续的计数序列，每次发送的长度都是256的倍数，可以用drain_check检查
+
+// MSG_ZEROCOPY只支持TCP/UDP，用回环上的TCP连接代替socketpair
+static void make_tcp_pair(tcp_socket *a, tcp_socket *b) {
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int lfd = socket(AF_INET, SOCK_STREAM, 0);
+	int r;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	r = bind(lfd, (struct sockaddr*)&addr, sizeof(addr));
+	if (0 == r) r = listen(lfd, 1);
+	if (0 == r) r = getsockname(lfd, (struct sockaddr*)&addr, &len);
+	if (0 == r) r = tcp_connect(a, (uint8_t*)"127.0.0.1", ntohs(addr.sin_port), 1000);
+	if (r != 0) {
+		exit(-1);
+	}
+	b->fd = accept(lfd, NULL, NULL);
+	if (b->fd < 0) {
+		exit(-1);
+	}
+	fcntl(b->fd, F_SETFL, fcntl(b->fd, F_GETFL) | O_NONBLOCK);
+	close(lfd);
+}
+
+static uint8_t test8_pattern[256 * 1024];
+
+// 发送n个字节的计数序列，对端同时读取检查，返回最后一次零拷贝发送的序号
+static int64_t test8_send(tcp_zc *zc, tcp_socket *b, uint32_t n, uint32_t *next, uint64_t *total) {
+	uint32_t off = 0;
+	int64_t seq, last = -1;
+	int32_t r;
+
+	while (off < n) {
+		r = tcp_zc_send(zc, test8_pattern + off, n - off, &seq);
+		if (r < 0) {
+			exit(-1);
+		}
+		off += r;
+		if (seq >= 0) last = seq;
+		drain_check(b, next, total);
+	}
+	return last;
+}
+
+static void test8_loop_cb(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	(void)loop;
+	*(uint32_t*)conn->udata |= events;
+}
+
+static void test8() {
+	tcp_socket a, b;
+	tcp_zc *zc;
+	tcp_zc_stat st;
+	uint32_t next = 0, events = 0;
+	uint64_t total = 0, expect = 0;
+	int64_t seq;
+	int32_t r;
+	int i;
+
+	for (i = 0; i < (int)sizeof(test8_pattern); ++i) {
+		test8_pattern[i] = (uint8_t)i;
+	}
+	make_tcp_pair(&a, &b);
+	zc = tcp_zc_create(&a, 16 * 1024);
+	if (!zc) {
+		exit(-1);
+	}
+	tcp_zc_get_stat(zc, &st);
+	if (!st.enabled) {
+		exit(-1);
+	}
+
+	// 小于阈值的数据直接拷贝，buf可以立即复用
+	seq = test8_send(zc, &b, 1024, &next, &total);
+	expect += 1024;
+	if (seq != -1) {
+		exit(-1);
+	}
+	tcp_zc_get_stat(zc, &st);
+	if (st.copy_sends < 1 || st.zerocopy_sends != 0) {
+		exit(-1);
+	}
+
+	// 大块数据零拷贝，等待完成通知
+	seq = test8_send(zc, &b, sizeof(test8_pattern), &next, &total);
+	expect += sizeof(test8_pattern);
+	if (seq < 0) {
+		exit(-1);
+	}
+	r = tcp_zc_wait(zc, seq, 1000);
+	if (r != 1 || !tcp_zc_done(zc, seq) || tcp_zc_outstanding(zc) != 0) {
+		exit(-1);
+	}
+	tcp_zc_get_stat(zc, &st);
+	if (st.zerocopy_sends < 1 || st.completions < 1) {
+		exit(-1);
+	}
+
+	// 在tcp_loop中完成通知以TCP_EV_ERRQUEUE送达，而不是TCP_EV_ERROR
+	{
+		tcp_loop *loop = tcp_loop_create(16);
+		tcp_conn conn;
+		r = tcp_loop_add(loop, &conn, a, test8_loop_cb, &events);
+		if (r != 0) {
+			exit(-1);
+		}
+		seq = test8_send(zc, &b, sizeof(test8_pattern), &next, &total);
+		expect += sizeof(test8_pattern);
+		for (i = 0; i < 100 && !tcp_zc_done(zc, seq); ++i) {
+			tcp_loop_run_once(loop, 10);
+			if (events & TCP_EV_ERRQUEUE) {
+				r = tcp_zc_reap(zc);
+				if (r < 0) {
+					exit(-1);
+				}
+			}
+		}
+		if (!tcp_zc_done(zc, seq) || !(events & TCP_EV_ERRQUEUE) || (events & TCP_EV_ERROR)) {
+			exit(-1);
+		}
+		tcp_loop_remove(loop, &conn);
+		tcp_loop_destroy(loop);
+	}
+
+	// 回环上内核总是拷贝，连续多次后自动退回普通send
+	tcp_zc_get_stat(zc, &st);
+	if (st.copied != st.completions) {
+		exit(-1);
+	}
+	for (i = 0; i < 100 && st.enabled; ++i) {
+		seq = test8_send(zc, &b, 64 * 1024, &next, &total);
+		expect += 64 * 1024;
+		r = tcp_zc_wait(zc, seq, 1000);
+		if (r != 1) {
+			exit(-1);
+		}
+		tcp_zc_get_stat(zc, &st);
+	}
+	if (st.enabled) {
+		exit(-1);
+	}
+	seq = test8_send(zc, &b, 64 * 1024, &next, &total);
+	expect += 64 * 1024;
+	if (seq != -1) {
+		exit(-1);
+	}
+
+	// sendfile：发送缓冲区满时返回0，文件读完后返回TCP_ZC_EOF
+	{
+		char path[] = "/tmp/tcp_zc_testXXXXXX";
+		int fd = mkstemp(path);
+		off_t off = 0;
+		ssize_t n;
+		if (fd < 0) {
+			exit(-1);
+		}
+		unlink(path);
+		for (i = 0; i < 4; ++i) {
+			n = write(fd, test8_pattern, sizeof(test8_pattern));
+			if (n != (ssize_t)sizeof(test8_pattern)) {
+				exit(-1);
+			}
+		}
+		while (off < 4 * (off_t)sizeof(test8_pattern)) {
+			n = tcp_zc_sendfile(zc, fd, &off, 4 * sizeof(test8_pattern) - off);
+			if (n < 0) {
+				exit(-1);
+			}
+			drain_check(&b, &next, &total);
+		}
+		expect += 4 * sizeof(test8_pattern);
+		n = tcp_zc_sendfile(zc, fd, &off, 1024);
+		if (n != TCP_ZC_EOF) {
+			exit(-1);
+		}
+		close(fd);
+	}
+
+	// splice：发送缓冲区满时返回0，管道为空时返回TCP_ZC_EMPTY，写端关闭后返回TCP_ZC_EOF
+	{
+		int p[2];
+		ssize_t n, moved = 0;
+		int full = 0;
+		r = pipe(p);
+		if (r != 0) {
+			exit(-1);
+		}
+		n = write(p[1], test8_pattern, 32 * 1024);
+		if (n != 32 * 1024) {
+			exit(-1);
+		}
+		while (moved < 32 * 1024) {
+			n = tcp_zc_splice(zc, p[0], 32 * 1024 - moved);
+			if (n < 0) {
+				exit(-1);
+			}
+			moved += n;
+			drain_check(&b, &next, &total);
+		}
+		n = tcp_zc_splice(zc, p[0], 1024);
+		if (n != TCP_ZC_EMPTY) {
+			exit(-1);
+		}
+		expect += 32 * 1024;
+
+		// 对端不读取，直到socket发送缓冲区满，这时管道中还有数据
+		for (i = 0; i < 4096 && !full; ++i) {
+			n = write(p[1], test8_pattern, 32 * 1024);
+			if (n != 32 * 1024) {
+				exit(-1);
+			}
+			expect += 32 * 1024;
+			for (moved = 0; moved < 32 * 1024; moved += n) {
+				n = tcp_zc_splice(zc, p[0], 32 * 1024 - moved);
+				if (n < 0) {
+					exit(-1);
+				}
+				if (0 == n) {
+					full = 1;
+					break;
+				}
+			}
+		}
+		if (!full) {
+			exit(-1);
+		}
+		while (moved < 32 * 1024) {
+			n = tcp_zc_splice(zc, p[0], 32 * 1024 - moved);
+			if (n < 0) {
+				exit(-1);
+			}
+			moved += n;
+			drain_check(&b, &next, &total);
+		}
+
+		close(p[1]);
+		n = tcp_zc_splice(zc, p[0], 1024);
+		if (n != TCP_ZC_EOF) {
+			exit(-1);
+		}
+		close(p[0]);
+	}
+
+	for (i = 0; i < 100 && total < expect; ++i) {
+		usleep(1000);
+		drain_check(&b, &next, &total);
+	}
+	if (total != expect) {
+		exit(-1);
+	}
+
+	tcp_zc_destroy(zc);
+	tcp_close(&a);
+	tcp_close(&b);
+	printf("test8 ok\n");
+}
+
+int main() {
+	echo_server server;
+	pthread_t tid;
+
+	echo_server_start(&server, &tid);
+	test1(server.port);
+	test2(server.port);
+	test3();
+	test4(server.port);
+	test5();
+	test6(server.port);
+	test7(server.port);
+	test8();
+	echo_server_stop(&server, tid);
+
+	return 0;
+}
@@ -0,0 +1,279 @@
+// 请求/回应吞吐测试：进程内的echo server，对比阻塞接口(tcp_write + tcp_read)、tcp_uring的epoll后端和io_uring后端
+// 统计客户端每个请求的系统调用次数和每秒请求数
+// 编译：gcc -O2 -o uring_bench uring_bench.c tcp_uring.c tcp_loop.c tcp_writer.c tcpclient.c -pthread
+// 用法：./uring_bench [连接数，默认100] [每个连接同时进行的请求数，默认1] [总请求数，默认200000] [消息大小，默认64]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "tcpclient.h"
+#include "tcp_loop.h"
+#include "tcp_writer.h"
+#include "tcp_uring.h"
+
+static int conns = 100;
+static int depth = 1;
+static long total_requests = 200000;
+static uint32_t msg_size = 64;
+
+static double now_sec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ----------------------------------------------------------------
+// echo server
+
+typedef struct {
+	tcp_conn conn;
+	tcp_writer *w;
+} echo_conn;
+
+static volatile int server_stop;
+
+static void echo_conn_cb(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	echo_conn *c = (echo_conn*)conn->udata;
+	uint8_t buf[16 * 1024];
+	int32_t n, r = 1;
+
+	while ((n = tcp_nb_read(&conn->sock, buf, sizeof(buf))) > 0) {
+		if (tcp_writer_write(c->w, buf, n) != n) {
+			n = -1;
+			break;
+		}
+	}
+	if (n == 0) {
+		r = tcp_writer_flush(c->w);
+		tcp_loop_want_write(loop, conn, r == 0);
+	}
+	if (n < 0 || r < 0 || (events & TCP_EV_ERROR)) {
+		tcp_loop_remove(loop, conn);
+		tcp_close(&conn->sock);
+		tcp_writer_destroy(c->w);
+		free(c);
+	}
+}
+
+static void echo_accept_cb(tcp_loop *loop, tcp_conn *conn, uint32_t events) {
+	int fd;
+	while ((fd = accept(conn->sock.fd, NULL, NULL)) >= 0) {
+		tcp_socket sock = {fd};
+		echo_conn *c = (echo_conn*)malloc(sizeof(echo_conn));
+		tcp_loop_add(loop, &c->conn, sock, echo_conn_cb, c);
+		c->w = tcp_writer_create(&c->conn.sock, 1024 * 1024, 0);
+	}
+}
+
+static void *echo_server(void *arg) {
+	tcp_loop *loop = (tcp_loop*)arg;
+	while (!server_stop) {
+		tcp_loop_run_once(loop, 50);
+	}
+	return NULL;
+}
+
+static uint16_t echo_server_start(pthread_t *tid, tcp_loop **loop, tcp_conn *listener) {
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	tcp_socket sock;
+
+	sock.fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(sock.fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(sock.fd, 4096) < 0) {
+		return 0;
+	}
+	getsockname(sock.fd, (struct sockaddr*)&addr, &len);
+
+	*loop = tcp_loop_create(1024);
+	tcp_loop_add(*loop, listener, sock, echo_accept_cb, NULL);
+	pthread_create(tid, NULL, echo_server, *loop);
+	return ntohs(addr.sin_port);
+}
+
+// ----------------------------------------------------------------
+// 阻塞接口：每个连接一次只有一个请求，轮流发送
+
+static void bench_blocking(uint16_t port) {
+	tcp_socket *socks = (tcp_socket*)calloc(conns, sizeof(tcp_socket));
+	uint8_t *req = (uint8_t*)calloc(1, msg_size);
+	uint8_t *resp = (uint8_t*)malloc(msg_size);
+	uint64_t syscalls = 0;
+	long done = 0;
+	double t0, t1;
+	int i;
+
+	for (i = 0; i < conns; ++i) {
+		if (tcp_connect(&socks[i], (uint8_t*)"127.0.0.1", port, 1000) < 0) {
+			printf("blocking: connect failed\n");
+			return;
+		}
+	}
+
+	t0 = now_sec();
+	while (done < total_requests) {
+		for (i = 0; i < conns && done < total_requests; ++i, ++done) {
+			uint32_t got = 0;
+			int32_t n;
+			// tcp_write和tcp_read各是一次poll加一次write/read
+			if (tcp_write(&socks[i], req, msg_size, 1000) != (int32_t)msg_size) {
+				printf("blocking: write failed\n");
+				return;
+			}
+			syscalls += 2;
+			while (got < msg_size) {
+				n = tcp_read(&socks[i], resp + got, msg_size - got, 1000);
+				syscalls += 2;
+				if (n <= 0) {
+					printf("blocking: read failed\n");
+					return;
+				}
+				got += n;
+			}
+		}
+	}
+	t1 = now_sec();
+
+	printf("%-10s %10.0f req/s %8.2f syscalls/req\n", "blocking", done / (t1 - t0), (double)syscalls / done);
+	for (i = 0; i < conns; ++i) {
+		tcp_close(&socks[i]);
+	}
+	free(socks);
+	free(req);
+	free(resp);
+}
+
+// ----------------------------------------------------------------
+// tcp_uring：每个连接同时有depth个请求
+
+typedef struct {
+	tcp_uring_conn conn;
+	uint32_t pending_bytes;		// 当前回应已经收到的字节数
+} bench_conn;
+
+static uint8_t *bench_req;
+static long bench_sent;
+static long bench_done;
+static int bench_closed;
+
+static void bench_send(tcp_uring *ring, bench_conn *c) {
+	if (bench_sent < total_requests) {
+		bench_sent++;
+		tcp_uring_send(ring, &c->conn, bench_req, msg_size);
+	}
+}
+
+static void bench_cb(tcp_uring *ring, tcp_uring_conn *conn, int op, int32_t res, const uint8_t *data) {
+	bench_conn *c = (bench_conn*)conn->udata;
+	int i;
+
+	switch (op) {
+	case TCP_URING_OP_CONNECT:
+		if (res < 0) {
+			printf("uring: connect failed %d\n", res);
+			exit(-1);
+		}
+		tcp_uring_recv(ring, conn);
+		for (i = 0; i < depth; ++i) {
+			bench_send(ring, c);
+		}
+		break;
+	case TCP_URING_OP_RECV:
+		if (res <= 0) {
+			break;
+		}
+		c->pending_bytes += res;
+		while (c->pending_bytes >= msg_size) {
+			c->pending_bytes -= msg_size;
+			bench_done++;
+			bench_send(ring, c);
+		}
+		if (bench_done == total_requests) {
+			tcp_uring_stop(ring);
+		}
+		break;
+	case TCP_URING_OP_CLOSE:
+		bench_closed++;
+		break;
+	}
+}
+
+static void bench_uring(uint16_t port, int flags) {
+	tcp_uring *ring = tcp_uring_create(1024, 256, 16 * 1024, flags);
+	bench_conn *cs = (bench_conn*)calloc(conns, sizeof(bench_conn));
+	const char *name;
+	uint64_t syscalls;
+	double t0, t1;
+	int i;
+
+	if (!ring) {
+		printf("tcp_uring_create failed\n");
+		return;
+	}
+	name = tcp_uring_backend(ring) == TCP_URING_BACKEND_IO_URING ? "io_uring" : "epoll";
+	if (!(flags & TCP_URING_FORCE_EPOLL) && tcp_uring_backend(ring) != TCP_URING_BACKEND_IO_URING) {
+		printf("io_uring not available, skipped\n");
+		tcp_uring_destroy(ring);
+		free(cs);
+		return;
+	}
+
+	bench_sent = bench_done = 0;
+	bench_closed = 0;
+	// 先建立连接，不计入统计
+	for (i = 0; i < conns; ++i) {
+		tcp_uring_connect(ring, &cs[i].conn, "127.0.0.1", port, bench_cb, &cs[i]);
+	}
+	syscalls = tcp_uring_syscalls(ring);
+	t0 = now_sec();
+	tcp_uring_run(ring);
+	t1 = now_sec();
+	syscalls = tcp_uring_syscalls(ring) - syscalls;
+
+	printf("%-10s %10.0f req/s %8.2f syscalls/req\n", name, bench_done / (t1 - t0), (double)syscalls / bench_done);
+
+	for (i = 0; i < conns; ++i) {
+		tcp_uring_close(ring, &cs[i].conn);
+	}
+	while (bench_closed < conns) {
+		tcp_uring_run_once(ring, 100);
+	}
+	tcp_uring_destroy(ring);
+	free(cs);
+}
+
+int main(int argc, char *argv[]) {
+	pthread_t tid;
+	tcp_loop *server_loop;
+	tcp_conn listener;
+	uint16_t port;
+
+	if (argc > 1) conns = atoi(argv[1]);
+	if (argc > 2) depth = atoi(argv[2]);
+	if (argc > 3) total_requests = atol(argv[3]);
+	if (argc > 4) msg_size = (uint32_t)atoi(argv[4]);
+
+	bench_req = (uint8_t*)calloc(1, msg_size);
+	port = echo_server_start(&tid, &server_loop, &listener);
+	if (0 == port) {
+		printf("echo server start failed\n");
+		return -1;
+	}
+	printf("conns[%d] depth[%d] requests[%ld] msg_size[%u]\n", conns, depth, total_requests, msg_size);
+
+	bench_blocking(port);
+	bench_uring(port, TCP_URING_FORCE_EPOLL);
+	bench_uring(port, 0);
+
+	server_stop = 1;
+	pthread_join(tid, NULL);
+	free(bench_req);
+	return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+
+// gcc -O2 -DTRACE_ENABLE -o test test.c trace.c -pthread
+
+static void leaf() {
+	TRACE_SCOPE("leaf");
+	TRACE_INSTANT("tick");
+}
+
+static void *worker(void *arg) {
+	int i;
+	for (i = 0; i < 1000; ++i) {
+		TRACE_SCOPE("worker");
+		leaf();
+	}
+	return NULL;
+}
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main() {
+	pthread_t t1, t2;
+	pthread_create(&t1, NULL, worker, NULL);
+	pthread_create(&t2, NULL, worker, NULL);
+	pthread_join(t1, NULL);
+	pthread_join(t2, NULL);
+
+	// 每个线程保留最新的TRACE_RING_SIZE字节
+	int n = trace_dump("/tmp/trace_test.json");
+	printf("dump: %d events\n", n);
+#ifdef TRACE_ENABLE
+	if (n != 2 * 1000 * 5) {
+		exit(-1);
+	}
+#endif
+
+	// 单个事件的开销
+	int i, loops = 1000000;
+	uint64_t begin = now_ns();
+	for (i = 0; i < loops; ++i) {
+		TRACE_INSTANT("overhead");
+	}
+	printf("overhead: %.1f ns/event\n", (double)(now_ns() - begin) / loops);
+
+	return 0;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+#include "../ringbuffer/rb_lossy.h"
+
+// 固定32字节，ringbuffer容量是32的倍数，按事件对齐读取时不会读到半个事件
+typedef struct {
+	uint64_t ts;		// CLOCK_MONOTONIC，纳秒
+	const char *name;
+	uint32_t tid;
+	char ph;
+	char pad[11];
+} trace_record_t;
+
+typedef struct {
+	rb_lossy_t *ring;
+	uint32_t tid;
+} trace_thread_t;
+
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static trace_thread_t g_threads[TRACE_MAX_THREADS];
+static int g_thread_count = 0;
+
+static __thread rb_lossy_t *t_ring = NULL;
+static __thread uint32_t t_tid = 0;
+static __thread int t_disabled = 0;
+
+// 线程第一次记录事件时注册，之后只访问线程私有的ringbuffer
+static rb_lossy_t *trace_thread_ring() {
+	if (t_ring || t_disabled) {
+		return t_ring;
+	}
+
+	pthread_mutex_lock(&g_mutex);
+	if (g_thread_count < TRACE_MAX_THREADS) {
+		t_ring = rb_lossy_malloc(TRACE_RING_SIZE);
+		t_tid = (uint32_t)syscall(SYS_gettid);
+		if (t_ring) {
+			g_threads[g_thread_count].ring = t_ring;
+			g_threads[g_thread_count].tid = t_tid;
+			g_thread_count++;
+		}
+	}
+	if (!t_ring) {
+		t_disabled = 1;
+	}
+	pthread_mutex_unlock(&g_mutex);
+
+	return t_ring;
+}
+
+void trace_event(const char *name, char ph) {
+	rb_lossy_t *ring = trace_thread_ring();
+	struct timespec ts;
+	trace_record_t rec;
+
+	if (!ring) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec.ts = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	rec.name = name;
+	rec.tid = t_tid;
+	rec.ph = ph;
+	rb_lossy_write(ring, &rec, sizeof(rec));
+}
+
+void trace_scope_end(const char **name) {
+	trace_event(*name, TRACE_PH_END);
+}
+
+static void trace_write_string(FILE *fp, const char *s) {
+	fputc('"', fp);
+	for (; *s; ++s) {
+		if ('"' == *s || '\\' == *s) {
+			fputc('\\', fp);
+			fputc(*s, fp);
+		} else if ((unsigned char)*s < 0x20) {
+			fprintf(fp, "\\u%04x", *s);
+		} else {
+			fputc(*s, fp);
+		}
+	}
+	fputc('"', fp);
+}
+
+int trace_dump(const char *path) {
+	trace_thread_t threads[TRACE_MAX_THREADS];
+	int thread_count, i, count = 0;
+	size_t n, j;
+	pid_t pid = getpid();
+
+	FILE *fp = fopen(path, "w");
+	if (!fp) {
+		return -1;
+	}
+
+	trace_record_t *recs = (trace_record_t*)malloc(TRACE_RING_SIZE);
+	if (!recs) {
+		fclose(fp);
+		return -1;
+	}
+
+	pthread_mutex_lock(&g_mutex);
+	thread_count = g_thread_count;
+	memcpy(threads, g_threads, sizeof(trace_thread_t) * thread_count);
+	pthread_mutex_unlock(&g_mutex);
+
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", fp);
+	for (i = 0; i < thread_count; ++i) {
+		n = rb_lossy_read_latest(threads[i].ring, recs, TRACE_RING_SIZE) / sizeof(trace_record_t);
+		for (j = 0; j < n; ++j) {
+			fputs(count ? ",\n" : "\n", fp);
+			fputs("{\"name\":", fp);
+			trace_write_string(fp, recs[j].name);
+			fprintf(fp, ",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%u%s}",
+				recs[j].ph, (unsigned long long)(recs[j].ts / 1000), (unsigned)(recs[j].ts % 1000),
+				(int)pid, recs[j].tid, TRACE_PH_INSTANT == recs[j].ph ? ",\"s\":\"t\"" : "");
+			count++;
+		}
+	}
+	fputs("\n]}\n", fp);
+
+	free(recs);
+	if (fclose(fp) != 0) {
+		return -1;
+	}
+	return count;
+}
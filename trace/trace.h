@@ -0,0 +1,74 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+
+// 轻量级的线程内事件跟踪，每个线程一个覆盖写的ringbuffer（rb_lossy_t），记录时不加锁、不申请内存，
+// 只保留每个线程最新的TRACE_RING_SIZE字节事件，可通过trace_dump导出为Chrome/Perfetto可以打开的JSON
+//
+// 编译时定义TRACE_ENABLE才会记录事件，否则所有TRACE_*宏为空，没有任何开销
+// 事件名必须是字符串常量（只记录指针）
+//
+// 用法：
+//   void foo() {
+//       TRACE_SCOPE("foo");    // 进入时记录begin事件，离开作用域时记录end事件
+//       TRACE_INSTANT("bar");  // 记录一个瞬时事件
+//   }
+//   trace_dump("trace.json");
+
+#define TRACE_RING_SIZE		(1 << 20)	// 每个线程的buffer大小
+#define TRACE_MAX_THREADS	256			// 最多跟踪的线程数，超出的线程不记录
+
+#define TRACE_PH_BEGIN		'B'
+#define TRACE_PH_END		'E'
+#define TRACE_PH_INSTANT	'i'
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 记录一个事件，ph为TRACE_PH_*
+void trace_event(const char *name, char ph);
+
+// 将所有线程的事件导出为Chrome trace格式的JSON文件，成功返回导出的事件数，失败返回-1
+// 可以在其他线程仍在记录时调用
+int trace_dump(const char *path);
+
+// TRACE_SCOPE在C中使用的清理函数
+void trace_scope_end(const char **name);
+
+#ifdef __cplusplus
+} /* extern "C" */
+
+class trace_scope {
+public:
+	explicit trace_scope(const char *name): _name(name) { trace_event(_name, TRACE_PH_BEGIN); }
+	~trace_scope() { trace_event(_name, TRACE_PH_END); }
+	trace_scope(const trace_scope &rhs) = delete;
+	trace_scope& operator = (const trace_scope &rhs) = delete;
+private:
+	const char *_name;
+};
+#endif
+
+#define TRACE_CONCAT_(a, b)	a##b
+#define TRACE_CONCAT(a, b)	TRACE_CONCAT_(a, b)
+
+#ifdef TRACE_ENABLE
+#ifdef __cplusplus
+#define TRACE_SCOPE(name)	trace_scope TRACE_CONCAT(_trace_scope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)	const char *TRACE_CONCAT(_trace_scope_, __LINE__) __attribute__((cleanup(trace_scope_end))) = \
+								(trace_event(name, TRACE_PH_BEGIN), name)
+#endif
+#define TRACE_BEGIN(name)	trace_event(name, TRACE_PH_BEGIN)
+#define TRACE_END(name)		trace_event(name, TRACE_PH_END)
+#define TRACE_INSTANT(name)	trace_event(name, TRACE_PH_INSTANT)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_BEGIN(name)
+#define TRACE_END(name)
+#define TRACE_INSTANT(name)
+#endif
+
+#endif /* __TRACE_H__ */